@@ -0,0 +1,212 @@
+# benchmark.py
+"""Benchmark suite for the validator (run it with `make bench`).
+
+Generates synthetic rosters with generate_roster and times each stage in
+process through libdataloom.so: load (parse), validate (validators,
+duplicate detection and cross-field rules) and save (CSV output). Reports:
+
+  stages      rows/s and MB/s per stage at the largest size
+  validators  cost of each validator family, measured by validating with a
+              schema that binds only that family's columns, minus a run with
+              no validators (or with only the family it reads, see DEPENDS_ON)
+  threads     validate-stage throughput and speedup per --threads value
+  sizes       rows/s per stage at every size
+
+Timings are the best of --runs runs. The log is discarded inside the
+library, so the numbers exclude log file I/O.
+"""
+import argparse
+import json
+import os
+import subprocess
+import sys
+import time
+
+import dataloom
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+GENERATOR = os.path.join(HERE, "generate_roster")
+SCHEMA = os.path.join(HERE, "schema.ini")
+
+# Validators that read another column are timed on top of that column's validator
+DEPENDS_ON = {"email": "control_number", "disability_type": "disability"}
+
+
+def parse_list(text):
+    return [int(float(item)) for item in text.split(",") if item]
+
+
+def generate(work_dir, rows, args):
+    path = os.path.join(work_dir, "roster_%d_s%d_e%g_d%g.csv" % (rows, args.seed, args.error_rate, args.duplicate_rate))
+    if not os.path.exists(path):
+        print("Generating %s rows..." % format(rows, ","), flush=True)
+        subprocess.run([GENERATOR, str(rows), path, "--seed", str(args.seed), "--error-rate", str(args.error_rate),
+                        "--duplicate-rate", str(args.duplicate_rate)], check=True)
+    return path
+
+
+def run_stages(path, options, output):
+    """Seconds spent in load, validate and save for one processor"""
+    with dataloom.Processor(options, keep_log=False) as processor:
+        start = time.perf_counter()
+        processor.load_file(path)
+        loaded = time.perf_counter()
+        processor.process()
+        validated = time.perf_counter()
+        processor.save(output)
+        saved = time.perf_counter()
+        rows = processor.row_count()
+    return rows, {"load": loaded - start, "validate": validated - loaded, "save": saved - validated}
+
+
+def best_stages(path, options, output, runs):
+    best = None
+    for _ in range(runs):
+        rows, times = run_stages(path, options, output)
+        best = times if best is None else {stage: min(best[stage], times[stage]) for stage in times}
+    return rows, best
+
+
+def schema_sections():
+    """(code, validator, lines) for every [code] section of schema.ini"""
+    sections = []
+    with open(SCHEMA, encoding="utf-8") as file:
+        for line in file:
+            stripped = line.strip()
+            if stripped.startswith("["):
+                sections.append([stripped[1:-1], "none", []])
+            elif sections and "=" in stripped and not stripped.startswith(";"):
+                key, value = (part.strip() for part in stripped.split("=", 1))
+                if key == "validator":
+                    sections[-1][1] = value
+                sections[-1][2].append(stripped)
+    return sections
+
+
+def write_schema(path, sections):
+    with open(path, "w", encoding="utf-8") as file:
+        for code, _, lines in sections:
+            file.write("[%s]\n%s\n\n" % (code, "\n".join(lines)))
+    return path
+
+
+def table(title, header, rows):
+    print()
+    print(title)
+    widths = [max(len(str(cell)) for cell in column) for column in zip(header, *rows)]
+    for row in [header] + rows:
+        print("  " + "  ".join(str(cell).rjust(width) if i else str(cell).ljust(width)
+                               for i, (cell, width) in enumerate(zip(row, widths))))
+
+
+def rate(count, seconds):
+    return count / seconds if seconds > 0 else float("inf")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--sizes", default="10000,100000,1000000", help="Row counts, comma-separated")
+    parser.add_argument("--threads", help="--threads values to compare (default 1, 2, 4, ... up to the cores)")
+    parser.add_argument("--validator-rows", type=int, default=200000, help="Rows for the per-validator runs")
+    parser.add_argument("--runs", type=int, default=3, help="Runs per measurement; the best is kept")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--error-rate", type=float, default=0.05)
+    parser.add_argument("--duplicate-rate", type=float, default=0.01)
+    parser.add_argument("--work-dir", default=os.path.join(HERE, "bench_data"),
+                        help="Where generated rosters are cached and outputs written")
+    parser.add_argument("--json", help="Also write the results to this file")
+    args = parser.parse_args()
+
+    if not dataloom.available() or not os.path.exists(GENERATOR):
+        sys.exit("Build first: make lib generator")
+    os.makedirs(args.work_dir, exist_ok=True)
+    output = os.path.join(args.work_dir, "output.csv")
+    sizes = sorted(parse_list(args.sizes))
+    cores = os.cpu_count() or 1
+    if args.threads:
+        thread_counts = parse_list(args.threads)
+    else:
+        thread_counts = [1]
+        while thread_counts[-1] * 2 <= cores:
+            thread_counts.append(thread_counts[-1] * 2)
+        if thread_counts[-1] != cores:
+            thread_counts.append(cores)
+    results = {"cores": cores, "runs": args.runs, "seed": args.seed, "error_rate": args.error_rate,
+               "duplicate_rate": args.duplicate_rate}
+
+    # Size scaling; the largest size also gives the per-stage table
+    size_rows = []
+    results["sizes"] = []
+    for size in sizes:
+        path = generate(args.work_dir, size, args)
+        rows, times = best_stages(path, ["--threads", str(cores)], output, args.runs)
+        total = sum(times.values())
+        entry = {"rows": rows, "bytes": os.path.getsize(path), "seconds": times}
+        results["sizes"].append(entry)
+        size_rows.append([format(rows, ",")] + ["%.0f" % rate(rows, times[s]) for s in ("load", "validate", "save")] +
+                         ["%.0f" % rate(rows, total)])
+
+    largest = results["sizes"][-1]
+    stage_rows = []
+    for stage, seconds in largest["seconds"].items():
+        stage_rows.append([stage, "%.3f" % seconds, "%.0f" % rate(largest["rows"], seconds),
+                           "%.1f" % (rate(largest["bytes"], seconds) / 1e6)])
+    table("Stages (%s rows, %.1f MB, %d threads)" % (format(largest["rows"], ","), largest["bytes"] / 1e6, cores),
+          ["stage", "seconds", "rows/s", "MB/s"], stage_rows)
+    table("Size scaling (rows/s, %d threads)" % cores, ["rows", "load", "validate", "save", "total"], size_rows)
+
+    # Per-validator cost, single-threaded so families are comparable
+    path = generate(args.work_dir, args.validator_rows, args)
+    sections = schema_sections()
+    baseline_schema = write_schema(os.path.join(args.work_dir, "schema_none.ini"),
+                                   [(code, "none", ["validator = none"]) for code, _, _ in sections[:1]])
+    _, baseline = best_stages(path, ["--threads", "1", "--schema", baseline_schema], output, args.runs)
+    families = {}
+    for section in sections:
+        families.setdefault(section[1], []).append(section)
+    validator_rows = []
+    results["validators"] = {"rows": args.validator_rows, "baseline_seconds": baseline["validate"], "families": {}}
+    _, everything = best_stages(path, ["--threads", "1", "--schema", SCHEMA], output, args.runs)
+    validate_seconds = {}
+    for family in sorted(families, key=lambda name: name in DEPENDS_ON):
+        if family == "none":
+            continue
+        members = families[family]
+        bound = members + families.get(DEPENDS_ON.get(family), [])
+        schema = write_schema(os.path.join(args.work_dir, "schema_%s.ini" % family), bound)
+        _, times = best_stages(path, ["--threads", "1", "--schema", schema], output, args.runs)
+        validate_seconds[family] = times["validate"]
+        below = validate_seconds.get(DEPENDS_ON.get(family), baseline["validate"])
+        cost = max(times["validate"] - below, 0.0)
+        results["validators"]["families"][family] = {"columns": [code for code, _, _ in members], "seconds": cost}
+        validator_rows.append([family, ",".join(code for code, _, _ in members), "%.3f" % cost,
+                               "%.0f" % rate(args.validator_rows, cost) if cost >= 0.0005 else "-"])
+    validator_rows.sort(key=lambda row: -float(row[2]))
+    validator_rows.append(["all (schema.ini)", "", "%.3f" % (everything["validate"] - baseline["validate"]),
+                           "%.0f" % rate(args.validator_rows, everything["validate"] - baseline["validate"])])
+    table("Validators (%s rows, 1 thread; validate time above a run with no validators, %.3f s)" %
+          (format(args.validator_rows, ","), baseline["validate"]),
+          ["validator", "columns", "seconds", "rows/s"], validator_rows)
+
+    # Thread scaling of the validate stage at the largest size
+    path = generate(args.work_dir, sizes[-1], args)
+    thread_rows = []
+    results["threads"] = []
+    single = None
+    for threads in thread_counts:
+        rows, times = best_stages(path, ["--threads", str(threads)], output, args.runs)
+        single = single or times["validate"]
+        results["threads"].append({"threads": threads, "validate_seconds": times["validate"]})
+        thread_rows.append([threads, "%.3f" % times["validate"], "%.0f" % rate(rows, times["validate"]),
+                            "%.2fx" % (single / times["validate"])])
+    table("Thread scaling (validate, %s rows, %d cores)" % (format(sizes[-1], ","), cores),
+          ["threads", "seconds", "rows/s", "speedup"], thread_rows)
+
+    if args.json:
+        with open(args.json, "w", encoding="utf-8") as file:
+            json.dump(results, file, indent=2)
+        print("\nResults written to %s" % args.json)
+
+
+if __name__ == "__main__":
+    main()
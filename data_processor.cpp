@@ -10,112 +10,5716 @@
 #include <sstream>
 #include <regex>
 #include <unordered_set>
+#include <unordered_map>
 #include <memory>
 #include <iomanip>
+#include <string_view>
+#include <limits>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <iterator>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <charconv>
+#include <cstring>
+#include <cerrno>
+#include <deque>
+#include <set>
+#include <filesystem>
+#include <new>
+#include <cstdlib>
+#include <ctime>
 
-// Simple CSV-based data structure
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(DATALOOM_NO_SIMD)
+#define DATALOOM_X86_SIMD 1
+#include <immintrin.h>
+#endif
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Read-only view of a whole input file. On POSIX the file is mmapped so cells
+// can point straight into the page cache; elsewhere it is read into a buffer.
+// It can also view bytes owned by the caller, which must outlive it.
+class MappedFile {
+private:
+    const char* mapped = nullptr;
+    size_t length = 0;
+    size_t released = 0;
+    std::string fallback;
+    std::string_view borrowed;
+
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) return false;
+        fallback.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        length = fallback.size();
+        return true;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+
+        length = static_cast<size_t>(st.st_size);
+        if (length > 0) {
+            void* addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED) {
+                ::close(fd);
+                length = 0;
+                return false;
+            }
+            madvise(addr, length, MADV_SEQUENTIAL);
+            mapped = static_cast<const char*>(addr);
+        }
+        ::close(fd);
+        return true;
+#endif
+    }
+
+    void borrow(std::string_view bytes) {
+        close();
+        borrowed = bytes;
+    }
+
+    std::string_view view() const {
+        if (mapped) return std::string_view(mapped, length);
+        if (borrowed.data()) return borrowed;
+        return std::string_view(fallback.data(), fallback.size());
+    }
+
+    // Hint that the bytes before offset will not be read again so their pages
+    // can be dropped from the resident set
+    void release(size_t offset) {
+#ifndef _WIN32
+        if (!mapped) return;
+        static const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t end = std::min(offset, length) / page * page;
+        if (end > released) {
+            madvise(const_cast<char*>(mapped) + released, end - released, MADV_DONTNEED);
+            released = end;
+        }
+#else
+        (void)offset;
+#endif
+    }
+
+    void close() {
+#ifndef _WIN32
+        if (mapped) {
+            munmap(const_cast<char*>(mapped), length);
+        }
+#endif
+        mapped = nullptr;
+        length = 0;
+        released = 0;
+        fallback.clear();
+        borrowed = std::string_view();
+    }
+
+    ~MappedFile() {
+        close();
+    }
+};
+
+// Bump allocator for cell text that does not live in the mapped input:
+// unescaped quoted fields and auto-corrected values. Text is copied into large
+// blocks, so views into it stay valid until reset(), which frees a whole
+// dataset at once. Up to kMaxSpare standard blocks are kept for reuse.
+class CellArena {
+private:
+    static constexpr size_t kBlockSize = 64 * 1024;
+    static constexpr size_t kMaxSpare = 64;
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::vector<std::unique_ptr<char[]>> large_blocks;
+    std::vector<std::unique_ptr<char[]>> spare;
+    char* current = nullptr;
+    size_t used = kBlockSize;
+
+    char* allocate() {
+        if (spare.empty()) {
+            blocks.emplace_back(new char[kBlockSize]);
+        } else {
+            blocks.push_back(std::move(spare.back()));
+            spare.pop_back();
+        }
+        return blocks.back().get();
+    }
+
+public:
+    std::string_view store(std::string_view text) {
+        if (text.empty()) return std::string_view();
+        char* dest;
+        if (text.size() > kBlockSize / 4) {
+            // Large values get a block of their own so the current one keeps filling
+            large_blocks.emplace_back(new char[text.size()]);
+            dest = large_blocks.back().get();
+        } else {
+            if (used + text.size() > kBlockSize) {
+                current = allocate();
+                used = 0;
+            }
+            dest = current + used;
+            used += text.size();
+        }
+        std::memcpy(dest, text.data(), text.size());
+        return std::string_view(dest, text.size());
+    }
+
+    // Take over another arena's blocks; views into them stay valid
+    void absorb(CellArena&& other) {
+        for (auto& block : other.blocks) {
+            blocks.push_back(std::move(block));
+        }
+        for (auto& block : other.large_blocks) {
+            large_blocks.push_back(std::move(block));
+        }
+        other.blocks.clear();
+        other.reset();
+    }
+
+    void reset() {
+        for (auto& block : blocks) {
+            if (spare.size() == kMaxSpare) break;
+            spare.push_back(std::move(block));
+        }
+        blocks.clear();
+        large_blocks.clear();
+        current = nullptr;
+        used = kBlockSize;
+    }
+};
+
+// 64-bit finalizer: spreads every input bit over the whole word
+inline uint64_t mixKey(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Fast non-cryptographic hash of a byte string, 8 bytes per step. Chaining
+// calls through seed hashes a sequence of strings; the length is mixed in,
+// so ("ab", "c") and ("a", "bc") differ.
+inline uint64_t hashBytes(std::string_view bytes, uint64_t seed = 0) {
+    uint64_t h = seed ^ (bytes.size() * 0x9e3779b97f4a7c15ULL);
+    size_t i = 0;
+    for (; i + 8 <= bytes.size(); i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes.data() + i, sizeof(word));
+        h = (h ^ (word * 0x87c37b91114253d5ULL)) * 0x4cf5ad432745937fULL;
+        h ^= h >> 29;
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, bytes.data() + i, bytes.size() - i);
+    return mixKey(h ^ tail);
+}
+
+// Classifies 64 bytes of CSV text at a time: bit i of the mask is set when
+// byte i is ',', '"', '\n' or '\r'. AVX2 or SSE2 is picked at run time on x86;
+// other targets, or builds with DATALOOM_NO_SIMD, use the scalar loop.
+class StructuralScanner {
+public:
+    using BlockMask = uint64_t (*)(const char* block);
+
+    static BlockMask blockMask() {
+        static const BlockMask selected = select();
+        return selected;
+    }
+
+    static const char* name() {
+        BlockMask selected = blockMask();
+#ifdef DATALOOM_X86_SIMD
+        if (selected == avx2Mask) return "avx2";
+        if (selected == sse2Mask) return "sse2";
+#endif
+        return selected == scalarMask ? "scalar" : "unknown";
+    }
+
+    // Eight bytes per step: a byte of (word ^ pattern) is zero where it matches
+    static uint64_t scalarMask(const char* block) {
+        constexpr uint64_t kOnes = 0x0101010101010101ULL;
+        constexpr uint64_t kLow7 = 0x7F7F7F7F7F7F7F7FULL;
+        auto zeroBytes = [](uint64_t x) {
+            return ~(((x & kLow7) + kLow7) | x | kLow7);
+        };
+        uint64_t mask = 0;
+        for (size_t i = 0; i < 8; ++i) {
+            uint64_t word;
+            std::memcpy(&word, block + 8 * i, sizeof(word));
+            uint64_t hits = zeroBytes(word ^ (kOnes * ',')) | zeroBytes(word ^ (kOnes * '"')) |
+                            zeroBytes(word ^ (kOnes * '\n')) | zeroBytes(word ^ (kOnes * '\r'));
+            // Gather the high bit of each byte into 8 bits, in byte order
+            uint64_t bits = ((hits >> 7) * 0x0102040810204080ULL) >> 56;
+            mask |= bits << (8 * i);
+        }
+        return mask;
+    }
+
+#ifdef DATALOOM_X86_SIMD
+    __attribute__((target("sse2")))
+    static uint64_t sse2Mask(const char* block) {
+        const __m128i comma = _mm_set1_epi8(',');
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i lf = _mm_set1_epi8('\n');
+        const __m128i cr = _mm_set1_epi8('\r');
+        uint64_t mask = 0;
+        for (int i = 0; i < 4; ++i) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+            __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, comma), _mm_cmpeq_epi8(bytes, quote)),
+                                        _mm_or_si128(_mm_cmpeq_epi8(bytes, lf), _mm_cmpeq_epi8(bytes, cr)));
+            mask |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(hits))) << (16 * i);
+        }
+        return mask;
+    }
+
+    __attribute__((target("avx2")))
+    static uint64_t avx2Mask(const char* block) {
+        const __m256i comma = _mm256_set1_epi8(',');
+        const __m256i quote = _mm256_set1_epi8('"');
+        const __m256i lf = _mm256_set1_epi8('\n');
+        const __m256i cr = _mm256_set1_epi8('\r');
+        uint64_t mask = 0;
+        for (int i = 0; i < 2; ++i) {
+            __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32 * i));
+            __m256i hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(bytes, comma), _mm256_cmpeq_epi8(bytes, quote)),
+                                           _mm256_or_si256(_mm256_cmpeq_epi8(bytes, lf), _mm256_cmpeq_epi8(bytes, cr)));
+            mask |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(hits))) << (32 * i);
+        }
+        return mask;
+    }
+#endif
+
+private:
+    static BlockMask select() {
+#ifdef DATALOOM_X86_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return avx2Mask;
+        if (__builtin_cpu_supports("sse2")) return sse2Mask;
+#endif
+        return scalarMask;
+    }
+};
+
+// RFC 4180 record reader over an in-memory buffer. Fields are returned as views
+// into the buffer; only quoted fields with escaped quotes ("") are unescaped
+// into the caller's arena.
+//
+// The reader does not look at every byte: it walks an index of the structural
+// characters, built a window at a time by StructuralScanner. Quotes are
+// indexed like delimiters rather than folded into a quoted-region mask, so
+// stray quotes in unquoted fields and text after a closing quote are read
+// exactly as a byte-by-byte parser would.
+class CsvReader {
+private:
+    static constexpr size_t kIndexWindow = 64 * 1024;
+
+    std::string_view buffer;
+    size_t pos = 0;
+    std::string unescaped;
+    std::vector<size_t> structural;
+    size_t next_structural = 0;
+    size_t indexed_to = 0;
+
+    void indexWindow(size_t begin) {
+        StructuralScanner::BlockMask block_mask = StructuralScanner::blockMask();
+        size_t end = std::min(buffer.size(), begin + kIndexWindow);
+        structural.clear();
+        next_structural = 0;
+        for (size_t base = begin; base < end; base += 64) {
+            uint64_t mask;
+            if (base + 64 <= buffer.size()) {
+                mask = block_mask(buffer.data() + base);
+            } else {
+                // Last partial block: pad with bytes that are not structural
+                char padded[64] = {};
+                std::memcpy(padded, buffer.data() + base, buffer.size() - base);
+                mask = block_mask(padded);
+            }
+            if (base + 64 > end) {
+                mask &= (uint64_t(1) << (end - base)) - 1;
+            }
+            while (mask) {
+                structural.push_back(base + __builtin_ctzll(mask));
+                mask &= mask - 1;
+            }
+        }
+        indexed_to = end;
+    }
+
+    // First structural character at or after from, or buffer.size()
+    size_t findStructural(size_t from) {
+        for (;;) {
+            while (next_structural < structural.size() && structural[next_structural] < from) {
+                next_structural++;
+            }
+            if (next_structural < structural.size()) {
+                return structural[next_structural];
+            }
+            if (indexed_to >= buffer.size()) {
+                return buffer.size();
+            }
+            indexWindow(std::max(from, indexed_to));
+        }
+    }
+
+    // First ',', '\n' or '\r' at or after from
+    size_t findDelimiter(size_t from) {
+        size_t at = findStructural(from);
+        while (at < buffer.size() && buffer[at] == '"') {
+            at = findStructural(at + 1);
+        }
+        return at;
+    }
+
+    size_t findQuote(size_t from) {
+        size_t at = findStructural(from);
+        while (at < buffer.size() && buffer[at] != '"') {
+            at = findStructural(at + 1);
+        }
+        return at;
+    }
+
+public:
+    CsvReader() = default;
+    explicit CsvReader(std::string_view input) : buffer(input) {
+        structural.reserve(kIndexWindow / 4);
+    }
+
+    bool atEnd() const {
+        return pos >= buffer.size();
+    }
+
+    size_t position() const {
+        return pos;
+    }
+
+    bool readRecord(std::vector<std::string_view>& fields, CellArena& owned) {
+        fields.clear();
+        if (atEnd()) return false;
+
+        const size_t size = buffer.size();
+        while (true) {
+            if (pos < size && buffer[pos] == '"') {
+                // Quoted field: find the closing quote, unescaping "" if present
+                size_t start = ++pos;
+                size_t end = size;
+                bool is_unescaped = false;
+                unescaped.clear();
+                while (true) {
+                    size_t quote = findQuote(pos);
+                    if (quote >= size) {
+                        pos = size;
+                        break;
+                    }
+                    if (quote + 1 < size && buffer[quote + 1] == '"') {
+                        is_unescaped = true;
+                        unescaped.append(buffer.data() + start, quote + 1 - start);
+                        pos = start = quote + 2;
+                        continue;
+                    }
+                    end = quote;
+                    pos = quote + 1;
+                    break;
+                }
+                if (is_unescaped) {
+                    unescaped.append(buffer.data() + start, end - start);
+                }
+
+                // Be lenient with text after the closing quote: keep it in the field
+                size_t tail = findDelimiter(pos);
+                if (tail > pos) {
+                    if (!is_unescaped) {
+                        unescaped.assign(buffer.data() + start, end - start);
+                        is_unescaped = true;
+                    }
+                    unescaped.append(buffer.data() + pos, tail - pos);
+                    pos = tail;
+                }
+
+                if (is_unescaped) {
+                    fields.push_back(owned.store(unescaped));
+                } else {
+                    fields.emplace_back(buffer.data() + start, end - start);
+                }
+            } else {
+                size_t start = pos;
+                pos = findDelimiter(pos);
+                fields.emplace_back(buffer.data() + start, pos - start);
+            }
+
+            if (pos >= size) return true;
+            char c = buffer[pos];
+            if (c == ',') {
+                pos++;
+                if (pos >= size) {
+                    fields.emplace_back();
+                    return true;
+                }
+                continue;
+            }
+            // End of record: accept \n, \r\n or a lone \r
+            pos++;
+            if (c == '\r' && pos < size && buffer[pos] == '\n') {
+                pos++;
+            }
+            return true;
+        }
+    }
+};
+
+// Little-endian field of a ZIP header
+inline uint32_t readLE(const char* bytes, size_t width) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < width; ++i) {
+        value |= static_cast<uint32_t>(static_cast<uint8_t>(bytes[i])) << (8 * i);
+    }
+    return value;
+}
+
+// Entries of a ZIP archive held in memory, found through its central directory
+class ZipArchive {
+public:
+    struct Entry {
+        uint16_t method = 0;  // 0 stored, 8 deflated
+        size_t offset = 0;    // Of the entry data within the archive
+        std::string_view data;
+        size_t size = 0;      // Uncompressed
+    };
+
+    bool open(std::string_view archive, std::string& error) {
+        bytes = archive;
+        entries.clear();
+        if (bytes.size() < 22) {
+            error = "not a ZIP archive";
+            return false;
+        }
+        // The end-of-directory record sits in the last 64 KB (it may carry a comment)
+        size_t eocd = std::string_view::npos;
+        size_t lowest = bytes.size() > 22 + 0xFFFF ? bytes.size() - 22 - 0xFFFF : 0;
+        for (size_t at = bytes.size() - 22; at + 1 > lowest; --at) {
+            if (readLE(bytes.data() + at, 4) == 0x06054b50) {
+                eocd = at;
+                break;
+            }
+            if (at == 0) break;
+        }
+        if (eocd == std::string_view::npos) {
+            error = "not a ZIP archive (no central directory)";
+            return false;
+        }
+        size_t count = readLE(bytes.data() + eocd + 10, 2);
+        size_t at = readLE(bytes.data() + eocd + 16, 4);
+        if (count == 0xFFFF || at == 0xFFFFFFFF) {
+            error = "ZIP64 archives are not supported";
+            return false;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (at + 46 > bytes.size() || readLE(bytes.data() + at, 4) != 0x02014b50) {
+                error = "corrupt ZIP central directory";
+                return false;
+            }
+            const char* header = bytes.data() + at;
+            size_t name_length = readLE(header + 28, 2);
+            size_t skip = name_length + readLE(header + 30, 2) + readLE(header + 32, 2);
+            if (at + 46 + name_length > bytes.size()) {
+                error = "corrupt ZIP central directory";
+                return false;
+            }
+            Entry entry;
+            entry.method = static_cast<uint16_t>(readLE(header + 10, 2));
+            size_t compressed = readLE(header + 20, 4);
+            entry.size = readLE(header + 24, 4);
+            size_t local = readLE(header + 42, 4);
+            if (local + 30 <= bytes.size() && readLE(bytes.data() + local, 4) == 0x04034b50) {
+                entry.offset = local + 30 + readLE(bytes.data() + local + 26, 2) + readLE(bytes.data() + local + 28, 2);
+                if (entry.offset <= bytes.size() && compressed <= bytes.size() - entry.offset) {
+                    entry.data = bytes.substr(entry.offset, compressed);
+                    entries.emplace(std::string(header + 46, name_length), entry);
+                }
+            }
+            at += 46 + skip;
+        }
+        return true;
+    }
+
+    const Entry* find(const std::string& name) const {
+        auto it = entries.find(name);
+        return it != entries.end() ? &it->second : nullptr;
+    }
+
+private:
+    std::string_view bytes;
+    std::map<std::string, Entry> entries;
+};
+
+// Incremental DEFLATE (RFC 1951) decoder. read() appends roughly the
+// requested number of bytes per call, so a large entry is never held whole;
+// only the 32 KB back-reference window is kept between calls.
+class Inflater {
+public:
+    Inflater() = default;
+    explicit Inflater(std::string_view compressed) : in(compressed) {}
+
+    // Appends about want bytes to out (more by at most one match); returns how
+    // many were appended, 0 at the end of the stream or on corrupt data
+    size_t read(std::string& out, size_t want) {
+        size_t start = length;
+        if (history.size() < start + want + kMaxMatch) {
+            history.resize(start + want + kMaxMatch);
+        }
+        while (length - start < want && state != State::Done && state != State::Error) {
+            switch (state) {
+                case State::BlockHeader: readBlockHeader(); break;
+                case State::Stored:
+                    if (stored_remaining == 0) {
+                        state = last_block ? State::Done : State::BlockHeader;
+                    } else {
+                        put(static_cast<uint8_t>(bits(8)));
+                        stored_remaining--;
+                    }
+                    break;
+                case State::Codes: decodeSymbol(); break;
+                default: break;
+            }
+        }
+        size_t produced = length - start;
+        out.append(reinterpret_cast<const char*>(history.data()) + start, produced);
+
+        // Keep only what later matches can refer back to
+        if (length > kWindow) {
+            std::memmove(history.data(), history.data() + length - kWindow, kWindow);
+            length = kWindow;
+        }
+        return produced;
+    }
+
+    bool failed() const {
+        return state == State::Error;
+    }
+
+    // Compressed bytes consumed so far
+    size_t consumed() const {
+        return in_pos - (bit_count - overrun) / 8;
+    }
+
+private:
+    static constexpr size_t kWindow = 32768;
+    static constexpr size_t kMaxMatch = 258;
+    static constexpr int kFastBits = 10;
+
+    // Canonical Huffman code with a lookup table for codes up to kFastBits
+    struct Huffman {
+        uint16_t count[16] = {};
+        uint16_t symbol[320] = {};
+        uint16_t fast[1 << kFastBits] = {};  // (symbol << 4) | length, 0 if longer
+
+        bool build(const uint8_t* lengths, size_t n) {
+            std::fill(std::begin(count), std::end(count), 0);
+            std::fill(std::begin(fast), std::end(fast), 0);
+            for (size_t i = 0; i < n; ++i) count[lengths[i]]++;
+            count[0] = 0;
+            int left = 1;
+            for (int len = 1; len < 16; ++len) {
+                left = (left << 1) - count[len];
+                if (left < 0) return false;  // Over-subscribed
+            }
+            // Symbols sorted by code length, and the first code of each length
+            uint16_t offsets[16] = {};
+            uint16_t next_code[16] = {};
+            for (int len = 1, code = 0; len < 16; ++len) {
+                if (len > 1) offsets[len] = static_cast<uint16_t>(offsets[len - 1] + count[len - 1]);
+                code = (code + count[len - 1]) << 1;
+                next_code[len] = static_cast<uint16_t>(code);
+            }
+            for (size_t i = 0; i < n; ++i) {
+                int len = lengths[i];
+                if (len == 0) continue;
+                symbol[offsets[len]++] = static_cast<uint16_t>(i);
+                int code = next_code[len]++;
+                if (len <= kFastBits) {
+                    int reversed = 0;
+                    for (int b = 0; b < len; ++b) reversed |= ((code >> b) & 1) << (len - 1 - b);
+                    for (int fill = reversed; fill < (1 << kFastBits); fill += 1 << len) {
+                        fast[fill] = static_cast<uint16_t>((i << 4) | len);
+                    }
+                }
+            }
+            return true;
+        }
+    };
+
+    enum class State { BlockHeader, Stored, Codes, Done, Error };
+
+    std::string_view in;
+    size_t in_pos = 0;
+    uint64_t bit_buffer = 0;
+    int bit_count = 0;
+    int overrun = 0;  // Bits handed out past the end of the input
+    std::vector<uint8_t> history;  // Window followed by the bytes of this read()
+    size_t length = 0;
+    size_t total_out = 0;
+    State state = State::BlockHeader;
+    bool last_block = false;
+    size_t stored_remaining = 0;
+    Huffman literals;
+    Huffman distances;
+
+    void refill() {
+        if (in_pos + 8 <= in.size()) {
+            // Whole bytes that fit; bits past bit_count repeat the next input
+            uint64_t word;
+            std::memcpy(&word, in.data() + in_pos, sizeof(word));
+            bit_buffer |= word << bit_count;
+            in_pos += (63 - bit_count) >> 3;
+            bit_count |= 56;
+            return;
+        }
+        while (bit_count <= 56) {
+            if (in_pos < in.size()) {
+                bit_buffer |= static_cast<uint64_t>(static_cast<uint8_t>(in[in_pos++])) << bit_count;
+            } else {
+                overrun += 8;  // Zero padding; only an error if consumed
+            }
+            bit_count += 8;
+        }
+    }
+
+    // Padding sits above the real bits, so reaching into it means the input ran out
+    void consume(int n) {
+        bit_buffer >>= n;
+        bit_count -= n;
+        if (bit_count < overrun) {
+            state = State::Error;
+        }
+    }
+
+    uint32_t bits(int n) {
+        if (n == 0) return 0;
+        refill();
+        uint32_t value = static_cast<uint32_t>(bit_buffer & ((uint64_t(1) << n) - 1));
+        consume(n);
+        return value;
+    }
+
+    int decode(const Huffman& h) {
+        refill();
+        uint16_t entry = h.fast[bit_buffer & ((1u << kFastBits) - 1)];
+        if (entry != 0) {
+            consume(entry & 15);
+            return entry >> 4;
+        }
+        int code = 0;
+        int first = 0;
+        int index = 0;
+        for (int len = 1; len < 16; ++len) {
+            code |= static_cast<int>((bit_buffer >> (len - 1)) & 1);
+            int count = h.count[len];
+            if (code - count < first) {
+                consume(len);
+                return h.symbol[index + (code - first)];
+            }
+            index += count;
+            first = (first + count) << 1;
+            code <<= 1;
+        }
+        state = State::Error;
+        return -1;
+    }
+
+    void put(uint8_t byte) {
+        history[length++] = byte;
+        total_out++;
+    }
+
+    void readBlockHeader() {
+        if (last_block) {
+            state = State::Done;
+            return;
+        }
+        last_block = bits(1) != 0;
+        switch (bits(2)) {
+            case 0: {
+                consume(bit_count % 8);  // Stored blocks start on a byte boundary
+                uint32_t length = bits(16);
+                uint32_t complement = bits(16);
+                if ((length ^ 0xFFFF) != complement) {
+                    state = State::Error;
+                    return;
+                }
+                stored_remaining = length;
+                state = State::Stored;
+                return;
+            }
+            case 1: {
+                static const std::pair<Huffman, Huffman> fixed = [] {
+                    std::pair<Huffman, Huffman> codes;
+                    uint8_t lengths[288];
+                    std::fill(lengths, lengths + 144, 8);
+                    std::fill(lengths + 144, lengths + 256, 9);
+                    std::fill(lengths + 256, lengths + 280, 7);
+                    std::fill(lengths + 280, lengths + 288, 8);
+                    codes.first.build(lengths, 288);
+                    std::fill(lengths, lengths + 30, 5);
+                    codes.second.build(lengths, 30);
+                    return codes;
+                }();
+                literals = fixed.first;
+                distances = fixed.second;
+                state = State::Codes;
+                return;
+            }
+            case 2:
+                state = readDynamicCodes() ? State::Codes : State::Error;
+                return;
+            default:
+                state = State::Error;
+        }
+    }
+
+    bool readDynamicCodes() {
+        static const uint8_t kOrder[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+        size_t nlen = bits(5) + 257;
+        size_t ndist = bits(5) + 1;
+        size_t ncode = bits(4) + 4;
+        if (nlen > 286 || ndist > 30) return false;
+
+        uint8_t lengths[320] = {};
+        for (size_t i = 0; i < ncode; ++i) lengths[kOrder[i]] = static_cast<uint8_t>(bits(3));
+        Huffman lencode;
+        if (!lencode.build(lengths, 19)) return false;
+
+        std::fill(std::begin(lengths), std::end(lengths), 0);
+        for (size_t i = 0; i < nlen + ndist;) {
+            int sym = decode(lencode);
+            if (sym < 0 || state == State::Error) return false;
+            if (sym < 16) {
+                lengths[i++] = static_cast<uint8_t>(sym);
+                continue;
+            }
+            uint8_t value = 0;
+            size_t repeat;
+            if (sym == 16) {
+                if (i == 0) return false;
+                value = lengths[i - 1];
+                repeat = 3 + bits(2);
+            } else if (sym == 17) {
+                repeat = 3 + bits(3);
+            } else {
+                repeat = 11 + bits(7);
+            }
+            if (i + repeat > nlen + ndist) return false;
+            while (repeat--) lengths[i++] = value;
+        }
+        if (lengths[256] == 0) return false;  // No end-of-block code
+        return literals.build(lengths, nlen) && distances.build(lengths + nlen, ndist);
+    }
+
+    void decodeSymbol() {
+        static const uint16_t kLengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                                 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+        static const uint8_t kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                                 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+        static const uint16_t kDistBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                               257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                               8193, 12289, 16385, 24577};
+        static const uint8_t kDistExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                               7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+        int sym = decode(literals);
+        if (state == State::Error) return;
+        if (sym < 256) {
+            put(static_cast<uint8_t>(sym));
+            return;
+        }
+        if (sym == 256) {
+            state = last_block ? State::Done : State::BlockHeader;
+            return;
+        }
+        sym -= 257;
+        if (sym >= 29) {
+            state = State::Error;
+            return;
+        }
+        size_t match = kLengthBase[sym] + bits(kLengthExtra[sym]);
+        int dist_sym = decode(distances);
+        if (dist_sym < 0 || dist_sym >= 30 || state == State::Error) {
+            state = State::Error;
+            return;
+        }
+        size_t distance = kDistBase[dist_sym] + bits(kDistExtra[dist_sym]);
+        if (distance > total_out || state == State::Error) {
+            state = State::Error;
+            return;
+        }
+        uint8_t* to = history.data() + length;
+        const uint8_t* from = to - distance;
+        for (size_t k = 0; k < match; ++k) {
+            to[k] = from[k];  // Overlapping copies repeat the pattern
+        }
+        length += match;
+        total_out += match;
+    }
+};
+
+// Append code point cp to out as UTF-8
+inline void appendUtf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out.push_back(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+}
+
+// Pull (SAX-style) parser for the XML found in XLSX parts: elements,
+// attributes, text, CDATA and character entities. Comments, processing
+// instructions and DOCTYPE are skipped. Input arrives in pieces from a refill
+// callback and only the current token is buffered, so memory stays bounded
+// whatever the size of the document.
+class XmlReader {
+public:
+    enum class Token { Start, End, Text, Eof, Error };
+
+    // Appends more input to the buffer; returns false at the end of the input
+    using Refill = std::function<bool(std::string&)>;
+
+    explicit XmlReader(Refill source) : refill(std::move(source)) {}
+
+    // A self-closing element is reported as Start followed by End
+    Token next() {
+        if (pending_end) {
+            pending_end = false;
+            return Token::End;
+        }
+        for (;;) {
+            if (pos >= buffer.size() && !more()) return Token::Eof;
+            if (buffer[pos] != '<') {
+                size_t end = find('<', pos);
+                if (end == std::string::npos) end = buffer.size();
+                content.clear();
+                decode(std::string_view(buffer).substr(pos, end - pos), content);
+                pos = end;
+                return Token::Text;
+            }
+
+            if (pos + 1 >= buffer.size()) more();
+            char kind = pos + 1 < buffer.size() ? buffer[pos + 1] : '\0';
+            if (kind == '!' && startsWith("<!--")) {
+                if (!skipPast("-->")) return Token::Error;
+                continue;
+            }
+            if (kind == '!' && startsWith("<![CDATA[")) {
+                size_t end = findText("]]>", pos);
+                if (end == std::string::npos) return Token::Error;
+                content.assign(buffer, pos + 9, end - pos - 9);
+                pos = end + 3;
+                return Token::Text;
+            }
+            if (kind == '?') {
+                if (!skipPast("?>")) return Token::Error;
+                continue;
+            }
+            if (kind == '!') {
+                if (!skipPast(">")) return Token::Error;
+                continue;
+            }
+
+            size_t end = findTagEnd();
+            if (end == std::string::npos) return Token::Error;
+            std::string_view tag = std::string_view(buffer).substr(pos + 1, end - pos - 1);
+            pos = end + 1;
+            bool closing = !tag.empty() && tag.front() == '/';
+            if (closing) tag.remove_prefix(1);
+            bool self_closing = !closing && !tag.empty() && tag.back() == '/';
+            if (self_closing) tag.remove_suffix(1);
+
+            size_t name_end = tag.find_first_of(" \t\r\n");
+            qualified = tag.substr(0, name_end);
+            attributes = name_end == std::string_view::npos ? std::string_view() : tag.substr(name_end);
+            pending_end = self_closing;
+            return closing ? Token::End : Token::Start;
+        }
+    }
+
+    // Element name without its namespace prefix (Start and End)
+    std::string_view name() const {
+        size_t colon = qualified.find(':');
+        return colon == std::string_view::npos ? qualified : qualified.substr(colon + 1);
+    }
+
+    // Decoded text (Text)
+    const std::string& text() const {
+        return content;
+    }
+
+    // Decoded value of an attribute of the current Start element. A prefixed
+    // name also matches the same local name under another prefix.
+    bool attribute(std::string_view wanted, std::string& value) const {
+        size_t colon = wanted.find(':');
+        std::string_view suffix = colon == std::string_view::npos ? std::string_view() : wanted.substr(colon);
+        const char* p = attributes.data();
+        const char* end = p + attributes.size();
+        while (p < end) {
+            while (p < end && isXmlSpace(*p)) ++p;
+            const char* name_begin = p;
+            while (p < end && *p != '=' && !isXmlSpace(*p)) ++p;
+            std::string_view attr_name(name_begin, p - name_begin);
+            while (p < end && *p != '"' && *p != '\'') ++p;
+            if (p == end) return false;
+            char quote = *p++;
+            const char* value_end = static_cast<const char*>(std::memchr(p, quote, end - p));
+            if (!value_end) return false;
+            if (attr_name == wanted || (!suffix.empty() && attr_name.size() > suffix.size() && 
+                                        attr_name.substr(attr_name.size() - suffix.size()) == suffix)) {
+                value.clear();
+                decode(std::string_view(p, value_end - p), value);
+                return true;
+            }
+            p = value_end + 1;
+        }
+        return false;
+    }
+
+private:
+    static constexpr size_t kCompactAt = 64 * 1024;
+
+    Refill refill;
+    std::string buffer;
+    size_t pos = 0;
+    bool exhausted = false;
+    bool pending_end = false;
+    std::string_view qualified;
+    std::string_view attributes;
+    std::string content;
+
+    // Pull more input, first dropping what has been consumed. Views into the
+    // buffer from the previous token are invalidated.
+    bool more() {
+        if (exhausted) return false;
+        if (pos >= kCompactAt || pos == buffer.size()) {
+            size_t keep = pos;
+            buffer.erase(0, keep);
+            pos = 0;
+        }
+        size_t before = buffer.size();
+        while (buffer.size() == before) {
+            if (!refill(buffer)) {
+                exhausted = true;
+                break;
+            }
+        }
+        return buffer.size() > before;
+    }
+
+    bool startsWith(std::string_view prefix) {
+        while (buffer.size() - pos < prefix.size()) {
+            if (!more()) return false;
+        }
+        return std::string_view(buffer).substr(pos, prefix.size()) == prefix;
+    }
+
+    size_t find(char c, size_t from) {
+        size_t offset = from - pos;
+        for (;;) {
+            size_t at = buffer.find(c, pos + offset);
+            if (at != std::string::npos) return at;
+            offset = buffer.size() - pos;
+            if (!more()) return std::string::npos;
+        }
+    }
+
+    size_t findText(std::string_view text, size_t from) {
+        size_t offset = from - pos;
+        for (;;) {
+            size_t at = buffer.find(text, pos + offset);
+            if (at != std::string::npos) return at;
+            offset = buffer.size() - pos >= text.size() ? buffer.size() - pos - text.size() + 1 : 0;
+            if (!more()) return std::string::npos;
+        }
+    }
+
+    bool skipPast(std::string_view terminator) {
+        size_t at = findText(terminator, pos);
+        if (at == std::string::npos) return false;
+        pos = at + terminator.size();
+        return true;
+    }
+
+    // Closing '>' of the tag at pos, skipping any inside quoted attribute values
+    size_t findTagEnd() {
+        size_t offset = 1;
+        char quote = 0;
+        for (;;) {
+            for (size_t at = pos + offset; at < buffer.size(); ++at) {
+                char c = buffer[at];
+                if (quote) {
+                    if (c == quote) quote = 0;
+                } else if (c == '"' || c == '\'') {
+                    quote = c;
+                } else if (c == '>') {
+                    return at;
+                }
+            }
+            offset = buffer.size() - pos;
+            if (!more()) return std::string::npos;
+        }
+    }
+
+    static bool isXmlSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    static void decode(std::string_view raw, std::string& out) {
+        if (raw.find('&') == std::string_view::npos) {
+            out.append(raw);
+            return;
+        }
+        for (size_t i = 0; i < raw.size(); ++i) {
+            if (raw[i] != '&') {
+                out.push_back(raw[i]);
+                continue;
+            }
+            size_t semi = raw.find(';', i);
+            if (semi == std::string_view::npos) {
+                out.append(raw.substr(i));
+                return;
+            }
+            std::string_view entity = raw.substr(i + 1, semi - i - 1);
+            if (entity == "lt") out.push_back('<');
+            else if (entity == "gt") out.push_back('>');
+            else if (entity == "amp") out.push_back('&');
+            else if (entity == "quot") out.push_back('"');
+            else if (entity == "apos") out.push_back('\'');
+            else if (entity.size() > 1 && entity[0] == '#') {
+                bool hex = entity[1] == 'x' || entity[1] == 'X';
+                uint32_t cp = 0;
+                auto digits = entity.substr(hex ? 2 : 1);
+                auto result = std::from_chars(digits.data(), digits.data() + digits.size(), cp, hex ? 16 : 10);
+                if (result.ec != std::errc() || result.ptr != digits.data() + digits.size() || cp > 0x10FFFF) {
+                    out.append(raw.substr(i, semi - i + 1));
+                } else {
+                    appendUtf8(out, cp);
+                }
+            } else {
+                out.append(raw.substr(i, semi - i + 1));
+            }
+            i = semi;
+        }
+    }
+};
+
+// Reads the first worksheet of an .xlsx workbook as records, like CsvReader.
+// Shared strings are loaded once into the reader's own arena; the sheet is
+// inflated and parsed as it is read, so only the current row is in memory.
+// Rows without any value are skipped, and gaps between cells and missing
+// trailing cells are filled with empty fields. Numbers and dates come through
+// as stored (dates as serials).
+class XlsxReader {
+public:
+    XlsxReader() = default;
+    XlsxReader(const XlsxReader&) = delete;
+    XlsxReader& operator=(const XlsxReader&) = delete;
+
+    static bool isWorkbook(std::string_view bytes) {
+        return bytes.substr(0, 4) == std::string_view("PK\x03\x04", 4);
+    }
+
+    bool open(std::string_view archive, std::string& error) {
+        if (!zip.open(archive, error)) return false;
+
+        // The first <sheet> of the workbook and the part its relationship points to
+        std::string relationship;
+        std::string sheet_path = "xl/worksheets/sheet1.xml";
+        std::string strings_path = "xl/sharedStrings.xml";
+        const ZipArchive::Entry* workbook = zip.find("xl/workbook.xml");
+        if (!workbook) {
+            error = "not an XLSX workbook (no xl/workbook.xml)";
+            return false;
+        }
+        {
+            Inflater inflater;
+            XmlReader xml(entrySource(*workbook, inflater));
+            for (XmlReader::Token t; (t = xml.next()) != XmlReader::Token::Eof && t != XmlReader::Token::Error;) {
+                if (t == XmlReader::Token::Start && xml.name() == "sheet") {
+                    xml.attribute("name", sheet_name);
+                    xml.attribute("r:id", relationship);
+                    break;
+                }
+            }
+        }
+        if (const ZipArchive::Entry* rels = zip.find("xl/_rels/workbook.xml.rels")) {
+            Inflater inflater;
+            XmlReader xml(entrySource(*rels, inflater));
+            std::string id, target, type;
+            for (XmlReader::Token t; (t = xml.next()) != XmlReader::Token::Eof && t != XmlReader::Token::Error;) {
+                if (t != XmlReader::Token::Start || xml.name() != "Relationship") continue;
+                if (!xml.attribute("Id", id) || !xml.attribute("Target", target)) continue;
+                xml.attribute("Type", type);
+                std::string path = !target.empty() && target[0] == '/' ? target.substr(1) : "xl/" + target;
+                if (!relationship.empty() && id == relationship) sheet_path = path;
+                if (type.size() >= 14 && type.compare(type.size() - 14, 14, "/sharedStrings") == 0) strings_path = path;
+            }
+        }
+
+        if (const ZipArchive::Entry* strings = zip.find(strings_path)) {
+            if (!loadSharedStrings(*strings)) {
+                error = "corrupt shared strings in " + strings_path;
+                return false;
+            }
+        }
+
+        sheet = zip.find(sheet_path);
+        if (!sheet) {
+            error = "worksheet " + sheet_path + " not found";
+            return false;
+        }
+        if (sheet->method != 0 && sheet->method != 8) {
+            error = "unsupported compression in " + sheet_path;
+            return false;
+        }
+        sheet_xml = std::make_unique<XmlReader>(entrySource(*sheet, sheet_inflater));
+        return true;
+    }
+
+    const std::string& sheetName() const {
+        return sheet_name;
+    }
+
+    size_t sharedStringCount() const {
+        return shared_strings.size();
+    }
+
+    // Why the sheet ended before its end tag, reported once; empty otherwise
+    std::string takeError() {
+        std::string reason;
+        std::swap(reason, error);
+        return reason;
+    }
+
+    // Archive bytes consumed by the sheet so far
+    size_t position() const {
+        return sheet ? sheet->offset + (sheet->method == 8 ? sheet_inflater.consumed() : stored_pos) : 0;
+    }
+
+    bool readRecord(std::vector<std::string_view>& fields, CellArena& owned) {
+        if (done) return false;
+        bool in_row = false;
+        bool in_cell = false;
+        bool has_value = false;
+        bool capture = false;
+        int phonetic_depth = 0;
+        size_t col = 0;
+        size_t next_col = 0;
+        std::string type;
+        std::string ref;
+        fields.clear();
+        for (;;) {
+            XmlReader::Token token = sheet_xml->next();
+            if (token == XmlReader::Token::Eof || token == XmlReader::Token::Error) {
+                if (token == XmlReader::Token::Error || sheet_inflater.failed()) {
+                    error = "the worksheet data is corrupt";
+                }
+                done = true;
+                return false;
+            }
+            if (token == XmlReader::Token::Text) {
+                if (capture && phonetic_depth == 0) value += sheet_xml->text();
+                continue;
+            }
+            std::string_view name = sheet_xml->name();
+            if (token == XmlReader::Token::Start) {
+                if (name == "row") {
+                    in_row = true;
+                    has_value = false;
+                    next_col = 0;
+                    fields.clear();
+                } else if (name == "c" && in_row) {
+                    in_cell = true;
+                    col = next_col;
+                    if (sheet_xml->attribute("r", ref)) col = columnOf(ref, col);
+                    if (!sheet_xml->attribute("t", type)) type.clear();
+                    value.clear();
+                } else if (in_cell && (name == "v" || name == "t")) {
+                    capture = true;
+                } else if (in_cell && name == "rPh") {
+                    phonetic_depth++;
+                }
+                continue;
+            }
+
+            // End tags
+            if (name == "v" || name == "t") {
+                capture = false;
+            } else if (name == "rPh") {
+                phonetic_depth--;
+            } else if (name == "c" && in_cell) {
+                in_cell = false;
+                next_col = col + 1;
+                std::string_view cell = cellText(type);
+                if (!cell.empty()) {
+                    if (fields.size() <= col) fields.resize(col + 1);
+                    fields[col] = type == "s" ? cell : owned.store(cell);
+                    has_value = true;
+                }
+            } else if (name == "row") {
+                in_row = false;
+                if (has_value) {
+                    // Sheets leave out trailing empty cells; pad to the header row
+                    if (width == 0) width = fields.size();
+                    if (fields.size() < width) fields.resize(width);
+                    return true;
+                }
+                fields.clear();
+            } else if (name == "sheetData") {
+                done = true;
+                return false;
+            }
+        }
+    }
+
+private:
+    ZipArchive zip;
+    CellArena strings_arena;
+    std::vector<std::string_view> shared_strings;
+    std::string sheet_name;
+    const ZipArchive::Entry* sheet = nullptr;
+    Inflater sheet_inflater;
+    size_t stored_pos = 0;
+    std::unique_ptr<XmlReader> sheet_xml;
+    std::string value;
+    bool done = false;
+    size_t width = 0;  // Fields in the first record
+    std::string error;
+
+    static constexpr size_t kRefillBytes = 64 * 1024;
+
+    // Feeds an entry to an XmlReader in kRefillBytes pieces
+    XmlReader::Refill entrySource(const ZipArchive::Entry& entry, Inflater& inflater) {
+        if (entry.method == 8) {
+            inflater = Inflater(entry.data);
+            return [&inflater](std::string& out) { return inflater.read(out, kRefillBytes) > 0; };
+        }
+        size_t* cursor = &entry == sheet ? &stored_pos : nullptr;
+        auto offset = std::make_shared<size_t>(0);
+        return [data = entry.data, offset, cursor](std::string& out) {
+            if (*offset >= data.size()) return false;
+            size_t take = std::min(kRefillBytes, data.size() - *offset);
+            out.append(data.substr(*offset, take));
+            *offset += take;
+            if (cursor) *cursor = *offset;
+            return true;
+        };
+    }
+
+    bool loadSharedStrings(const ZipArchive::Entry& entry) {
+        Inflater inflater;
+        XmlReader xml(entrySource(entry, inflater));
+        std::string text;
+        bool in_item = false;
+        bool capture = false;
+        int phonetic_depth = 0;
+        for (;;) {
+            XmlReader::Token token = xml.next();
+            if (token == XmlReader::Token::Eof) return !inflater.failed();
+            if (token == XmlReader::Token::Error) return false;
+            if (token == XmlReader::Token::Text) {
+                if (capture && phonetic_depth == 0) text += xml.text();
+                continue;
+            }
+            std::string_view name = xml.name();
+            bool start = token == XmlReader::Token::Start;
+            if (name == "si") {
+                in_item = start;
+                if (start) {
+                    text.clear();
+                } else {
+                    shared_strings.push_back(strings_arena.store(unescapeExcel(text)));
+                }
+            } else if (name == "t" && in_item) {
+                capture = start;
+            } else if (name == "rPh") {
+                phonetic_depth += start ? 1 : -1;
+            }
+        }
+    }
+
+    std::string_view cellText(const std::string& type) {
+        if (type == "s") {
+            size_t index = 0;
+            auto result = std::from_chars(value.data(), value.data() + value.size(), index);
+            if (result.ec != std::errc() || index >= shared_strings.size()) return std::string_view();
+            return shared_strings[index];
+        }
+        if (type == "b") {
+            return value == "1" ? "TRUE" : value.empty() ? "" : "FALSE";
+        }
+        if (type == "inlineStr" || type == "str") {
+            value = unescapeExcel(value);
+        }
+        return value;
+    }
+
+    // "AB12" -> 27; fallback when the reference has no column letters
+    static size_t columnOf(std::string_view ref, size_t fallback) {
+        size_t col = 0;
+        size_t i = 0;
+        for (; i < ref.size() && ref[i] >= 'A' && ref[i] <= 'Z'; ++i) {
+            col = col * 26 + static_cast<size_t>(ref[i] - 'A' + 1);
+            if (col > 16384) return fallback;
+        }
+        return i == 0 ? fallback : col - 1;
+    }
+
+    // Excel writes control characters in text as _xHHHH_
+    static std::string unescapeExcel(const std::string& text) {
+        if (text.find("_x") == std::string::npos) return text;
+        std::string out;
+        for (size_t i = 0; i < text.size(); ++i) {
+            uint32_t cp = 0;
+            if (text[i] == '_' && i + 6 < text.size() && text[i + 1] == 'x' && text[i + 6] == '_') {
+                auto result = std::from_chars(text.data() + i + 2, text.data() + i + 6, cp, 16);
+                if (result.ec == std::errc() && result.ptr == text.data() + i + 6) {
+                    appendUtf8(out, cp);
+                    i += 6;
+                    continue;
+                }
+            }
+            out.push_back(text[i]);
+        }
+        return out;
+    }
+};
+
+// CRC-32 (IEEE) as used by ZIP, continued from a previous value
+inline uint32_t crc32(std::string_view bytes, uint32_t crc = 0) {
+    static const auto table = [] {
+        std::array<std::array<uint32_t, 256>, 4> t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c >> 1) ^ (0xEDB88320u & (0u - (c & 1)));
+            t[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (size_t k = 1; k < 4; ++k) t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+        }
+        return t;
+    }();
+    crc = ~crc;
+    const auto* p = reinterpret_cast<const uint8_t*>(bytes.data());
+    size_t n = bytes.size();
+    for (; n >= 4; n -= 4, p += 4) {
+        crc ^= static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+               static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+        crc = table[3][crc & 0xFF] ^ table[2][(crc >> 8) & 0xFF] ^ table[1][(crc >> 16) & 0xFF] ^ table[0][crc >> 24];
+    }
+    for (; n > 0; --n, ++p) crc = (crc >> 8) ^ table[0][(crc ^ *p) & 0xFF];
+    return ~crc;
+}
+
+// Streaming DEFLATE (RFC 1951) encoder: greedy LZ77 over hash chains, with
+// each block coded by its own dynamic Huffman tables. Input is taken in any
+// pieces; only the 32 KB window and the pending block are kept.
+class Deflater {
+public:
+    Deflater() : head(kHashSize, 0), prev(kWindow, 0) {}
+
+    // Compresses data, appending whatever output is complete to out
+    void write(std::string_view data, std::string& out) {
+        buffer.insert(buffer.end(), data.begin(), data.end());
+        compress(false, out);
+    }
+
+    // Compresses the rest and closes the stream
+    void finish(std::string& out) {
+        compress(true, out);
+        emitBlock(true, out);
+        if (bit_count > 0) {
+            putBits(0, (8 - bit_count % 8) % 8);
+            flushBits(out);
+        }
+    }
+
+private:
+    static constexpr size_t kWindow = 32768;
+    static constexpr size_t kMinMatch = 4;
+    static constexpr size_t kMaxMatch = 258;
+    static constexpr int kHashBits = 15;
+    static constexpr size_t kHashSize = size_t(1) << kHashBits;
+    static constexpr int kMaxChain = 16;
+    static constexpr size_t kNiceMatch = 64;
+    static constexpr size_t kBlockSymbols = 1 << 15;
+    static constexpr size_t kSlideAt = 256 * 1024;
+
+    struct Symbol {
+        uint16_t value;     // Literal byte, or match length
+        uint16_t distance;  // 0 for a literal
+    };
+
+    // Code and extra bits of each match length 3..258 and distance 1..32768
+    struct Tables {
+        uint8_t length_code[259] = {};
+        uint16_t length_base[29] = {};
+        uint8_t length_extra[29] = {};
+        uint16_t distance_base[30] = {};
+        uint8_t distance_extra[30] = {};
+
+        Tables() {
+            for (int code = 0, base = 3; code < 28; ++code) {
+                length_extra[code] = static_cast<uint8_t>(code < 8 ? 0 : (code - 4) / 4);
+                length_base[code] = static_cast<uint16_t>(base);
+                for (int k = 0; k < (1 << length_extra[code]); ++k) length_code[base++] = static_cast<uint8_t>(code);
+            }
+            length_code[258] = 28;
+            length_base[28] = 258;
+            for (int code = 0, base = 1; code < 30; ++code) {
+                distance_extra[code] = static_cast<uint8_t>(code < 4 ? 0 : (code - 2) / 2);
+                distance_base[code] = static_cast<uint16_t>(base);
+                base += 1 << distance_extra[code];
+            }
+            for (int code = 0; code < 30; ++code) {
+                int first = distance_base[code] - 1;
+                int last = first + (1 << distance_extra[code]);
+                for (int d = first; d < last; ++d) {
+                    if (d < 256) distance_code[d] = static_cast<uint8_t>(code);
+                    else distance_code[256 + (d >> 7)] = static_cast<uint8_t>(code);
+                }
+            }
+        }
+
+        uint8_t distance_code[512] = {};  // By distance - 1 up to 256, then by (distance - 1) >> 7
+
+        int distanceCode(size_t distance) const {
+            return distance <= 256 ? distance_code[distance - 1] : distance_code[256 + ((distance - 1) >> 7)];
+        }
+    };
+
+    static const Tables& tables() {
+        static const Tables t;
+        return t;
+    }
+
+    std::vector<uint8_t> buffer;  // Window followed by input not yet compressed
+    size_t buffer_base = 0;       // Stream offset of buffer[0]
+    size_t pos = 0;               // Next byte to compress, within buffer
+    std::vector<uint64_t> head;   // Last stream offset + 1 per hash
+    std::vector<uint64_t> prev;   // Previous offset + 1 with the same hash
+    std::vector<Symbol> symbols;
+    uint64_t bit_buffer = 0;
+    int bit_count = 0;
+
+    static uint32_t hashAt(const uint8_t* p) {
+        uint32_t word;
+        std::memcpy(&word, p, sizeof(word));
+        return (word * 2654435761u) >> (32 - kHashBits);
+    }
+
+    void insert(size_t at) {
+        uint32_t h = hashAt(buffer.data() + at);
+        uint64_t offset = buffer_base + at;
+        prev[offset & (kWindow - 1)] = head[h];
+        head[h] = offset + 1;
+    }
+
+    // Longest match for buffer[at...] in the window, at most limit bytes
+    size_t longestMatch(size_t at, size_t limit, size_t& distance) const {
+        const uint8_t* here = buffer.data() + at;
+        uint64_t offset = buffer_base + at;
+        uint64_t candidate = head[hashAt(here)];
+        size_t best = kMinMatch - 1;
+        for (int chain = kMaxChain; candidate != 0 && chain > 0; --chain) {
+            uint64_t from = candidate - 1;
+            if (from >= offset || offset - from > kWindow) break;
+            const uint8_t* there = buffer.data() + (from - buffer_base);
+            if (there[best] == here[best]) {
+                size_t length = 0;
+                while (length + 8 <= limit) {
+                    uint64_t a, b;
+                    std::memcpy(&a, here + length, 8);
+                    std::memcpy(&b, there + length, 8);
+                    if (a != b) {
+                        length += static_cast<size_t>(__builtin_ctzll(a ^ b)) / 8;
+                        break;
+                    }
+                    length += 8;
+                }
+                if (length + 8 > limit) {
+                    while (length < limit && here[length] == there[length]) length++;
+                }
+                length = std::min(length, limit);
+                if (length > best) {
+                    best = length;
+                    distance = static_cast<size_t>(offset - from);
+                    if (length >= kNiceMatch) break;
+                }
+            }
+            uint64_t next = prev[from & (kWindow - 1)];
+            if (next >= candidate) break;
+            candidate = next;
+        }
+        return best >= kMinMatch ? best : 0;
+    }
+
+    void compress(bool flush, std::string& out) {
+        size_t end = buffer.size();
+        size_t stop = flush ? end : (end > kMaxMatch + 8 ? end - kMaxMatch - 8 : 0);
+        while (pos < stop) {
+            size_t limit = std::min(kMaxMatch + 8, end - pos);
+            size_t distance = 0;
+            size_t length = 0;
+            if (limit >= kMinMatch + 8) {
+                length = longestMatch(pos, limit - 8, distance);
+                insert(pos);
+            }
+            if (length > 0) {
+                symbols.push_back({static_cast<uint16_t>(length), static_cast<uint16_t>(distance)});
+                for (size_t k = 1; k < length; ++k) {
+                    if (pos + k + kMinMatch + 8 <= end) insert(pos + k);
+                }
+                pos += length;
+            } else {
+                symbols.push_back({buffer[pos], 0});
+                pos++;
+            }
+            if (symbols.size() >= kBlockSymbols) emitBlock(false, out);
+        }
+
+        // Keep only the window behind the next byte
+        if (pos >= kSlideAt) {
+            size_t drop = pos - kWindow;
+            buffer.erase(buffer.begin(), buffer.begin() + static_cast<std::ptrdiff_t>(drop));
+            buffer_base += drop;
+            pos -= drop;
+        }
+    }
+
+    void putBits(uint32_t value, int count) {
+        bit_buffer |= static_cast<uint64_t>(value) << bit_count;
+        bit_count += count;
+    }
+
+    void flushBits(std::string& out) {
+        while (bit_count >= 8) {
+            out.push_back(static_cast<char>(bit_buffer & 0xFF));
+            bit_buffer >>= 8;
+            bit_count -= 8;
+        }
+    }
+
+    // Code lengths of at most max_bits for the given frequencies; rarely used
+    // symbols are flattened until the tree is shallow enough
+    static void buildLengths(const std::vector<uint32_t>& frequency, int max_bits, std::vector<uint8_t>& lengths) {
+        size_t n = frequency.size();
+        std::vector<uint32_t> weight(frequency);
+        lengths.assign(n, 0);
+        for (;;) {
+            std::vector<std::pair<uint64_t, int>> heap;  // (weight, node)
+            std::vector<int> parent;
+            for (size_t i = 0; i < n; ++i) {
+                if (weight[i] > 0) {
+                    heap.emplace_back(weight[i], static_cast<int>(parent.size()));
+                    parent.push_back(-1);
+                }
+            }
+            std::vector<int> leaf_node(n, -1);
+            for (size_t i = 0, node = 0; i < n; ++i) {
+                if (weight[i] > 0) leaf_node[i] = static_cast<int>(node++);
+            }
+            if (heap.size() == 1) {
+                for (size_t i = 0; i < n; ++i) {
+                    if (leaf_node[i] >= 0) lengths[i] = 1;
+                }
+                return;
+            }
+            auto greater = [](const auto& a, const auto& b) { return a.first > b.first; };
+            std::make_heap(heap.begin(), heap.end(), greater);
+            while (heap.size() > 1) {
+                std::pop_heap(heap.begin(), heap.end(), greater);
+                auto a = heap.back();
+                heap.pop_back();
+                std::pop_heap(heap.begin(), heap.end(), greater);
+                auto b = heap.back();
+                heap.pop_back();
+                int node = static_cast<int>(parent.size());
+                parent.push_back(-1);
+                parent[a.second] = node;
+                parent[b.second] = node;
+                heap.emplace_back(a.first + b.first, node);
+                std::push_heap(heap.begin(), heap.end(), greater);
+            }
+            std::vector<int> depth(parent.size(), 0);
+            for (int node = static_cast<int>(parent.size()) - 1; node >= 0; --node) {
+                if (parent[node] >= 0) depth[node] = depth[parent[node]] + 1;
+            }
+            int deepest = 0;
+            for (size_t i = 0; i < n; ++i) {
+                if (leaf_node[i] >= 0) {
+                    lengths[i] = static_cast<uint8_t>(depth[leaf_node[i]]);
+                    deepest = std::max(deepest, depth[leaf_node[i]]);
+                }
+            }
+            if (deepest <= max_bits) return;
+            for (auto& w : weight) {
+                if (w > 0) w = (w >> 1) | 1;
+            }
+        }
+    }
+
+    // Canonical codes for the lengths, bit-reversed for LSB-first output
+    static void buildCodes(const std::vector<uint8_t>& lengths, std::vector<uint16_t>& codes) {
+        uint16_t count[16] = {};
+        uint16_t next[16] = {};
+        for (uint8_t len : lengths) count[len]++;
+        count[0] = 0;
+        for (int len = 1, code = 0; len < 16; ++len) {
+            code = (code + count[len - 1]) << 1;
+            next[len] = static_cast<uint16_t>(code);
+        }
+        codes.assign(lengths.size(), 0);
+        for (size_t i = 0; i < lengths.size(); ++i) {
+            int len = lengths[i];
+            if (len == 0) continue;
+            int code = next[len]++;
+            int reversed = 0;
+            for (int b = 0; b < len; ++b) reversed |= ((code >> b) & 1) << (len - 1 - b);
+            codes[i] = static_cast<uint16_t>(reversed);
+        }
+    }
+
+    // Writes the pending symbols as one block with dynamic Huffman codes
+    void emitBlock(bool last, std::string& out) {
+        const Tables& t = tables();
+        std::vector<uint32_t> literal_freq(286, 0);
+        std::vector<uint32_t> distance_freq(30, 0);
+        for (const Symbol& s : symbols) {
+            if (s.distance == 0) {
+                literal_freq[s.value]++;
+            } else {
+                literal_freq[257 + t.length_code[s.value]]++;
+                distance_freq[t.distanceCode(s.distance)]++;
+            }
+        }
+        literal_freq[256] = 1;
+        // Decoders expect at least two codes in each tree
+        if (std::count_if(literal_freq.begin(), literal_freq.end(), [](uint32_t f) { return f > 0; }) < 2) {
+            literal_freq[0] = std::max<uint32_t>(literal_freq[0], 1);
+        }
+        for (size_t code = 0; code < 2; ++code) {
+            if (std::count_if(distance_freq.begin(), distance_freq.end(), [](uint32_t f) { return f > 0; }) < 2) {
+                distance_freq[code] = std::max<uint32_t>(distance_freq[code], 1);
+            }
+        }
+
+        std::vector<uint8_t> literal_lengths, distance_lengths;
+        buildLengths(literal_freq, 15, literal_lengths);
+        buildLengths(distance_freq, 15, distance_lengths);
+        size_t hlit = 286;
+        while (hlit > 257 && literal_lengths[hlit - 1] == 0) hlit--;
+        size_t hdist = 30;
+        while (hdist > 1 && distance_lengths[hdist - 1] == 0) hdist--;
+
+        // Run-length code the two length tables as one sequence
+        std::vector<uint8_t> all(literal_lengths.begin(), literal_lengths.begin() + static_cast<std::ptrdiff_t>(hlit));
+        all.insert(all.end(), distance_lengths.begin(), distance_lengths.begin() + static_cast<std::ptrdiff_t>(hdist));
+        std::vector<std::pair<uint8_t, uint8_t>> runs;  // (symbol, extra bits value)
+        std::vector<uint32_t> length_freq(19, 0);
+        for (size_t i = 0; i < all.size();) {
+            uint8_t len = all[i];
+            size_t run = 1;
+            while (i + run < all.size() && all[i + run] == len) run++;
+            size_t left = run;
+            if (len == 0) {
+                while (left >= 11) {
+                    size_t take = std::min<size_t>(left, 138);
+                    runs.emplace_back(18, static_cast<uint8_t>(take - 11));
+                    left -= take;
+                }
+                if (left >= 3) {
+                    runs.emplace_back(17, static_cast<uint8_t>(left - 3));
+                    left = 0;
+                }
+            } else {
+                runs.emplace_back(len, 0);
+                left--;
+                while (left >= 3) {
+                    size_t take = std::min<size_t>(left, 6);
+                    runs.emplace_back(16, static_cast<uint8_t>(take - 3));
+                    left -= take;
+                }
+            }
+            for (; left > 0; --left) runs.emplace_back(len, 0);
+            i += run;
+        }
+        for (const auto& run : runs) length_freq[run.first]++;
+        std::vector<uint8_t> length_lengths;
+        buildLengths(length_freq, 7, length_lengths);
+        static const uint8_t kOrder[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+        size_t hclen = 19;
+        while (hclen > 4 && length_lengths[kOrder[hclen - 1]] == 0) hclen--;
+
+        std::vector<uint16_t> literal_codes, distance_codes, length_codes;
+        buildCodes(literal_lengths, literal_codes);
+        buildCodes(distance_lengths, distance_codes);
+        buildCodes(length_lengths, length_codes);
+
+        putBits(last ? 1 : 0, 1);
+        putBits(2, 2);
+        putBits(static_cast<uint32_t>(hlit - 257), 5);
+        putBits(static_cast<uint32_t>(hdist - 1), 5);
+        putBits(static_cast<uint32_t>(hclen - 4), 4);
+        flushBits(out);
+        for (size_t i = 0; i < hclen; ++i) {
+            putBits(length_lengths[kOrder[i]], 3);
+            flushBits(out);
+        }
+        for (const auto& run : runs) {
+            putBits(length_codes[run.first], length_lengths[run.first]);
+            if (run.first == 16) putBits(run.second, 2);
+            if (run.first == 17) putBits(run.second, 3);
+            if (run.first == 18) putBits(run.second, 7);
+            flushBits(out);
+        }
+
+        for (const Symbol& s : symbols) {
+            if (s.distance == 0) {
+                putBits(literal_codes[s.value], literal_lengths[s.value]);
+            } else {
+                int code = t.length_code[s.value];
+                putBits(literal_codes[257 + code], literal_lengths[257 + code]);
+                putBits(s.value - t.length_base[code], t.length_extra[code]);
+                if (bit_count >= 32) flushBits(out);
+                int dcode = t.distanceCode(s.distance);
+                putBits(distance_codes[dcode], distance_lengths[dcode]);
+                putBits(s.distance - t.distance_base[dcode], t.distance_extra[dcode]);
+            }
+            if (bit_count >= 32) flushBits(out);
+        }
+        putBits(literal_codes[256], literal_lengths[256]);
+        flushBits(out);
+        symbols.clear();
+    }
+};
+
+// Writes a ZIP archive entry by entry. Entry data is streamed through a
+// Deflater and sizes follow each entry in a data descriptor, so the output
+// is never seeked and may be a pipe.
+class ZipWriter {
+public:
+    bool open(const std::string& path) {
+        file.open(path, std::ios::binary | std::ios::trunc);
+        return file.is_open();
+    }
+
+    void beginEntry(const std::string& name) {
+        current = Record();
+        current.name = name;
+        current.offset = written;
+        deflater = Deflater();
+        std::string header;
+        appendLE(header, 0x04034b50, 4);
+        appendLE(header, 20, 2);         // Version needed
+        appendLE(header, 0x0808, 2);     // Data descriptor follows; UTF-8 name
+        appendLE(header, 8, 2);          // Deflated
+        appendLE(header, 0, 4);          // Time and date
+        appendLE(header, 0, 12);         // CRC and sizes, in the descriptor
+        appendLE(header, name.size(), 2);
+        appendLE(header, 0, 2);
+        header += name;
+        put(header);
+    }
+
+    void write(std::string_view data) {
+        current.crc = crc32(data, current.crc);
+        current.size += data.size();
+        deflater.write(data, compressed);
+        if (compressed.size() >= kFlushBytes) flushCompressed();
+    }
+
+    void endEntry() {
+        deflater.finish(compressed);
+        flushCompressed();
+        std::string descriptor;
+        appendLE(descriptor, 0x08074b50, 4);
+        appendLE(descriptor, current.crc, 4);
+        appendLE(descriptor, current.compressed_size, 4);
+        appendLE(descriptor, current.size, 4);
+        put(descriptor);
+        records.push_back(current);
+    }
+
+    // Writes the central directory; false when the archive is over the ZIP32
+    // limits or the file could not be written
+    bool close(std::string& error) {
+        std::string directory;
+        for (const auto& record : records) {
+            appendLE(directory, 0x02014b50, 4);
+            appendLE(directory, 20, 2);      // Made by
+            appendLE(directory, 20, 2);      // Needed
+            appendLE(directory, 0x0808, 2);
+            appendLE(directory, 8, 2);
+            appendLE(directory, 0, 4);
+            appendLE(directory, record.crc, 4);
+            appendLE(directory, record.compressed_size, 4);
+            appendLE(directory, record.size, 4);
+            appendLE(directory, record.name.size(), 2);
+            appendLE(directory, 0, 8);       // Extra, comment, disk, internal attributes
+            appendLE(directory, 0, 4);       // External attributes
+            appendLE(directory, record.offset, 4);
+            directory += record.name;
+        }
+        size_t directory_offset = written;
+        put(directory);
+        std::string end;
+        appendLE(end, 0x06054b50, 4);
+        appendLE(end, 0, 4);
+        appendLE(end, records.size(), 2);
+        appendLE(end, records.size(), 2);
+        appendLE(end, directory.size(), 4);
+        appendLE(end, directory_offset, 4);
+        appendLE(end, 0, 2);
+        put(end);
+        file.close();
+
+        for (const auto& record : records) {
+            if (record.size > 0xFFFFFFFFull || record.compressed_size > 0xFFFFFFFFull) {
+                error = record.name + " is over 4 GB, which needs ZIP64";
+                return false;
+            }
+        }
+        if (directory_offset > 0xFFFFFFFFull) {
+            error = "archive is over 4 GB, which needs ZIP64";
+            return false;
+        }
+        if (file.fail()) {
+            error = "write failed";
+            return false;
+        }
+        return true;
+    }
+
+private:
+    struct Record {
+        std::string name;
+        uint64_t offset = 0;
+        uint32_t crc = 0;
+        uint64_t size = 0;
+        uint64_t compressed_size = 0;
+    };
+
+    static constexpr size_t kFlushBytes = 64 * 1024;
+
+    std::ofstream file;
+    uint64_t written = 0;
+    Deflater deflater;
+    std::string compressed;
+    Record current;
+    std::vector<Record> records;
+
+    static void appendLE(std::string& out, uint64_t value, size_t width) {
+        for (size_t i = 0; i < width; ++i) out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+
+    void put(std::string_view bytes) {
+        file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        written += bytes.size();
+    }
+
+    void flushCompressed() {
+        current.compressed_size += compressed.size();
+        put(compressed);
+        compressed.clear();
+    }
+};
+
+// Writes a one-sheet .xlsx workbook row by row. Sheet XML is compressed as it
+// is produced; text cells go to a deduplicated shared-string table, written
+// when the workbook is closed. Once the table holds kMaxSharedBytes of text,
+// new values are written inline so memory stays bounded. Values that read
+// back unchanged as numbers are stored as numbers.
+class XlsxWriter {
+public:
+    enum class CellStyle : uint8_t { Plain, Error, Header };
+
+    bool open(const std::string& path, const std::string& sheet) {
+        sheet_name = sheet;
+        if (!zip.open(path)) return false;
+        zip.beginEntry("xl/worksheets/sheet1.xml");
+        xml = "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+              "<worksheet xmlns=\"http://schemas.openxmlformats.org/spreadsheetml/2006/main\"><sheetData>";
+        return true;
+    }
+
+    void beginRow() {
+        row++;
+        col = 0;
+        row_number = std::to_string(row);
+        xml += "<row r=\"";
+        xml += row_number;
+        xml += "\">";
+    }
+
+    void cell(std::string_view value, CellStyle style = CellStyle::Plain) {
+        size_t column = col++;
+        if (value.empty() && style != CellStyle::Error) return;
+        while (column_names.size() <= column) column_names.push_back(columnName(column_names.size()));
+        xml += "<c r=\"";
+        xml += column_names[column];
+        xml += row_number;
+        xml += '"';
+        if (style != CellStyle::Plain) {
+            xml += " s=\"";
+            xml += static_cast<char>('0' + static_cast<int>(style));
+            xml += '"';
+        }
+        if (value.empty()) {
+            xml += "/>";
+        } else if (isNumber(value)) {
+            xml += "><v>";
+            xml += value;
+            xml += "</v></c>";
+        } else if (uint32_t index; sharedIndex(value, index)) {
+            xml += " t=\"s\"><v>";
+            xml += std::to_string(index);
+            xml += "</v></c>";
+        } else {
+            xml += " t=\"inlineStr\"><is>";
+            appendText(xml, value);
+            xml += "</is></c>";
+        }
+    }
+
+    void endRow() {
+        xml += "</row>";
+        if (xml.size() >= kFlushBytes) {
+            zip.write(xml);
+            xml.clear();
+        }
+    }
+
+    // Finishes the sheet and writes the remaining parts of the workbook
+    bool close(std::string& error) {
+        xml += "</sheetData></worksheet>";
+        zip.write(xml);
+        xml.clear();
+        zip.endEntry();
+
+        zip.beginEntry("xl/sharedStrings.xml");
+        xml = "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+              "<sst xmlns=\"http://schemas.openxmlformats.org/spreadsheetml/2006/main\" count=\"" +
+              std::to_string(shared_references) + "\" uniqueCount=\"" + std::to_string(shared_strings.size()) + "\">";
+        for (std::string_view text : shared_strings) {
+            xml += "<si>";
+            appendText(xml, text);
+            xml += "</si>";
+            if (xml.size() >= kFlushBytes) {
+                zip.write(xml);
+                xml.clear();
+            }
+        }
+        xml += "</sst>";
+        zip.write(xml);
+        xml.clear();
+        zip.endEntry();
+
+        std::string escaped_name;
+        appendEscaped(escaped_name, sheet_name.substr(0, 31));
+        addPart("xl/workbook.xml",
+                "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+                "<workbook xmlns=\"http://schemas.openxmlformats.org/spreadsheetml/2006/main\" "
+                "xmlns:r=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships\">"
+                "<sheets><sheet name=\"" + escaped_name + "\" sheetId=\"1\" r:id=\"rId1\"/></sheets></workbook>");
+        addPart("xl/styles.xml",
+                "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+                "<styleSheet xmlns=\"http://schemas.openxmlformats.org/spreadsheetml/2006/main\">"
+                "<fonts count=\"2\"><font><sz val=\"11\"/><name val=\"Calibri\"/></font>"
+                "<font><b/><sz val=\"11\"/><name val=\"Calibri\"/></font></fonts>"
+                "<fills count=\"3\"><fill><patternFill patternType=\"none\"/></fill>"
+                "<fill><patternFill patternType=\"gray125\"/></fill>"
+                "<fill><patternFill patternType=\"solid\"><fgColor rgb=\"FFFFC7CE\"/><bgColor indexed=\"64\"/></patternFill></fill></fills>"
+                "<borders count=\"1\"><border><left/><right/><top/><bottom/><diagonal/></border></borders>"
+                "<cellStyleXfs count=\"1\"><xf numFmtId=\"0\" fontId=\"0\" fillId=\"0\" borderId=\"0\"/></cellStyleXfs>"
+                "<cellXfs count=\"3\"><xf numFmtId=\"0\" fontId=\"0\" fillId=\"0\" borderId=\"0\" xfId=\"0\"/>"
+                "<xf numFmtId=\"0\" fontId=\"0\" fillId=\"2\" borderId=\"0\" xfId=\"0\" applyFill=\"1\"/>"
+                "<xf numFmtId=\"0\" fontId=\"1\" fillId=\"0\" borderId=\"0\" xfId=\"0\" applyFont=\"1\"/></cellXfs>"
+                "<cellStyles count=\"1\"><cellStyle name=\"Normal\" xfId=\"0\" builtinId=\"0\"/></cellStyles></styleSheet>");
+        addPart("xl/_rels/workbook.xml.rels",
+                "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+                "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">"
+                "<Relationship Id=\"rId1\" Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/worksheet\" Target=\"worksheets/sheet1.xml\"/>"
+                "<Relationship Id=\"rId2\" Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/styles\" Target=\"styles.xml\"/>"
+                "<Relationship Id=\"rId3\" Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/sharedStrings\" Target=\"sharedStrings.xml\"/>"
+                "</Relationships>");
+        addPart("_rels/.rels",
+                "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+                "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">"
+                "<Relationship Id=\"rId1\" Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/officeDocument\" Target=\"xl/workbook.xml\"/>"
+                "</Relationships>");
+        addPart("[Content_Types].xml",
+                "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+                "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">"
+                "<Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>"
+                "<Default Extension=\"xml\" ContentType=\"application/xml\"/>"
+                "<Override PartName=\"/xl/workbook.xml\" ContentType=\"application/vnd.openxmlformats-officedocument.spreadsheetml.sheet.main+xml\"/>"
+                "<Override PartName=\"/xl/worksheets/sheet1.xml\" ContentType=\"application/vnd.openxmlformats-officedocument.spreadsheetml.worksheet+xml\"/>"
+                "<Override PartName=\"/xl/styles.xml\" ContentType=\"application/vnd.openxmlformats-officedocument.spreadsheetml.styles+xml\"/>"
+                "<Override PartName=\"/xl/sharedStrings.xml\" ContentType=\"application/vnd.openxmlformats-officedocument.spreadsheetml.sharedStrings+xml\"/>"
+                "</Types>");
+        return zip.close(error);
+    }
+
+private:
+    static constexpr size_t kFlushBytes = 64 * 1024;
+    static constexpr size_t kMaxSharedBytes = 64 * 1024 * 1024;
+
+    ZipWriter zip;
+    std::string sheet_name;
+    std::string xml;
+    size_t row = 0;
+    size_t col = 0;
+    std::string row_number;
+    std::vector<std::string> column_names;
+    CellArena strings_arena;
+    std::unordered_map<std::string_view, uint32_t> shared_index;
+    std::vector<std::string_view> shared_strings;
+    size_t shared_bytes = 0;
+    size_t shared_references = 0;
+
+    // Index of value in the shared-string table, adding it while there is room
+    bool sharedIndex(std::string_view value, uint32_t& index) {
+        auto it = shared_index.find(value);
+        if (it == shared_index.end()) {
+            if (shared_bytes + value.size() > kMaxSharedBytes) return false;
+            std::string_view stored = strings_arena.store(value);
+            shared_bytes += value.size();
+            it = shared_index.emplace(stored, static_cast<uint32_t>(shared_strings.size())).first;
+            shared_strings.push_back(stored);
+        }
+        shared_references++;
+        index = it->second;
+        return true;
+    }
+
+    void addPart(const std::string& name, std::string_view content) {
+        zip.beginEntry(name);
+        zip.write(content);
+        zip.endEntry();
+    }
+
+    // 0 -> "A", 26 -> "AA"
+    static std::string columnName(size_t column) {
+        std::string name;
+        for (size_t n = column + 1; n > 0; n = (n - 1) / 26) {
+            name.insert(name.begin(), static_cast<char>('A' + (n - 1) % 26));
+        }
+        return name;
+    }
+
+    // Integers and decimals in the form Excel writes them back: no sign but
+    // '-', no leading or trailing zeros, at most 15 significant digits
+    static bool isNumber(std::string_view value) {
+        size_t i = value[0] == '-' ? 1 : 0;
+        size_t digits_start = i;
+        while (i < value.size() && value[i] >= '0' && value[i] <= '9') i++;
+        size_t integer_digits = i - digits_start;
+        if (integer_digits == 0 || (integer_digits > 1 && value[digits_start] == '0')) return false;
+        size_t fraction_digits = 0;
+        if (i < value.size()) {
+            if (value[i] != '.') return false;
+            size_t fraction_start = ++i;
+            while (i < value.size() && value[i] >= '0' && value[i] <= '9') i++;
+            fraction_digits = i - fraction_start;
+            if (i != value.size() || fraction_digits == 0 || value.back() == '0') return false;
+        }
+        if (value.substr(digits_start) == "0" && digits_start == 1) return false;  // "-0"
+        size_t significant = integer_digits + fraction_digits;
+        if (value[digits_start] == '0') significant--;
+        return significant <= 15;
+    }
+
+    // <t> element for a text value, keeping edge whitespace
+    static void appendText(std::string& out, std::string_view value) {
+        bool edge_space = std::isspace(static_cast<unsigned char>(value.front())) ||
+                          std::isspace(static_cast<unsigned char>(value.back()));
+        out += edge_space ? "<t xml:space=\"preserve\">" : "<t>";
+        appendEscaped(out, value);
+        out += "</t>";
+    }
+
+    // XML character escapes, plus Excel's _xHHHH_ form for control characters
+    // XML cannot carry and for text that would otherwise read as one
+    static void appendEscaped(std::string& out, std::string_view value) {
+        size_t plain = 0;
+        for (size_t i = 0; i < value.size(); ++i) {
+            unsigned char c = static_cast<unsigned char>(value[i]);
+            const char* replacement = nullptr;
+            char code[8];
+            switch (c) {
+                case '&': replacement = "&amp;"; break;
+                case '<': replacement = "&lt;"; break;
+                case '>': replacement = "&gt;"; break;
+                case '"': replacement = "&quot;"; break;
+                case '\r': replacement = "_x000D_"; break;  // Parsers turn a raw CR into LF
+                case '_':
+                    if (i + 6 < value.size() && value[i + 1] == 'x' && value[i + 6] == '_' &&
+                        std::all_of(value.begin() + i + 2, value.begin() + i + 6,
+                                    [](char h) { return std::isxdigit(static_cast<unsigned char>(h)); })) {
+                        replacement = "_x005F_";
+                    }
+                    break;
+                default:
+                    if (c < 0x20 && c != '\t' && c != '\n') {
+                        std::snprintf(code, sizeof(code), "_x%04X_", c);
+                        replacement = code;
+                    }
+                    break;
+            }
+            if (!replacement) continue;
+            out.append(value.substr(plain, i - plain));
+            out += replacement;
+            plain = i + 1;
+        }
+        out.append(value.substr(plain));
+    }
+};
+
+// Builds a flatbuffer the way the flatbuffers library does, back to front:
+// objects are added before the tables that refer to them, and an Offset is an
+// object's distance from the end of the buffer. Bytes are kept reversed until
+// finish().
+class FlatBuilder {
+public:
+    using Offset = uint32_t;
+
+    Offset string(std::string_view text) {
+        pad(text.size() + 1, 4);
+        bytes.push_back('\0');
+        prepend(text.data(), text.size());
+        scalar(static_cast<uint32_t>(text.size()));
+        return size();
+    }
+
+    // Vector of count structs of element_size bytes, 8-byte aligned
+    Offset structs(const void* data, size_t count, size_t element_size) {
+        pad(count * element_size, 8);
+        prepend(data, count * element_size);
+        scalar(static_cast<uint32_t>(count));
+        return size();
+    }
+
+    Offset offsets(const std::vector<Offset>& targets) {
+        for (auto it = targets.rbegin(); it != targets.rend(); ++it) reference(*it);
+        scalar(static_cast<uint32_t>(targets.size()));
+        return size();
+    }
+
+    void startTable() {
+        slots.clear();
+        table_start = size();
+    }
+
+    template <typename T>
+    void add(uint16_t slot, T value) {
+        scalar(value);
+        slots.emplace_back(slot, size());
+    }
+
+    void addOffset(uint16_t slot, Offset target) {
+        reference(target);
+        slots.emplace_back(slot, size());
+    }
+
+    // Closes the table with its vtable placed just before it
+    Offset endTable() {
+        uint16_t slot_count = 0;
+        for (const auto& slot : slots) slot_count = std::max<uint16_t>(slot_count, slot.first + 1);
+        uint16_t vtable_bytes = static_cast<uint16_t>(4 + 2 * slot_count);
+        scalar(static_cast<int32_t>(vtable_bytes));
+        Offset table = size();
+        std::vector<uint16_t> entries(slot_count, 0);
+        for (const auto& slot : slots) entries[slot.first] = static_cast<uint16_t>(table - slot.second);
+        for (size_t j = slot_count; j-- > 0;) scalar(entries[j]);
+        scalar(static_cast<uint16_t>(table - table_start));
+        scalar(vtable_bytes);
+        return table;
+    }
+
+    // The finished buffer, whose first word locates root
+    std::string finish(Offset root) {
+        pad(4, max_align);
+        reference(root);
+        return std::string(bytes.rbegin(), bytes.rend());
+    }
+
+private:
+    std::string bytes;
+    size_t max_align = 4;
+    Offset table_start = 0;
+    std::vector<std::pair<uint16_t, Offset>> slots;
+
+    Offset size() const {
+        return static_cast<Offset>(bytes.size());
+    }
+
+    void prepend(const void* data, size_t length) {
+        const char* source = static_cast<const char*>(data);
+        for (size_t i = length; i-- > 0;) bytes.push_back(source[i]);
+    }
+
+    // Zero padding so that the next length bytes end on an alignment boundary
+    void pad(size_t length, size_t alignment) {
+        max_align = std::max(max_align, alignment);
+        while ((bytes.size() + length) % alignment != 0) bytes.push_back('\0');
+    }
+
+    template <typename T>
+    void scalar(T value) {
+        pad(sizeof(T), sizeof(T));
+        prepend(&value, sizeof(T));
+    }
+
+    void reference(Offset target) {
+        pad(4, 4);
+        scalar(static_cast<uint32_t>(size() + 4 - target));
+    }
+};
+
+// Writes an Arrow IPC file (format version 5) row by row: the schema, a
+// record batch every kBatchRows rows, then the dictionaries and the footer.
+// Columns are UTF-8 strings, dictionary-encoded strings or unsigned 64-bit
+// integers, without nulls. Dictionaries only grow, so each is written once
+// at the end; readers load them through the footer before any batch.
+class ArrowWriter {
+public:
+    enum class Type : uint8_t { Utf8, Dictionary, UInt64 };
+
+    struct Field {
+        std::string name;
+        Type type;
+    };
+
+    bool open(const std::string& path, std::vector<Field> schema) {
+        file.open(path, std::ios::binary);
+        if (!file.is_open()) return false;
+        fields = std::move(schema);
+        columns.clear();
+        columns.resize(fields.size());
+        put(std::string_view("ARROW1\0\0", 8));
+        FlatBuilder builder;
+        FlatBuilder::Offset header = buildSchema(builder);
+        writeMessage(builder, kSchemaMessage, header, 0);
+        return true;
+    }
+
+    // The next cell of the current row
+    void value(std::string_view text) {
+        size_t j = col++;
+        Column& column = columns[j];
+        if (fields[j].type == Type::Dictionary) {
+            column.indices.push_back(dictionaryIndex(column, text));
+        } else {
+            column.bytes.append(text);
+            column.offsets.push_back(static_cast<int32_t>(column.bytes.size()));
+            if (column.bytes.size() > kMaxBatchBytes) batch_full = true;
+        }
+    }
+
+    void value(uint64_t number) {
+        columns[col++].numbers.push_back(number);
+    }
+
+    void endRow() {
+        col = 0;
+        if (++rows == kBatchRows || batch_full) flushBatch();
+    }
+
+    bool close(std::string& error) {
+        if (rows > 0 || record_batches.empty()) flushBatch();
+        for (size_t j = 0; j < columns.size(); ++j) {
+            Column& column = columns[j];
+            if (fields[j].type != Type::Dictionary) continue;
+            dictionaries.push_back(writeBatch(column.dictionary_offsets.size() - 1, 1,
+                                              {std::string_view(), view(column.dictionary_offsets), column.dictionary_bytes},
+                                              static_cast<int64_t>(j)));
+        }
+        put32(0xFFFFFFFF);
+        put32(0);
+
+        FlatBuilder builder;
+        FlatBuilder::Offset schema = buildSchema(builder);
+        FlatBuilder::Offset dictionary_blocks = builder.structs(dictionaries.data(), dictionaries.size(), sizeof(Block));
+        FlatBuilder::Offset batch_blocks = builder.structs(record_batches.data(), record_batches.size(), sizeof(Block));
+        builder.startTable();
+        builder.addOffset(1, schema);
+        builder.addOffset(2, dictionary_blocks);
+        builder.addOffset(3, batch_blocks);
+        builder.add<int16_t>(0, kMetadataVersion);
+        std::string footer = builder.finish(builder.endTable());
+        put(footer);
+        put32(static_cast<uint32_t>(footer.size()));
+        put(std::string_view("ARROW1", 6));
+
+        file.close();
+        if (!file) {
+            error = "write failed";
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static constexpr size_t kBatchRows = 65536;
+    static constexpr size_t kMaxBatchBytes = size_t(1) << 30;  // Offsets are 32-bit
+    static constexpr int16_t kMetadataVersion = 4;             // V5
+    static constexpr uint8_t kSchemaMessage = 1;
+    static constexpr uint8_t kDictionaryMessage = 2;
+    static constexpr uint8_t kRecordBatchMessage = 3;
+    static constexpr uint8_t kIntType = 2;
+    static constexpr uint8_t kUtf8Type = 5;
+
+    // Locates one encapsulated message in the file, as listed in the footer
+    struct Block {
+        int64_t offset;
+        int32_t metadata_length;
+        int32_t padding;
+        int64_t body_length;
+    };
+
+    struct Column {
+        std::vector<int32_t> offsets{0};
+        std::string bytes;
+        std::vector<int32_t> indices;
+        std::vector<uint64_t> numbers;
+        CellArena arena;
+        std::unordered_map<std::string_view, int32_t> dictionary;
+        std::vector<int32_t> dictionary_offsets{0};
+        std::string dictionary_bytes;
+    };
+
+    std::ofstream file;
+    uint64_t written = 0;
+    std::vector<Field> fields;
+    std::vector<Column> columns;
+    size_t col = 0;
+    size_t rows = 0;
+    bool batch_full = false;
+    std::vector<Block> dictionaries;
+    std::vector<Block> record_batches;
+
+    template <typename T>
+    static std::string_view view(const std::vector<T>& values) {
+        return std::string_view(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+
+    static int32_t dictionaryIndex(Column& column, std::string_view text) {
+        auto it = column.dictionary.find(text);
+        if (it != column.dictionary.end()) return it->second;
+        int32_t index = static_cast<int32_t>(column.dictionary.size());
+        column.dictionary.emplace(column.arena.store(text), index);
+        column.dictionary_bytes.append(text);
+        column.dictionary_offsets.push_back(static_cast<int32_t>(column.dictionary_bytes.size()));
+        return index;
+    }
+
+    void flushBatch() {
+        std::vector<std::string_view> buffers;
+        for (size_t j = 0; j < columns.size(); ++j) {
+            const Column& column = columns[j];
+            buffers.emplace_back();  // No validity bitmap: nothing is null
+            switch (fields[j].type) {
+                case Type::Utf8:
+                    buffers.push_back(view(column.offsets));
+                    buffers.push_back(column.bytes);
+                    break;
+                case Type::Dictionary:
+                    buffers.push_back(view(column.indices));
+                    break;
+                case Type::UInt64:
+                    buffers.push_back(view(column.numbers));
+                    break;
+            }
+        }
+        record_batches.push_back(writeBatch(rows, columns.size(), buffers, -1));
+        for (Column& column : columns) {
+            column.offsets.resize(1);
+            column.bytes.clear();
+            column.indices.clear();
+            column.numbers.clear();
+        }
+        rows = 0;
+        batch_full = false;
+    }
+
+    // A record batch, or with dictionary_id >= 0 the dictionary batch of that
+    // column; every column has length rows and the buffers are laid out in order
+    Block writeBatch(size_t length, size_t column_count, const std::vector<std::string_view>& buffers,
+                     int64_t dictionary_id) {
+        std::vector<int64_t> nodes;
+        for (size_t j = 0; j < column_count; ++j) {
+            nodes.push_back(static_cast<int64_t>(length));
+            nodes.push_back(0);
+        }
+        std::vector<int64_t> layout;
+        int64_t body_length = 0;
+        for (std::string_view buffer : buffers) {
+            layout.push_back(body_length);
+            layout.push_back(static_cast<int64_t>(buffer.size()));
+            body_length += static_cast<int64_t>(padded(buffer.size()));
+        }
+
+        FlatBuilder builder;
+        FlatBuilder::Offset node_vector = builder.structs(nodes.data(), column_count, 2 * sizeof(int64_t));
+        FlatBuilder::Offset buffer_vector = builder.structs(layout.data(), buffers.size(), 2 * sizeof(int64_t));
+        builder.startTable();
+        builder.add<int64_t>(0, static_cast<int64_t>(length));
+        builder.addOffset(1, node_vector);
+        builder.addOffset(2, buffer_vector);
+        FlatBuilder::Offset header = builder.endTable();
+        uint8_t type = kRecordBatchMessage;
+        if (dictionary_id >= 0) {
+            FlatBuilder::Offset batch = header;
+            builder.startTable();
+            builder.add<int64_t>(0, dictionary_id);
+            builder.addOffset(1, batch);
+            header = builder.endTable();
+            type = kDictionaryMessage;
+        }
+
+        Block block = writeMessage(builder, type, header, body_length);
+        for (std::string_view buffer : buffers) {
+            put(buffer);
+            putPadding(buffer.size());
+        }
+        return block;
+    }
+
+    FlatBuilder::Offset buildSchema(FlatBuilder& builder) {
+        std::vector<FlatBuilder::Offset> field_tables;
+        for (size_t j = 0; j < fields.size(); ++j) {
+            const Field& field = fields[j];
+            FlatBuilder::Offset name = builder.string(field.name);
+            FlatBuilder::Offset children = builder.offsets({});
+            builder.startTable();
+            if (field.type == Type::UInt64) {
+                builder.add<int32_t>(0, 64);
+                builder.add<uint8_t>(1, 0);
+            }
+            FlatBuilder::Offset type = builder.endTable();
+            FlatBuilder::Offset encoding = 0;
+            if (field.type == Type::Dictionary) {
+                builder.startTable();
+                builder.add<int32_t>(0, 32);
+                builder.add<uint8_t>(1, 1);
+                FlatBuilder::Offset index_type = builder.endTable();
+                builder.startTable();
+                builder.add<int64_t>(0, static_cast<int64_t>(j));
+                builder.addOffset(1, index_type);
+                encoding = builder.endTable();
+            }
+            builder.startTable();
+            builder.addOffset(0, name);
+            builder.addOffset(3, type);
+            if (encoding) builder.addOffset(4, encoding);
+            builder.addOffset(5, children);
+            builder.add<uint8_t>(1, 0);
+            builder.add<uint8_t>(2, field.type == Type::UInt64 ? kIntType : kUtf8Type);
+            field_tables.push_back(builder.endTable());
+        }
+        FlatBuilder::Offset field_vector = builder.offsets(field_tables);
+        builder.startTable();
+        builder.addOffset(1, field_vector);
+        builder.add<int16_t>(0, 0);  // Little-endian
+        return builder.endTable();
+    }
+
+    // Continuation marker, metadata length, the Message flatbuffer padded to
+    // 8 bytes; the body follows
+    Block writeMessage(FlatBuilder& builder, uint8_t type, FlatBuilder::Offset header, int64_t body_length) {
+        builder.startTable();
+        builder.add<int64_t>(3, body_length);
+        builder.addOffset(2, header);
+        builder.add<int16_t>(0, kMetadataVersion);
+        builder.add<uint8_t>(1, type);
+        std::string metadata = builder.finish(builder.endTable());
+        metadata.resize(padded(metadata.size()), '\0');
+
+        Block block{static_cast<int64_t>(written), static_cast<int32_t>(8 + metadata.size()), 0, body_length};
+        put32(0xFFFFFFFF);
+        put32(static_cast<uint32_t>(metadata.size()));
+        put(metadata);
+        return block;
+    }
+
+    static size_t padded(size_t size) {
+        return (size + 7) / 8 * 8;
+    }
+
+    void put(std::string_view bytes) {
+        file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        written += bytes.size();
+    }
+
+    void put32(uint32_t value) {
+        put(std::string_view(reinterpret_cast<const char*>(&value), sizeof(value)));
+    }
+
+    void putPadding(size_t size) {
+        static const char zeros[8] = {};
+        put(std::string_view(zeros, padded(size) - size));
+    }
+};
+
+// Writes JSON Lines through a large buffer. Strings are escaped per RFC 8259;
+// bytes that are not well-formed UTF-8 are read as Latin-1, the encoding of
+// exports that are not UTF-8, so every line stays valid JSON.
+class JsonLinesWriter {
+public:
+    bool open(const std::string& path) {
+        file.open(path, std::ios::binary);
+        buffer.reserve(kFlushBytes + 4096);
+        return file.is_open();
+    }
+
+    void beginRecord() {
+        buffer += '{';
+        first_field = true;
+    }
+
+    void field(std::string_view name, uint64_t value) {
+        key(name);
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        buffer.append(digits, result.ptr);
+    }
+
+    void field(std::string_view name, std::string_view value) {
+        key(name);
+        appendString(buffer, value);
+    }
+
+    void endRecord() {
+        buffer += "}\n";
+        if (buffer.size() >= kFlushBytes) flush();
+    }
+
+    bool close(std::string& error) {
+        flush();
+        file.close();
+        if (!file) {
+            error = "write failed";
+            return false;
+        }
+        return true;
+    }
+
+    // Append value to out as a quoted, escaped JSON string
+    static void appendString(std::string& out, std::string_view value) {
+        out += '"';
+        size_t plain = 0;
+        for (size_t i = 0; i < value.size();) {
+            unsigned char c = static_cast<unsigned char>(value[i]);
+            if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\') {
+                i++;
+                continue;
+            }
+            if (c >= 0x80) {
+                size_t length = utf8SequenceLength(value, i);
+                if (length > 0) {
+                    i += length;
+                    continue;
+                }
+            }
+            out.append(value.substr(plain, i - plain));
+            switch (c) {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                default: {
+                    char escape[8];
+                    std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+                    out += escape;
+                    break;
+                }
+            }
+            plain = ++i;
+        }
+        out.append(value.substr(plain));
+        out += '"';
+    }
+
+private:
+    static constexpr size_t kFlushBytes = 1 << 20;
+
+    std::ofstream file;
+    std::string buffer;
+    bool first_field = true;
+
+    void flush() {
+        file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        buffer.clear();
+    }
+
+    void key(std::string_view name) {
+        if (!first_field) buffer += ',';
+        first_field = false;
+        appendString(buffer, name);
+        buffer += ':';
+    }
+
+    // Length of the well-formed UTF-8 sequence starting at text[i], or 0
+    static size_t utf8SequenceLength(std::string_view text, size_t i) {
+        auto byte = [&text](size_t k) { return k < text.size() ? static_cast<unsigned char>(text[k]) : 0; };
+        auto continuation = [](unsigned char c) { return c >= 0x80 && c <= 0xBF; };
+        unsigned char lead = byte(i);
+        unsigned char next = byte(i + 1);
+        if (lead >= 0xC2 && lead <= 0xDF) {
+            return continuation(next) ? 2 : 0;
+        }
+        if (lead >= 0xE0 && lead <= 0xEF) {
+            bool second = lead == 0xE0 ? (next >= 0xA0 && next <= 0xBF)
+                        : lead == 0xED ? (next >= 0x80 && next <= 0x9F)
+                                       : continuation(next);
+            return second && continuation(byte(i + 2)) ? 3 : 0;
+        }
+        if (lead >= 0xF0 && lead <= 0xF4) {
+            bool second = lead == 0xF0 ? (next >= 0x90 && next <= 0xBF)
+                        : lead == 0xF4 ? (next >= 0x80 && next <= 0x8F)
+                                       : continuation(next);
+            return second && continuation(byte(i + 2)) && continuation(byte(i + 3)) ? 4 : 0;
+        }
+        return 0;
+    }
+};
+
+// Validation error codes. Messages are templates whose "{}" placeholders are
+// filled, in order, with the arguments recorded alongside the error.
+enum class ErrorCode : uint8_t {
+    ControlNumberEmpty,
+    ControlNumberLength,
+    ControlNumberDuplicate,
+    ControlNumberInHistory,
+    CurpEmpty,
+    CurpDuplicate,
+    CurpInHistory,
+    CurpLength,
+    CurpCharacters,
+    CurpLetters,
+    CurpBirthDate,
+    CurpGender,
+    CurpState,
+    CurpAlphanumeric,
+    CurpCheckDigits,
+    FieldEmpty,
+    NameCharacters,
+    NameTooShort,
+    NameRepeatedLetters,
+    NameDigits,
+    FirstNameCurpMismatch,
+    PaternalCurpMismatch,
+    PaternalVowelCurpMismatch,
+    MaternalMissingCurp,
+    MaternalCurpMismatch,
+    LastNameRequired,
+    OutOfRange,
+    NotInteger,
+    NotNumber,
+    GenderEmpty,
+    GenderInvalid,
+    CreditsNegative,
+    CreditsBelowMinimum,
+    AutoFilled,
+    YesNoInvalid,
+    EmailAutoFilled,
+    RfcEmpty,
+    RfcInvalid,
+    RfcLength,
+    RfcCharacters,
+    RfcLowercase,
+    RfcFisicaLetters,
+    RfcFisicaDate,
+    RfcFisicaHomoclave,
+    RfcMoralDash,
+    RfcMoralLetters,
+    RfcMoralDate,
+    RfcMoralHomoclave,
+    RfcMonth,
+    RfcDay,
+    RfcDateFormat,
+    PhoneCharacter,
+    PhoneAutoFilled,
+    PhoneLength,
+    PhoneDigits,
+    DisabilityTypeRequired,
+    DisabilityTypeUnexpected,
+    DisabilityTypeCharacters,
+    DisabilityTypeCustomCharacters,
+    NewStudentCredits,
+    NewStudentCurrentAverage,
+    NewStudentGeneralAverage,
+    LastNamesRequired
+};
+
+struct ErrorInfo {
+    ErrorCode code;
+    const char* id;
+    const char* message;
+};
+
+constexpr ErrorInfo kErrorInfo[] = {
+    {ErrorCode::ControlNumberEmpty, "control_number_empty", "Control number cannot be empty"},
+    {ErrorCode::ControlNumberLength, "control_number_length", "Control number should be {}-{} digits"},
+    {ErrorCode::ControlNumberDuplicate, "control_number_duplicate", "Duplicate control number found"},
+    {ErrorCode::ControlNumberInHistory, "control_number_in_history", "Control number was already accepted in an earlier batch"},
+    {ErrorCode::CurpEmpty, "curp_empty", "CURP cannot be empty"},
+    {ErrorCode::CurpDuplicate, "curp_duplicate", "Duplicate CURP found"},
+    {ErrorCode::CurpInHistory, "curp_in_history", "CURP was already accepted in an earlier batch"},
+    {ErrorCode::CurpLength, "curp_length", "CURP must be exactly 18 characters"},
+    {ErrorCode::CurpCharacters, "curp_characters", "CURP contains invalid characters"},
+    {ErrorCode::CurpLetters, "curp_letters", "CURP format invalid: first 4 characters should be letters"},
+    {ErrorCode::CurpBirthDate, "curp_birth_date", "CURP format invalid: characters 5-10 should be digits (birth date)"},
+    {ErrorCode::CurpGender, "curp_gender", "CURP format invalid: character 11 should be a letter (gender)"},
+    {ErrorCode::CurpState, "curp_state", "CURP format invalid: character 12 should be a letter (state)"},
+    {ErrorCode::CurpAlphanumeric, "curp_alphanumeric", "CURP format invalid: characters 13-16 should be alphanumeric"},
+    {ErrorCode::CurpCheckDigits, "curp_check_digits", "CURP format invalid: last 2 characters should be digits"},
+    {ErrorCode::FieldEmpty, "field_empty", "{} cannot be empty"},
+    {ErrorCode::NameCharacters, "name_characters", "{} contains invalid characters"},
+    {ErrorCode::NameTooShort, "name_too_short", "{} is too short"},
+    {ErrorCode::NameRepeatedLetters, "name_repeated_letters", "{} contains excessive repeated letters"},
+    {ErrorCode::NameDigits, "name_digits", "{} contains numbers"},
+    {ErrorCode::FirstNameCurpMismatch, "first_name_curp_mismatch", "First name initial '{}' doesn't match CURP 4th character '{}' (should match or be 'X')"},
+    {ErrorCode::PaternalCurpMismatch, "paternal_curp_mismatch", "Paternal last name first letter '{}' doesn't match CURP 1st character '{}'"},
+    {ErrorCode::PaternalVowelCurpMismatch, "paternal_vowel_curp_mismatch", "Paternal last name first vowel '{}' doesn't match CURP 2nd character '{}'"},
+    {ErrorCode::MaternalMissingCurp, "maternal_missing_curp", "No maternal last name but CURP 3rd character is '{}' (should be 'X')"},
+    {ErrorCode::MaternalCurpMismatch, "maternal_curp_mismatch", "Maternal last name first letter '{}' doesn't match CURP 3rd character '{}' (should match or be 'X')"},
+    {ErrorCode::LastNameRequired, "last_name_required", "At least one last name is required"},
+    {ErrorCode::OutOfRange, "out_of_range", "{} must be between {} and {}"},
+    {ErrorCode::NotInteger, "not_integer", "{} must be an integer number"},
+    {ErrorCode::NotNumber, "not_number", "{} must be a valid number (e.g., 89.87)"},
+    {ErrorCode::GenderEmpty, "gender_empty", "Gender cannot be empty, Added '{}' by default"},
+    {ErrorCode::GenderInvalid, "gender_invalid", "Gender must be 'H' or 'M'"},
+    {ErrorCode::CreditsNegative, "credits_negative", "Credits cannot be negative"},
+    {ErrorCode::CreditsBelowMinimum, "credits_below_minimum", "Credits must be at least {}"},
+    {ErrorCode::AutoFilled, "auto_filled", "{} was empty - auto-filled with '{}'"},
+    {ErrorCode::YesNoInvalid, "yes_no_invalid", "{} must be 'S' or 'N' (was: '{}')"},
+    {ErrorCode::EmailAutoFilled, "email_auto_filled", "Email was empty - auto-filled with {}"},
+    {ErrorCode::RfcEmpty, "rfc_empty", "RFC was empty - auto-filled with {}"},
+    {ErrorCode::RfcInvalid, "rfc_invalid", "RFC invalid - auto-filled with {}"},
+    {ErrorCode::RfcLength, "rfc_length", "RFC invalid length - auto-filled with {}"},
+    {ErrorCode::RfcCharacters, "rfc_characters", "RFC contains invalid characters (only letters, numbers, '-', and '&' allowed)"},
+    {ErrorCode::RfcLowercase, "rfc_lowercase", "RFC must be in uppercase letters"},
+    {ErrorCode::RfcFisicaLetters, "rfc_fisica_letters", "RFC persona física: first 4 characters should be letters"},
+    {ErrorCode::RfcFisicaDate, "rfc_fisica_date", "RFC persona física: characters 5-10 should be digits (date YYMMDD)"},
+    {ErrorCode::RfcFisicaHomoclave, "rfc_fisica_homoclave", "RFC persona física: last 3 characters should be alphanumeric (homoclave)"},
+    {ErrorCode::RfcMoralDash, "rfc_moral_dash", "RFC persona moral: first character should be '-'"},
+    {ErrorCode::RfcMoralLetters, "rfc_moral_letters", "RFC persona moral: characters 2-4 should be letters"},
+    {ErrorCode::RfcMoralDate, "rfc_moral_date", "RFC persona moral: characters 5-10 should be digits (date YYMMDD)"},
+    {ErrorCode::RfcMoralHomoclave, "rfc_moral_homoclave", "RFC persona moral: last 3 characters should be alphanumeric (homoclave)"},
+    {ErrorCode::RfcMonth, "rfc_month", "RFC: invalid month in date (should be 01-12)"},
+    {ErrorCode::RfcDay, "rfc_day", "RFC: invalid day in date (should be 01-31)"},
+    {ErrorCode::RfcDateFormat, "rfc_date_format", "RFC: invalid date format"},
+    {ErrorCode::PhoneCharacter, "phone_character", "Phone number contains invalid character: '{}'"},
+    {ErrorCode::PhoneAutoFilled, "phone_auto_filled", "Phone number was empty/invalid - auto-filled with '{}'"},
+    {ErrorCode::PhoneLength, "phone_length", "Phone number must be {} digits (after cleaning: {}, length: {})"},
+    {ErrorCode::PhoneDigits, "phone_digits", "Phone number must contain only digits"},
+    {ErrorCode::DisabilityTypeRequired, "disability_type_required", "Disability type is required when disability is 'S'"},
+    {ErrorCode::DisabilityTypeUnexpected, "disability_type_unexpected", "Disability type should be empty when disability is 'N'"},
+    {ErrorCode::DisabilityTypeCharacters, "disability_type_characters", "Disability type contains invalid characters (only letters, spaces, hyphens, and periods allowed)"},
+    {ErrorCode::DisabilityTypeCustomCharacters, "disability_type_custom_characters", "Disability type contains invalid characters"},
+    {ErrorCode::NewStudentCredits, "new_student_credits", "New students should have 0 accumulated credits"},
+    {ErrorCode::NewStudentCurrentAverage, "new_student_current_average", "New students should have 0.00 current average"},
+    {ErrorCode::NewStudentGeneralAverage, "new_student_general_average", "New students should have 0.00 general average"},
+    {ErrorCode::LastNamesRequired, "last_names_required", "At least one last name (paternal or maternal) is required"}
+};
+
+constexpr bool errorInfoInOrder() {
+    for (size_t i = 0; i < std::size(kErrorInfo); ++i) {
+        if (static_cast<size_t>(kErrorInfo[i].code) != i) return false;
+    }
+    return true;
+}
+
+static_assert(errorInfoInOrder(), "kErrorInfo must list error codes in declaration order");
+
+// Sparse, append-only store of the validation errors of the rows in memory.
+// Entries are kept in row order and hold a code plus the offset of their
+// arguments; message text is rendered only when it is read. Per-cell, per-row
+// and per-column counters are maintained as errors are added.
+class ErrorStore {
+public:
+    struct Entry {
+        size_t row;
+        uint32_t col;
+        ErrorCode code;
+        uint8_t arg_count;
+        // Arguments of a large in-memory dataset can pass 4 GiB
+        size_t arg_offset;
+    };
+
+    static_assert(sizeof(Entry) <= 24, "ErrorStore entries are kept compact");
+
+    std::vector<Entry> entries;
+    size_t error_cells = 0;
+    size_t error_rows = 0;
+    std::vector<size_t> column_error_cells;
+
+    // Errors must be added in row order
+    void add(size_t row, size_t col, ErrorCode code, std::initializer_list<std::string_view> args) {
+        add(row, col, code, args.begin(), args.size());
+    }
+
+    void add(size_t row, size_t col, ErrorCode code, const std::string_view* args, size_t arg_count) {
+        bool new_row = true;
+        bool new_cell = true;
+        for (auto it = entries.rbegin(); it != entries.rend() && it->row == row; ++it) {
+            new_row = false;
+            if (it->col == col) {
+                new_cell = false;
+                break;
+            }
+        }
+        if (new_row) {
+            error_rows++;
+        }
+        if (new_cell) {
+            error_cells++;
+            if (col >= column_error_cells.size()) {
+                column_error_cells.resize(col + 1, 0);
+            }
+            column_error_cells[col]++;
+        }
+
+        entries.push_back({row, static_cast<uint32_t>(col), code, static_cast<uint8_t>(arg_count), arguments.size()});
+        for (size_t k = 0; k < arg_count; ++k) {
+            std::string_view arg = args[k];
+            uint32_t length = static_cast<uint32_t>(arg.size());
+            arguments.append(reinterpret_cast<const char*>(&length), sizeof(length));
+            arguments.append(arg);
+        }
+    }
+
+    // Append the errors of the rows that follow ours
+    void append(ErrorStore&& other) {
+        size_t base = arguments.size();
+        for (Entry entry : other.entries) {
+            entry.arg_offset += base;
+            entries.push_back(entry);
+        }
+        arguments.append(other.arguments);
+        error_cells += other.error_cells;
+        error_rows += other.error_rows;
+        if (column_error_cells.size() < other.column_error_cells.size()) {
+            column_error_cells.resize(other.column_error_cells.size(), 0);
+        }
+        for (size_t i = 0; i < other.column_error_cells.size(); ++i) {
+            column_error_cells[i] += other.column_error_cells[i];
+        }
+    }
+
+    void appendMessage(std::string& out, const Entry& entry) const {
+        const char* text = kErrorInfo[static_cast<size_t>(entry.code)].message;
+        size_t offset = entry.arg_offset;
+        size_t remaining = entry.arg_count;
+        for (; *text; ++text) {
+            if (text[0] == '{' && text[1] == '}' && remaining > 0) {
+                uint32_t length;
+                std::memcpy(&length, arguments.data() + offset, sizeof(length));
+                out.append(arguments, offset + sizeof(length), length);
+                offset += sizeof(length) + length;
+                remaining--;
+                ++text;
+            } else {
+                out.push_back(*text);
+            }
+        }
+    }
+
+    // The arguments recorded with entry, in placeholder order
+    void appendArguments(std::vector<std::string_view>& out, const Entry& entry) const {
+        size_t offset = entry.arg_offset;
+        for (size_t k = 0; k < entry.arg_count; ++k) {
+            uint32_t length;
+            std::memcpy(&length, arguments.data() + offset, sizeof(length));
+            out.emplace_back(arguments.data() + offset + sizeof(length), length);
+            offset += sizeof(length) + length;
+        }
+    }
+
+    std::string message(const Entry& entry) const {
+        std::string out;
+        appendMessage(out, entry);
+        return out;
+    }
+
+    // Messages of one cell joined with "; " in the order they were added;
+    // entries [begin, end) are the errors of a single row
+    void appendCellMessages(std::string& out, size_t begin, size_t end, size_t col) const {
+        bool first = true;
+        for (size_t k = begin; k < end; ++k) {
+            if (entries[k].col != col) continue;
+            if (!first) out += "; ";
+            appendMessage(out, entries[k]);
+            first = false;
+        }
+    }
+
+    void clear() {
+        entries.clear();
+        arguments.clear();
+        error_cells = 0;
+        error_rows = 0;
+        column_error_cells.clear();
+    }
+
+private:
+    std::string arguments;
+};
+
+enum class RowStatus : uint8_t {
+    Valid,
+    Problematic
+};
+
+using Column = std::vector<std::string_view>;
+
+// One row of a column-major table, so row-oriented code can keep indexing
+// cells as row[j]. Assigning to row[j] updates the table.
+class RowView {
+private:
+    std::vector<Column>* columns;
+    size_t row;
+
+public:
+    RowView(std::vector<Column>& table, size_t row_idx) : columns(&table), row(row_idx) {}
+
+    std::string_view& operator[](size_t col) const {
+        return (*columns)[col][row];
+    }
+
+    size_t size() const {
+        return columns->size();
+    }
+};
+
+// Simple CSV-based data structure, stored by column: columns[j][i] is cell j of
+// row i. Cells are views into the mapped input file or, once unescaped or
+// auto-corrected, into the arena.
 struct ExcelData {
     std::vector<std::string> headers;
-    std::vector<std::vector<std::string>> rows;
-    std::vector<std::vector<std::string>> validation_errors;
+    std::vector<Column> columns;
+    std::vector<RowStatus> row_status;
+    ErrorStore errors;
+    MappedFile source;
+    CellArena arena;
+
+    size_t rowCount() const {
+        return row_status.size();
+    }
+
+    RowView row(size_t row_idx) {
+        return RowView(columns, row_idx);
+    }
+
+    // fields must hold one cell per column
+    void appendRow(const std::vector<std::string_view>& fields) {
+        for (size_t j = 0; j < columns.size(); ++j) {
+            columns[j].push_back(fields[j]);
+        }
+        row_status.push_back(RowStatus::Valid);
+    }
+
+    // Drop every row and the text they own; headers and column capacity stay
+    void clearRows() {
+        for (auto& column : columns) {
+            column.clear();
+        }
+        row_status.clear();
+        errors.clear();
+        arena.reset();
+    }
+};
+
+// Verbosity of the process log; each level includes the ones before it.
+// Errors are always written.
+enum class LogLevel {
+    Summary,
+    Warn,
+    Info,
+    Debug
+};
+
+// Timeline of a run for --trace, written as Chrome trace events (open it in
+// chrome://tracing or ui.perfetto.dev). Scopes record one complete event each
+// into a buffer owned by their thread; every thread, or worker slot, is a
+// track. Only stages and row blocks are traced, never single rows. Build with
+// -DDATALOOM_NO_TRACE to compile the scopes out.
+class Tracer {
+public:
+    static constexpr uint32_t kMainTrack = 0;
+    static constexpr uint32_t kLogTrack = 1;
+    static constexpr uint32_t kWorkerTrack = 100;
+#ifdef DATALOOM_NO_TRACE
+    static constexpr bool kEnabled = false;
+#else
+    static constexpr bool kEnabled = true;
+#endif
+
+    // Value-initialized Arg() is "no argument"
+    struct Arg {
+        const char* name;
+        int64_t value;
+    };
+
+    // Events are recorded while a tracer is active; there is one per process
+    static inline std::atomic<Tracer*> active{nullptr};
+
+    static uint64_t now() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    void start() {
+        origin = now();
+        active.store(this, std::memory_order_release);
+        nameThread(kMainTrack, "main");
+    }
+
+    void stop() {
+        active.store(nullptr, std::memory_order_release);
+    }
+
+    // Put the calling thread's events on track, labelled name (plus index)
+    static void nameThread(uint32_t track, const char* name, size_t index = std::string::npos) {
+        Tracer* tracer = active.load(std::memory_order_acquire);
+        if (!tracer) return;
+        thread_track = track;
+        std::string label = name;
+        if (index != std::string::npos) label += " " + std::to_string(index);
+        std::lock_guard<std::mutex> lock(tracer->registry_mutex);
+        tracer->track_names[track] = std::move(label);
+    }
+
+    static void record(const char* category, const char* name, uint64_t start, uint64_t end,
+                       Arg first = Arg(), Arg second = Arg()) {
+        Tracer* tracer = active.load(std::memory_order_acquire);
+        if (!tracer) return;
+        Buffer& buffer = tracer->localBuffer();
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        buffer.events.push_back({category, name, start, end, thread_track, {first, second}});
+    }
+
+    bool write(const std::string& path, std::string& error) {
+        std::string out = "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        bool first = true;
+        auto separate = [&]() {
+            if (!first) out += ",\n";
+            first = false;
+        };
+        std::lock_guard<std::mutex> registry(registry_mutex);
+        for (const auto& [track, label] : track_names) {
+            separate();
+            out += "{\"ph\": \"M\", \"pid\": 1, \"tid\": " + std::to_string(track) + 
+                   ", \"name\": \"thread_name\", \"args\": {\"name\": ";
+            JsonLinesWriter::appendString(out, label);
+            out += "}},\n{\"ph\": \"M\", \"pid\": 1, \"tid\": " + std::to_string(track) + 
+                   ", \"name\": \"thread_sort_index\", \"args\": {\"sort_index\": " + std::to_string(track) + "}}";
+        }
+        for (const auto& buffer : buffers) {
+            std::lock_guard<std::mutex> lock(buffer->mutex);
+            for (const Event& event : buffer->events) {
+                separate();
+                char times[96];
+                std::snprintf(times, sizeof(times), "\"ts\": %.3f, \"dur\": %.3f", 
+                              (event.start - std::min(event.start, origin)) / 1e3, (event.end - event.start) / 1e3);
+                out += "{\"ph\": \"X\", \"pid\": 1, \"tid\": " + std::to_string(event.track) + ", \"cat\": \"";
+                out += event.category;
+                out += "\", \"name\": \"";
+                out += event.name;
+                out += "\", ";
+                out += times;
+                if (event.args[0].name) {
+                    out += ", \"args\": {";
+                    for (size_t a = 0; a < event.args.size() && event.args[a].name; ++a) {
+                        if (a) out += ", ";
+                        out += '"';
+                        out += event.args[a].name;
+                        out += "\": " + std::to_string(event.args[a].value);
+                    }
+                    out += '}';
+                }
+                out += '}';
+            }
+        }
+        out += "\n]}\n";
+
+        std::ofstream file(path, std::ios::binary);
+        file.write(out.data(), static_cast<std::streamsize>(out.size()));
+        file.close();
+        if (!file) {
+            error = "Cannot write trace to " + path;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    struct Event {
+        const char* category;
+        const char* name;
+        uint64_t start;
+        uint64_t end;
+        uint32_t track;
+        std::array<Arg, 2> args;
+    };
+
+    // Only its thread appends; the lock lets write() read while threads still run
+    struct Buffer {
+        std::mutex mutex;
+        std::vector<Event> events;
+    };
+
+    static inline thread_local uint32_t thread_track = kMainTrack;
+    static inline thread_local Buffer* thread_buffer = nullptr;
+    static inline thread_local Tracer* thread_buffer_owner = nullptr;
+
+    uint64_t origin = 0;
+    std::mutex registry_mutex;
+    std::map<uint32_t, std::string> track_names;
+    std::vector<std::unique_ptr<Buffer>> buffers;
+
+    Buffer& localBuffer() {
+        if (thread_buffer_owner != this) {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            buffers.push_back(std::make_unique<Buffer>());
+            thread_buffer = buffers.back().get();
+            thread_buffer_owner = this;
+        }
+        return *thread_buffer;
+    }
+};
+
+// Records the enclosing block as one event; use it through DATALOOM_TRACE_SCOPE
+class TraceScope {
+public:
+    TraceScope(const char* category, const char* name, Tracer::Arg first = Tracer::Arg(), 
+               Tracer::Arg second = Tracer::Arg())
+        : category(category), name(name), first(first), second(second),
+          start(Tracer::active.load(std::memory_order_relaxed) ? Tracer::now() : 0) {}
+
+    ~TraceScope() {
+        if (start) Tracer::record(category, name, start, Tracer::now(), first, second);
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* category;
+    const char* name;
+    Tracer::Arg first;
+    Tracer::Arg second;
+    uint64_t start;
+};
+
+// Joins intervals less than kGapNs apart into one event, for work that comes
+// in many short bursts (log batches)
+class TraceCoalescer {
+public:
+    static constexpr uint64_t kGapNs = 1000000;
+
+    TraceCoalescer(const char* category, const char* name, const char* count_name)
+        : category(category), name(name), count_name(count_name) {}
+
+    ~TraceCoalescer() {
+        flush();
+    }
+
+    void add(uint64_t begin, uint64_t end, size_t count) {
+        if (total > 0 && begin - last_end > kGapNs) flush();
+        if (total == 0) first_begin = begin;
+        last_end = end;
+        total += count;
+        bursts++;
+    }
+
+    void flush() {
+        if (total == 0) return;
+        Tracer::record(category, name, first_begin, last_end, {count_name, static_cast<int64_t>(total)},
+                       {"bursts", static_cast<int64_t>(bursts)});
+        total = 0;
+        bursts = 0;
+    }
+
+private:
+    const char* category;
+    const char* name;
+    const char* count_name;
+    uint64_t first_begin = 0;
+    uint64_t last_end = 0;
+    size_t total = 0;
+    size_t bursts = 0;
+};
+
+#define DATALOOM_TRACE_JOIN2(a, b) a##b
+#define DATALOOM_TRACE_JOIN(a, b) DATALOOM_TRACE_JOIN2(a, b)
+#ifndef DATALOOM_NO_TRACE
+// DATALOOM_TRACE_SCOPE(category, name[, {"arg", value}[, {"arg", value}]])
+#define DATALOOM_TRACE_SCOPE(...) TraceScope DATALOOM_TRACE_JOIN(trace_scope_, __LINE__)(__VA_ARGS__)
+#define DATALOOM_TRACE_THREAD(...) Tracer::nameThread(__VA_ARGS__)
+#else
+#define DATALOOM_TRACE_SCOPE(...) ((void)0)
+#define DATALOOM_TRACE_THREAD(...) ((void)0)
+#endif
+
+// Log manager class to handle both console and file logging. Messages are
+// formatted by the caller into a lock-free ring of fixed-size slots and
+// written to the console and the log file in batches by a background thread.
+// Embedders can have the lines handed to a callback on that thread instead.
+class LogManager {
+private:
+    static constexpr size_t kSlotBytes = 240;
+    static constexpr size_t kSlotCount = 8192;
+    static constexpr size_t kBatchBytes = 1 << 16;
+    // Producers wake the sleeping writer once this many slots are waiting;
+    // otherwise it wakes on its own every kBatchDelay
+    static constexpr size_t kWakeSlots = kSlotCount / 4;
+    static constexpr std::chrono::milliseconds kBatchDelay{10};
+
+    // A line longer than one slot spans consecutive slots. Producers claim a
+    // run of slots with one CAS on enqueue_pos; the writer frees them in order,
+    // so a run is free once its last slot is.
+    struct Slot {
+        std::atomic<size_t> sequence{0};
+        uint32_t length = 0;
+        char bytes[kSlotBytes];
+    };
+
+    // "Row N: " rendered without allocating
+    class RowPrefix {
+    private:
+        char text[32];
+        size_t length;
+
+    public:
+        explicit RowPrefix(size_t row_num) {
+            std::memcpy(text, "Row ", 4);
+            char* end = std::to_chars(text + 4, text + sizeof(text) - 2, row_num + 1).ptr;
+            end[0] = ':';
+            end[1] = ' ';
+            length = end + 2 - text;
+        }
+
+        std::string_view view() const { return std::string_view(text, length); }
+    };
+
+    std::ofstream log_file;
+    std::string log_file_path;
+    std::function<void(std::string_view)> line_sink;
+    LogLevel level = LogLevel::Info;
+    static inline thread_local std::string* capture_buffer = nullptr;
+
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<size_t> enqueue_pos{0};
+    std::atomic<size_t> written_pos{0};
+    std::atomic<size_t> flushed_pos{0};
+    std::atomic<bool> stopping{false};
+    std::atomic<bool> flush_requested{false};
+    std::atomic<bool> writer_idle{false};
+    std::atomic<uint64_t> written_bytes{0};
+    std::atomic<uint64_t> written_batches{0};
+    std::atomic<uint64_t> full_ring_waits{0};
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    std::thread writer;
+    
+public:
+    LogManager() = default;
+
+    ~LogManager() {
+        close();
+    }
+
+    static bool parseLevel(std::string_view name, LogLevel& result) {
+        static const std::pair<std::string_view, LogLevel> kLevels[] = {
+            {"summary", LogLevel::Summary},
+            {"warn", LogLevel::Warn},
+            {"info", LogLevel::Info},
+            {"debug", LogLevel::Debug},
+        };
+        for (const auto& entry : kLevels) {
+            if (entry.first == name) {
+                result = entry.second;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void setLevel(LogLevel value) {
+        level = value;
+    }
+
+    LogLevel getLevel() const {
+        return level;
+    }
+
+    // Lets callers skip building a message nobody will read
+    bool enabled(LogLevel message_level) const {
+        return message_level <= level;
+    }
+
+    // A number rendered without allocating, for messages logged in pieces
+    class Number {
+    private:
+        char text[24];
+        size_t length;
+
+    public:
+        explicit Number(size_t value) {
+            length = std::to_chars(text, text + sizeof(text), value).ptr - text;
+        }
+
+        std::string_view view() const { return std::string_view(text, length); }
+    };
+
+    // Divert the calling thread's messages into a buffer for the lifetime of the
+    // scope. Parallel validation replays the buffers in row order afterwards.
+    class Capture {
+    private:
+        std::string* previous;
+
+    public:
+        explicit Capture(std::string& buffer) : previous(capture_buffer) {
+            capture_buffer = &buffer;
+        }
+
+        ~Capture() {
+            capture_buffer = previous;
+        }
+    };
+
+    // Lines captured by a Capture are already filtered and newline-terminated.
+    // Inside another Capture they are appended to that buffer.
+    void replay(const std::string& buffer) {
+        if (capture_buffer) {
+            capture_buffer->append(buffer);
+            return;
+        }
+        if (!writer.joinable()) {
+            std::cout << buffer;
+            return;
+        }
+        std::string_view rest(buffer);
+        constexpr size_t kMaxRun = kSlotCount / 2 * kSlotBytes;
+        while (!rest.empty()) {
+            size_t take = std::min(rest.size(), kMaxRun);
+            enqueue({rest.substr(0, take)});
+            rest.remove_prefix(take);
+        }
+    }
+    
+    bool initialize(const std::string& filepath) {
+        log_file_path = filepath;
+        log_file.open(filepath);
+        if (!log_file.is_open()) {
+            std::cerr << "ERROR: Cannot create log file " + filepath << std::endl;
+            return false;
+        }
+
+        startWriter();
+        log("Log initialized: " + filepath);
+        return true;
+    }
+
+    // Deliver each line, without its newline, to sink instead of the console
+    // and a file. The sink runs on the writer thread.
+    void initialize(std::function<void(std::string_view)> sink) {
+        line_sink = std::move(sink);
+        startWriter();
+    }
+    
+    void log(std::string_view message) {
+        emit(LogLevel::Info, {message});
+    }
+    
+    void log_auto_correction(size_t row_num, std::string_view action, std::string_view original, std::string_view corrected) {
+        if (!enabled(LogLevel::Info)) return;
+        RowPrefix row(row_num);
+        emit(LogLevel::Info, {row.view(), "AUTO-CORRECTED: ", action, ": '", original, "' -> '", corrected, "'"});
+    }
+    
+    void log_auto_fill(size_t row_num, std::string_view action, std::string_view value) {
+        if (!enabled(LogLevel::Info)) return;
+        RowPrefix row(row_num);
+        emit(LogLevel::Info, {row.view(), "AUTO-FILLED: ", action, " with '", value, "'"});
+    }
+    
+    void log_cleaned(size_t row_num, std::string_view field, std::string_view original, std::string_view cleaned) {
+        if (!enabled(LogLevel::Info)) return;
+        RowPrefix row(row_num);
+        emit(LogLevel::Info, {row.view(), "CLEANED ", field, ": '", original, "' -> '", cleaned, "'"});
+    }
+    
+    void log_error(size_t row_num, std::string_view error) {
+        RowPrefix row(row_num);
+        emit(LogLevel::Summary, {row.view(), "ERROR: ", error});
+    }
+    
+    void log_error(std::string_view error) {
+        emit(LogLevel::Summary, {"ERROR: ", error});
+    }
+    
+    void log_warning(size_t row_num, std::string_view warning) {
+        if (!enabled(LogLevel::Warn)) return;
+        RowPrefix row(row_num);
+        emit(LogLevel::Warn, {row.view(), "WARNING: ", warning});
+    }
+
+    // The warning is given in pieces so that nothing is built when warnings are filtered
+    void log_warning(size_t row_num, std::initializer_list<std::string_view> warning) {
+        if (!enabled(LogLevel::Warn)) return;
+        RowPrefix row(row_num);
+        emit(LogLevel::Warn, {row.view(), "WARNING: "}, warning);
+    }
+    
+    void log_warning(std::string_view warning) {
+        emit(LogLevel::Warn, {"WARNING: ", warning});
+    }
+    
+    void log_info(std::string_view info) {
+        emit(LogLevel::Info, {"INFO: ", info});
+    }
+
+    void log_debug(std::string_view message) {
+        emit(LogLevel::Debug, {"DEBUG: ", message});
+    }
+    
+    void log_summary(std::string_view summary) {
+        emit(LogLevel::Summary, {"SUMMARY: ", summary});
+    }
+
+    // Captured lines of one row with their "Row N: " prefixes removed, so they
+    // can be logged again for the same row at another position. Fails if a
+    // line does not carry the row's prefix.
+    static bool stripRowPrefix(size_t row_num, std::string_view lines, std::string& out) {
+        RowPrefix row(row_num);
+        while (!lines.empty()) {
+            size_t end = lines.find('\n') + 1;
+            std::string_view line = lines.substr(0, end);
+            if (line.substr(0, row.view().size()) != row.view()) return false;
+            out.append(line.substr(row.view().size()));
+            lines.remove_prefix(end);
+        }
+        return true;
+    }
+
+    // Log lines produced by stripRowPrefix under row_num's prefix. They were
+    // filtered when captured, so they are written at any level.
+    void log_row_lines(size_t row_num, std::string_view lines) {
+        RowPrefix row(row_num);
+        while (!lines.empty()) {
+            size_t end = lines.find('\n');
+            emit(LogLevel::Summary, {row.view(), lines.substr(0, end)});
+            lines.remove_prefix(end + 1);
+        }
+    }
+
+    // Output of the writer thread so far, for --stats
+    struct Counters {
+        uint64_t bytes = 0;
+        uint64_t batches = 0;
+        uint64_t full_ring_waits = 0;
+    };
+
+    Counters counters() const {
+        return {written_bytes.load(std::memory_order_relaxed), written_batches.load(std::memory_order_relaxed),
+                full_ring_waits.load(std::memory_order_relaxed)};
+    }
+
+    // Block until everything logged so far has been written and flushed
+    void flush() {
+        if (!writer.joinable()) return;
+        size_t target = enqueue_pos.load(std::memory_order_acquire);
+        while (flushed_pos.load(std::memory_order_acquire) < target) {
+            flush_requested.store(true, std::memory_order_release);
+            wakeWriter();
+            std::this_thread::yield();
+        }
+    }
+    
+    void close() {
+        if (writer.joinable()) {
+            stopping.store(true, std::memory_order_release);
+            wakeWriter();
+            writer.join();
+        }
+        if (log_file.is_open()) {
+            log_file.close();
+        }
+    }
+
+private:
+    // The line is pieces followed by more
+    void emit(LogLevel message_level, std::initializer_list<std::string_view> pieces,
+              std::initializer_list<std::string_view> more = {}) {
+        if (!enabled(message_level)) return;
+
+        if (capture_buffer) {
+            for (auto list : {pieces, more}) {
+                for (std::string_view piece : list) {
+                    capture_buffer->append(piece);
+                }
+            }
+            capture_buffer->push_back('\n');
+            return;
+        }
+
+        if (!writer.joinable()) {
+            // Not initialized: fall back to the console
+            for (auto list : {pieces, more}) {
+                for (std::string_view piece : list) {
+                    std::cout << piece;
+                }
+            }
+            std::cout << '\n';
+            return;
+        }
+
+        enqueue(pieces, more, true);
+    }
+
+    void enqueue(std::initializer_list<std::string_view> pieces, std::initializer_list<std::string_view> more = {},
+                 bool newline = false) {
+        size_t length = newline ? 1 : 0;
+        for (auto list : {pieces, more}) {
+            for (std::string_view piece : list) {
+                length += piece.size();
+            }
+        }
+        size_t count = std::min((length + kSlotBytes - 1) / kSlotBytes, kSlotCount / 2);
+        size_t capacity = count * kSlotBytes;
+
+        // Claim `count` consecutive slots, waiting for the writer if the ring is full
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        bool waited = false;
+        for (;;) {
+            size_t last = pos + count - 1;
+            size_t sequence = slots[last % kSlotCount].sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(sequence - last);
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                if (!waited) full_ring_waits.fetch_add(1, std::memory_order_relaxed);
+                waited = true;
+                wakeWriter();
+                std::this_thread::yield();
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        // Copy the pieces across the claimed slots; a line that does not fit
+        // in half the ring is truncated
+        size_t filled = 0;
+        auto put = [&](std::string_view piece) {
+            piece = piece.substr(0, std::min(piece.size(), capacity - filled));
+            while (!piece.empty()) {
+                Slot& slot = slots[(pos + filled / kSlotBytes) % kSlotCount];
+                size_t offset = filled % kSlotBytes;
+                size_t take = std::min(piece.size(), kSlotBytes - offset);
+                std::memcpy(slot.bytes + offset, piece.data(), take);
+                filled += take;
+                piece.remove_prefix(take);
+            }
+        };
+        for (auto list : {pieces, more}) {
+            for (std::string_view piece : list) {
+                put(piece);
+            }
+        }
+        if (newline) {
+            if (filled == capacity) filled--;
+            put("\n");
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            Slot& slot = slots[(pos + i) % kSlotCount];
+            slot.length = static_cast<uint32_t>(std::min(kSlotBytes, filled - std::min(filled, i * kSlotBytes)));
+            slot.sequence.store(pos + i + 1, std::memory_order_release);
+        }
+
+        // Only a backlog worth a batch wakes the writer early
+        if (pos + count - written_pos.load(std::memory_order_relaxed) >= kWakeSlots &&
+            writer_idle.load(std::memory_order_relaxed) && writer_idle.exchange(false, std::memory_order_relaxed)) {
+            wakeWriter();
+        }
+    }
+
+    void startWriter() {
+        slots.reset(new Slot[kSlotCount]);
+        for (size_t i = 0; i < kSlotCount; ++i) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        stopping.store(false);
+        flush_requested.store(false);
+        writer = std::thread([this] { writerLoop(); });
+    }
+
+    void wakeWriter() {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        wake.notify_one();
+    }
+
+    // Start of a traced write, or 0 when no trace is being recorded (always
+    // in a DATALOOM_NO_TRACE build, where the tracing code folds away)
+    static uint64_t traceClock() {
+        return Tracer::kEnabled && Tracer::active.load(std::memory_order_relaxed) ? Tracer::now() : 0;
+    }
+
+    // Only the writer thread updates these
+    void countBatch(size_t bytes) {
+        written_bytes.store(written_bytes.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+        written_batches.store(written_batches.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    // Append up to kBatchBytes of published slots to batch
+    size_t takeSlots(std::string& batch, size_t& pos) {
+        size_t taken = 0;
+        while (taken < kBatchBytes) {
+            Slot& slot = slots[pos % kSlotCount];
+            if (slot.sequence.load(std::memory_order_acquire) != pos + 1) break;
+            batch.append(slot.bytes, slot.length);
+            taken += slot.length;
+            slot.sequence.store(pos + kSlotCount, std::memory_order_release);
+            ++pos;
+        }
+        return taken;
+    }
+
+    void writeBatch(std::string& batch, TraceCoalescer& trace) {
+        if (line_sink) {
+            // A batch can end inside a long line; its tail waits for the rest
+            size_t complete = batch.rfind('\n') + 1;
+            if (complete == 0) return;
+            countBatch(complete);
+            uint64_t started = traceClock();
+            std::string_view rest(batch.data(), complete);
+            while (!rest.empty()) {
+                size_t end = rest.find('\n');
+                line_sink(rest.substr(0, end));
+                rest.remove_prefix(end + 1);
+            }
+            if (started) trace.add(started, Tracer::now(), complete);
+            batch.erase(0, complete);
+            return;
+        }
+        countBatch(batch.size());
+        uint64_t started = traceClock();
+        std::cout.write(batch.data(), batch.size());
+        log_file.write(batch.data(), batch.size());
+        if (started) trace.add(started, Tracer::now(), batch.size());
+        batch.clear();
+    }
+
+    // Sleeps until kBatchDelay passes, a producer finds kWakeSlots waiting,
+    // or flush() or close() asks; then writes what has gathered in batches of
+    // up to kBatchBytes. The streams are flushed only when asked.
+    void writerLoop() {
+        DATALOOM_TRACE_THREAD(Tracer::kLogTrack, "log writer");
+        TraceCoalescer trace("log", "write log", "bytes");
+        std::string batch;
+        batch.reserve(kBatchBytes + kSlotBytes);
+        size_t pos = 0;
+        for (;;) {
+            bool stop = stopping.load(std::memory_order_acquire);
+            bool flush_streams = flush_requested.exchange(false, std::memory_order_acquire);
+
+            // A short batch means the ring was drained
+            size_t taken;
+            do {
+                taken = takeSlots(batch, pos);
+                if (taken) {
+                    writeBatch(batch, trace);
+                    written_pos.store(pos, std::memory_order_release);
+                }
+            } while (taken >= kBatchBytes);
+
+            if (flush_streams || stop) {
+                if (!line_sink) {
+                    std::cout.flush();
+                    log_file.flush();
+                }
+                flushed_pos.store(pos, std::memory_order_release);
+            }
+            if (stop && enqueue_pos.load(std::memory_order_acquire) == pos) {
+                break;
+            }
+
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            if (flush_requested.load(std::memory_order_relaxed) || stopping.load(std::memory_order_relaxed)) {
+                continue;
+            }
+            writer_idle.store(true, std::memory_order_relaxed);
+            wake.wait_for(lock, kBatchDelay);
+            writer_idle.store(false, std::memory_order_relaxed);
+        }
+    }
+};
+
+// Validator bound to a column. Schema files name these in snake_case (see
+// kValidatorNames); the cross-field rules find their columns by kind.
+enum class FieldKind : uint8_t {
+    None,
+    ControlNumber,
+    CURP,
+    Name,
+    PaternalLastName,
+    MaternalLastName,
+    Integer,
+    Decimal,
+    Gender,
+    CurrentAverage,
+    GeneralAverage,
+    Credits,
+    YesNo,
+    Email,
+    RFC,
+    Phone,
+    Disability,
+    DisabilityType,
+    Reentry
+};
+
+struct ValidatorName {
+    std::string_view name;
+    FieldKind kind;
+};
+
+constexpr ValidatorName kValidatorNames[] = {
+    {"none", FieldKind::None},
+    {"control_number", FieldKind::ControlNumber},
+    {"curp", FieldKind::CURP},
+    {"name", FieldKind::Name},
+    {"paternal_last_name", FieldKind::PaternalLastName},
+    {"maternal_last_name", FieldKind::MaternalLastName},
+    {"integer", FieldKind::Integer},
+    {"decimal", FieldKind::Decimal},
+    {"gender", FieldKind::Gender},
+    {"current_average", FieldKind::CurrentAverage},
+    {"general_average", FieldKind::GeneralAverage},
+    {"credits", FieldKind::Credits},
+    {"yes_no", FieldKind::YesNo},
+    {"email", FieldKind::Email},
+    {"rfc", FieldKind::RFC},
+    {"phone", FieldKind::Phone},
+    {"disability", FieldKind::Disability},
+    {"disability_type", FieldKind::DisabilityType},
+    {"reentry", FieldKind::Reentry},
+};
+
+// ASCII character classes as 256-entry tables, built at compile time. They give
+// the answers std::isalpha and friends give in the "C" locale the validators
+// run in, without a locale lookup per character.
+enum AsciiClassBits : uint8_t {
+    kAsciiUpper = 1,
+    kAsciiLower = 2,
+    kAsciiDigit = 4,
+    kAsciiSpace = 8,
+    kAsciiPrint = 16
+};
+
+constexpr std::array<uint8_t, 256> buildAsciiClasses() {
+    std::array<uint8_t, 256> table{};
+    for (int c = 0; c < 256; ++c) {
+        uint8_t bits = 0;
+        if (c >= 'A' && c <= 'Z') bits |= kAsciiUpper;
+        if (c >= 'a' && c <= 'z') bits |= kAsciiLower;
+        if (c >= '0' && c <= '9') bits |= kAsciiDigit;
+        if (c == ' ' || (c >= '\t' && c <= '\r')) bits |= kAsciiSpace;
+        if (c >= 0x20 && c < 0x7F) bits |= kAsciiPrint;
+        table[c] = bits;
+    }
+    return table;
+}
+
+constexpr std::array<uint8_t, 256> kAsciiClasses = buildAsciiClasses();
+
+constexpr bool asciiIs(char c, uint8_t bits) {
+    return (kAsciiClasses[static_cast<unsigned char>(c)] & bits) != 0;
+}
+
+constexpr bool isAsciiAlpha(char c) { return asciiIs(c, kAsciiUpper | kAsciiLower); }
+constexpr bool isAsciiDigit(char c) { return asciiIs(c, kAsciiDigit); }
+constexpr bool isAsciiAlnum(char c) { return asciiIs(c, kAsciiUpper | kAsciiLower | kAsciiDigit); }
+constexpr bool isAsciiUpper(char c) { return asciiIs(c, kAsciiUpper); }
+constexpr bool isAsciiSpace(char c) { return asciiIs(c, kAsciiSpace); }
+constexpr bool isAsciiPrint(char c) { return asciiIs(c, kAsciiPrint); }
+
+static_assert(isAsciiAlpha('q') && !isAsciiAlpha('\xE9') && isAsciiDigit('7') && !isAsciiAlnum('-'), 
+              "ASCII class table");
+
+// Per-position classes of a fixed-width identifier (CURP, RFC): bit i of each
+// mask describes byte i. Only the first 32 bytes are classified.
+struct IdClasses {
+    uint32_t alpha = 0;
+    uint32_t digit = 0;
+
+    uint32_t alnum() const { return alpha | digit; }
+
+    // True when every byte in [first, last) has one of the classes in mask
+    static bool all(uint32_t mask, int first, int last) {
+        uint32_t want = ((last - first == 32) ? ~uint32_t(0) : ((uint32_t(1) << (last - first)) - 1)) << first;
+        return (mask & want) == want;
+    }
+
+    static IdClasses classify(std::string_view value) {
+        char block[32] = {};
+        if (!value.empty()) std::memcpy(block, value.data(), std::min(value.size(), sizeof(block)));
+        IdClasses classes;
+#if defined(DATALOOM_X86_SIMD) && defined(__SSE2__)
+        // Signed compares: bytes >= 0x80 are negative and fall outside every range
+        const __m128i case_bit = _mm_set1_epi8(0x20);
+        for (int half = 0; half < 2; ++half) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * half));
+            __m128i folded = _mm_or_si128(bytes, case_bit);
+            __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(folded, _mm_set1_epi8('a' - 1)), 
+                                          _mm_cmplt_epi8(folded, _mm_set1_epi8('z' + 1)));
+            __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('0' - 1)), 
+                                          _mm_cmplt_epi8(bytes, _mm_set1_epi8('9' + 1)));
+            classes.alpha |= uint32_t(static_cast<uint16_t>(_mm_movemask_epi8(alpha))) << (16 * half);
+            classes.digit |= uint32_t(static_cast<uint16_t>(_mm_movemask_epi8(digit))) << (16 * half);
+        }
+#else
+        for (int i = 0; i < 32; ++i) {
+            if (isAsciiAlpha(block[i])) classes.alpha |= uint32_t(1) << i;
+            if (isAsciiDigit(block[i])) classes.digit |= uint32_t(1) << i;
+        }
+#endif
+        return classes;
+    }
+
+    // Batch form over a run of a column; out[i - begin] classifies column[i]
+    static void classifyColumn(const std::vector<std::string_view>& column, size_t begin, size_t end, IdClasses* out) {
+        for (size_t i = begin; i < end; ++i) {
+            out[i - begin] = classify(column[i]);
+        }
+    }
+};
+
+// Positional layout of a fixed-width identifier, one character per position
+// with '|' between segments: 'A' a letter, '9' a digit, 'X' a letter or digit,
+// anything else that literal byte. The layout is compiled into per-class
+// position masks, so matching a value is a few mask operations and yields
+// the set of violated segments.
+class IdPattern {
+public:
+    static constexpr int kMaxSegments = 8;
+
+    constexpr explicit IdPattern(const char* layout) {
+        for (const char* p = layout; *p; ++p) {
+            if (*p == '|') {
+                if (++segment_count > kMaxSegments) throw "IdPattern: too many segments";
+                continue;
+            }
+            if (width >= 32) throw "IdPattern: layouts are at most 32 characters";
+            uint32_t bit = uint32_t(1) << width;
+            segments[segment_count - 1] |= bit;
+            switch (*p) {
+                case 'A': alpha |= bit; break;
+                case '9': digit |= bit; break;
+                case 'X': alnum |= bit; break;
+                default: literal |= bit; literals[width] = *p; break;
+            }
+            width++;
+        }
+    }
+
+    constexpr int size() const { return width; }
+    constexpr int segmentCount() const { return segment_count; }
+
+    // Bit s is set when segment s has a byte outside its class; value must be size() bytes
+    uint32_t violations(std::string_view value, const IdClasses& classes) const {
+        uint32_t bad = (alpha & ~classes.alpha) | (digit & ~classes.digit) | (alnum & ~classes.alnum());
+        for (uint32_t rest = literal; rest; rest &= rest - 1) {
+            int i = __builtin_ctz(rest);
+            if (value[i] != literals[i]) bad |= uint32_t(1) << i;
+        }
+        uint32_t violated = 0;
+        for (int s = 0; s < segment_count; ++s) {
+            violated |= uint32_t((bad & segments[s]) != 0) << s;
+        }
+        return violated;
+    }
+
+private:
+    int width = 0;
+    int segment_count = 1;
+    uint32_t alpha = 0;
+    uint32_t digit = 0;
+    uint32_t alnum = 0;
+    uint32_t literal = 0;
+    uint32_t segments[kMaxSegments] = {};
+    char literals[32] = {};
+};
+
+// How one segment of an identifier is reported when it does not match
+struct SegmentCheck {
+    ErrorCode code;
+    const char* warning;
+};
+
+// An identifier layout and the error for each of its segments
+struct IdFormat {
+    IdPattern pattern;
+    const SegmentCheck* checks;
+};
+
+constexpr SegmentCheck kCurpChecks[] = {
+    {ErrorCode::CurpLetters, "CURP first 4 chars should be letters"},
+    {ErrorCode::CurpBirthDate, "CURP date should be digits"},
+    {ErrorCode::CurpGender, "CURP gender should be letter"},
+    {ErrorCode::CurpState, "CURP state should be letter"},
+    {ErrorCode::CurpAlphanumeric, "CURP characters 13-16 invalid"},
+    {ErrorCode::CurpCheckDigits, "CURP last 2 chars should be digits"},
+};
+
+constexpr SegmentCheck kRfcFisicaChecks[] = {
+    {ErrorCode::RfcFisicaLetters, "RFC first 4 chars not letters"},
+    {ErrorCode::RfcFisicaDate, "RFC date not digits"},
+    {ErrorCode::RfcFisicaHomoclave, "RFC homoclave invalid"},
+};
+
+constexpr SegmentCheck kRfcMoralChecks[] = {
+    {ErrorCode::RfcMoralDash, "RFC should start with '-'"},
+    {ErrorCode::RfcMoralLetters, "RFC characters 2-4 not letters"},
+    {ErrorCode::RfcMoralDate, "RFC date not digits"},
+    {ErrorCode::RfcMoralHomoclave, "RFC homoclave invalid"},
+};
+
+// Check digits stay "XX" (alphanumeric) as the CURP validator has always accepted
+constexpr IdFormat kCurpFormat{IdPattern("AAAA|999999|A|A|XXXX|XX"), kCurpChecks};
+constexpr IdFormat kRfcFisicaFormat{IdPattern("AAAA|999999|XXX"), kRfcFisicaChecks};
+constexpr IdFormat kRfcMoralFormat{IdPattern("-|AAA|999999|XX"), kRfcMoralChecks};
+
+static_assert(kCurpFormat.pattern.size() == 18 && kCurpFormat.pattern.segmentCount() == std::size(kCurpChecks), "CURP layout");
+static_assert(kRfcFisicaFormat.pattern.size() == 13 && kRfcFisicaFormat.pattern.segmentCount() == std::size(kRfcFisicaChecks), 
+              "RFC persona fisica layout");
+static_assert(kRfcMoralFormat.pattern.size() == 12 && kRfcMoralFormat.pattern.segmentCount() == std::size(kRfcMoralChecks), 
+              "RFC persona moral layout");
+
+// Reads a two-character date field the way std::stoi would: optional leading
+// whitespace, an optional sign, then at least one digit. Returns false where
+// std::stoi would throw.
+inline bool parseDatePart(char first, char second, int& value) {
+    if (isAsciiDigit(first)) {
+        value = isAsciiDigit(second) ? (first - '0') * 10 + (second - '0') : first - '0';
+        return true;
+    }
+    if ((first == '+' || first == '-' || isAsciiSpace(first)) && isAsciiDigit(second)) {
+        value = first == '-' ? -(second - '0') : second - '0';
+        return true;
+    }
+    return false;
+}
+
+using CharClass = std::array<bool, 256>;
+
+// Build a character class from a spec such as "alpha space .-'": the named
+// classes alpha, digit, alnum, upper, lower and space ("C" locale), plus any
+// other characters taken literally. Returns false on an empty spec.
+inline bool parseCharClass(const std::string& spec, CharClass& chars) {
+    chars.fill(false);
+    std::istringstream tokens(spec);
+    std::string token;
+    bool any = false;
+    while (tokens >> token) {
+        any = true;
+        for (int c = 0; c < 256; ++c) {
+            bool in_class = (token == "alpha" && std::isalpha(c)) ||
+                            (token == "digit" && std::isdigit(c)) ||
+                            (token == "alnum" && std::isalnum(c)) ||
+                            (token == "upper" && std::isupper(c)) ||
+                            (token == "lower" && std::islower(c)) ||
+                            (token == "space" && std::isspace(c));
+            if (in_class) chars[c] = true;
+        }
+        if (token != "alpha" && token != "digit" && token != "alnum" && 
+            token != "upper" && token != "lower" && token != "space") {
+            for (unsigned char c : token) chars[c] = true;
+        }
+    }
+    return any;
+}
+
+// Parameters of one column's validator. Defaults reproduce the built-in ITE
+// rules; a schema file can override any of them per column code.
+struct FieldRule {
+    FieldKind kind = FieldKind::None;
+    std::string label;
+    double min = 0;
+    double max = 0;
+    size_t min_length = 0;
+    size_t max_length = 0;
+    std::string default_value;
+    std::string prefix;
+    std::string suffix;
+    CharClass chars{};
+
+    static FieldRule defaults(FieldKind kind, const std::string& label) {
+        FieldRule rule;
+        rule.kind = kind;
+        rule.label = label;
+        switch (kind) {
+            case FieldKind::ControlNumber:
+                rule.min_length = 8;
+                rule.max_length = 12;
+                break;
+            case FieldKind::Name:
+            case FieldKind::PaternalLastName:
+            case FieldKind::MaternalLastName:
+                rule.min_length = 2;
+                parseCharClass("alpha space .-'", rule.chars);
+                break;
+            case FieldKind::Integer:
+                rule.min = 1;
+                rule.max = 100;
+                break;
+            case FieldKind::Decimal:
+            case FieldKind::CurrentAverage:
+            case FieldKind::GeneralAverage:
+                rule.min = 0;
+                rule.max = 100;
+                break;
+            case FieldKind::Credits:
+                rule.min = 0;
+                break;
+            case FieldKind::Gender:
+                rule.default_value = "H";
+                break;
+            case FieldKind::YesNo:
+            case FieldKind::Disability:
+            case FieldKind::Reentry:
+                rule.default_value = "N";
+                break;
+            case FieldKind::Email:
+                rule.prefix = "al";
+                rule.suffix = "@ite.edu.mx";
+                break;
+            case FieldKind::RFC:
+                rule.default_value = "XAXX010101000";
+                break;
+            case FieldKind::Phone:
+                rule.min_length = rule.max_length = 10;
+                rule.default_value = "1234567890";
+                break;
+            case FieldKind::DisabilityType:
+                parseCharClass("alpha space -.", rule.chars);
+                break;
+            default:
+                break;
+        }
+        return rule;
+    }
+};
+
+struct HeaderCode {
+    std::string_view name;
+    FieldKind kind;
+    const char* label;
+};
+
+// Built-in schema: the ITE header codes
+constexpr HeaderCode kHeaderCodes[] = {
+    {"ctr", FieldKind::ControlNumber, "Control number"},
+    {"cur", FieldKind::CURP, "CURP"},
+    {"nom", FieldKind::Name, "Name"},
+    {"app", FieldKind::PaternalLastName, "Paternal Last Name"},
+    {"apm", FieldKind::MaternalLastName, "Maternal Last Name"},
+    {"sem", FieldKind::Integer, "Semester"},
+    {"sex", FieldKind::Gender, "Gender"},
+    {"psa1", FieldKind::CurrentAverage, "Current Average"},
+    {"pge", FieldKind::GeneralAverage, "General Average"},
+    {"cac", FieldKind::Credits, "Credits"},
+    {"res", FieldKind::YesNo, "Professional Residences"},
+    {"ema", FieldKind::Email, "Email"},
+    {"rfc", FieldKind::RFC, "RFC"},
+    {"cel", FieldKind::Phone, "Phone"},
+    {"dis", FieldKind::Disability, "Disability"},
+    {"tipo_discapacidad", FieldKind::DisabilityType, "Disability type"},
+    {"lengua_indigena", FieldKind::YesNo, "Indigenous Language"},
+    {"reingreso", FieldKind::Reentry, "Re-entry"},
+    {"movilidad", FieldKind::None, "Mobility"},
+};
+
+// Perfect hash of the header codes into 32 slots: the top 5 bits of a seeded
+// FNV-1a. buildHeaderTable fails to compile if a new code collides; pick
+// another seed when that happens.
+constexpr uint32_t kHeaderHashSeed = 110;
+
+constexpr size_t headerSlot(std::string_view name) {
+    uint32_t hash = kHeaderHashSeed;
+    for (char c : name) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 16777619u;
+    }
+    return hash >> 27;
+}
+
+constexpr std::array<int8_t, 32> buildHeaderTable() {
+    std::array<int8_t, 32> table{};
+    for (auto& slot : table) slot = -1;
+    for (size_t i = 0; i < std::size(kHeaderCodes); ++i) {
+        size_t slot = headerSlot(kHeaderCodes[i].name);
+        if (table[slot] != -1) throw "header codes collide in kHeaderTable";
+        table[slot] = static_cast<int8_t>(i);
+    }
+    return table;
+}
+
+constexpr std::array<int8_t, 32> kHeaderTable = buildHeaderTable();
+
+// Index of a built-in header code in kHeaderCodes, or -1
+constexpr int headerCodeIndex(std::string_view header) {
+    int8_t index = kHeaderTable[headerSlot(header)];
+    if (index >= 0 && kHeaderCodes[index].name == header) {
+        return index;
+    }
+    return -1;
+}
+
+static_assert(kHeaderCodes[headerCodeIndex("reingreso")].kind == FieldKind::Reentry, "header table lookup");
+static_assert(headerCodeIndex("carrera") == -1, "unknown headers are unbound");
+
+// Binding of column codes to validator rules: the built-in ITE schema or one
+// loaded from an INI file with a [code] section per column, e.g.
+//
+//   [sem]
+//   validator = integer
+//   label = Semester
+//   min = 1
+//   max = 100
+//
+// Lookups happen once per header row, never per cell.
+class ValidationSchema {
+private:
+    std::vector<FieldRule> rules;
+    std::map<std::string, size_t, std::less<>> index;
+    bool built_in = false;
+    std::string source = "built-in";
+    uint64_t content_digest = 0;
+
+public:
+    static ValidationSchema builtIn() {
+        ValidationSchema schema;
+        for (const auto& code : kHeaderCodes) {
+            schema.rules.push_back(FieldRule::defaults(code.kind, code.label));
+        }
+        schema.built_in = true;
+        return schema;
+    }
+
+    // Returns nullptr for codes the schema does not know
+    const FieldRule* find(std::string_view code) const {
+        if (built_in) {
+            int i = headerCodeIndex(code);
+            return i >= 0 ? &rules[i] : nullptr;
+        }
+        auto it = index.find(code);
+        return it != index.end() ? &rules[it->second] : nullptr;
+    }
+
+    size_t size() const {
+        return rules.size();
+    }
+
+    const std::string& name() const {
+        return source;
+    }
+
+    // Hash of the significant lines of the schema file; 0 for the built-in rules
+    uint64_t digest() const {
+        return content_digest;
+    }
+
+    bool loadFile(const std::string& path, std::string& error) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            error = "Cannot open schema file " + path;
+            return false;
+        }
+
+        rules.clear();
+        index.clear();
+        built_in = false;
+        source = path;
+        content_digest = 0;
+
+        // Keys are collected per section and applied once "validator" is known
+        std::vector<std::pair<std::string, std::map<std::string, std::string>>> sections;
+        std::vector<int> section_lines;
+        std::string line;
+        int line_number = 0;
+        while (std::getline(file, line)) {
+            line_number++;
+            size_t start = line.find_first_not_of(" \t\r");
+            if (start == std::string::npos || line[start] == ';' || line[start] == '#') continue;
+            size_t end = line.find_last_not_of(" \t\r");
+            line = line.substr(start, end - start + 1);
+            content_digest = hashBytes(line, content_digest);
+
+            if (line.front() == '[') {
+                if (line.back() != ']' || line.size() < 3) {
+                    error = path + ":" + std::to_string(line_number) + ": malformed section header";
+                    return false;
+                }
+                sections.emplace_back(line.substr(1, line.size() - 2), std::map<std::string, std::string>());
+                section_lines.push_back(line_number);
+                continue;
+            }
+
+            size_t eq = line.find('=');
+            if (eq == std::string::npos || sections.empty()) {
+                error = path + ":" + std::to_string(line_number) + ": expected 'key = value' inside a [code] section";
+                return false;
+            }
+            std::string key = line.substr(0, eq);
+            std::string value = eq + 1 < line.size() ? line.substr(eq + 1) : "";
+            key.erase(key.find_last_not_of(" \t") + 1);
+            value.erase(0, value.find_first_not_of(" \t"));
+            sections.back().second[key] = value;
+        }
+
+        for (size_t s = 0; s < sections.size(); ++s) {
+            const auto& [code, keys] = sections[s];
+            std::string where = path + ": [" + code + "] (line " + std::to_string(section_lines[s]) + ")";
+            if (index.count(code)) {
+                error = where + ": duplicate column code";
+                return false;
+            }
+
+            auto validator = keys.find("validator");
+            if (validator == keys.end()) {
+                error = where + ": missing 'validator'";
+                return false;
+            }
+            const ValidatorName* kind = nullptr;
+            for (const auto& candidate : kValidatorNames) {
+                if (candidate.name == validator->second) kind = &candidate;
+            }
+            if (!kind) {
+                error = where + ": unknown validator '" + validator->second + "'";
+                return false;
+            }
+
+            auto label = keys.find("label");
+            FieldRule rule = FieldRule::defaults(kind->kind, label != keys.end() ? label->second : code);
+            for (const auto& [key, value] : keys) {
+                try {
+                    if (key == "validator" || key == "label") {
+                        continue;
+                    } else if (key == "min") {
+                        rule.min = std::stod(value);
+                    } else if (key == "max") {
+                        rule.max = std::stod(value);
+                    } else if (key == "min_length") {
+                        rule.min_length = std::stoul(value);
+                    } else if (key == "max_length") {
+                        rule.max_length = std::stoul(value);
+                    } else if (key == "length") {
+                        rule.min_length = rule.max_length = std::stoul(value);
+                    } else if (key == "default") {
+                        rule.default_value = value;
+                    } else if (key == "prefix") {
+                        rule.prefix = value;
+                    } else if (key == "suffix") {
+                        rule.suffix = value;
+                    } else if (key == "chars") {
+                        if (!parseCharClass(value, rule.chars)) {
+                            error = where + ": empty 'chars'";
+                            return false;
+                        }
+                    } else {
+                        error = where + ": unknown key '" + key + "'";
+                        return false;
+                    }
+                } catch (...) {
+                    error = where + ": invalid number for '" + key + "': " + value;
+                    return false;
+                }
+            }
+
+            index[code] = rules.size();
+            rules.push_back(rule);
+        }
+        return true;
+    }
+};
+
+// Column bindings resolved once per header row, so the per-row loop does no
+// header work. -1 means the column is not present.
+struct ValidationPlan {
+    std::vector<FieldKind> columns;
+    std::vector<const FieldRule*> rules;
+    int control_number = -1;
+    int disability = -1;
+    int curp = -1;
+    int name = -1;
+    int paternal = -1;
+    int maternal = -1;
+    int credits = -1;
+    int reentry = -1;
+    int current_average = -1;
+    int general_average = -1;
+};
+
+// 128-bit packed key; CURPs pack into one of these instead of a heap string.
+struct PackedKey128 {
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+    bool operator==(const PackedKey128& other) const { return lo == other.lo && hi == other.hi; }
+    bool operator<(const PackedKey128& other) const { return hi != other.hi ? hi < other.hi : lo < other.lo; }
+};
+
+inline uint64_t hashKey(uint64_t key) { return mixKey(key); }
+inline uint64_t hashKey(const PackedKey128& key) { return mixKey(key.lo ^ mixKey(key.hi)); }
+
+// Flat open-addressing set of packed keys. A control byte per slot holds 7
+// bits of the hash (or kEmpty), and lookups compare a 16-byte group of control
+// bytes at once before touching any key. Nothing is ever erased, so probing
+// stops at the first group with a free slot.
+template <typename Key>
+class FlatKeySet {
+public:
+    static constexpr size_t kGroup = 16;
+    static constexpr uint8_t kEmpty = 0x80;
+
+    // Returns true if the key was already present
+    bool checkAndInsert(const Key& key, uint64_t hash) {
+        if ((count + 1) * 8 > slots.size() * 7) {
+            grow();
+        }
+        uint8_t tag = static_cast<uint8_t>((hash >> 50) & 0x7F);
+        size_t group_mask = slots.size() / kGroup - 1;
+        for (size_t group = hash & group_mask;; group = (group + 1) & group_mask) {
+            const uint8_t* ctrl = control.data() + group * kGroup;
+            const Key* keys = slots.data() + group * kGroup;
+            for (uint32_t hits = matchByte(ctrl, tag); hits != 0; hits &= hits - 1) {
+                if (keys[__builtin_ctz(hits)] == key) return true;
+            }
+            uint32_t free_slots = matchByte(ctrl, kEmpty);
+            if (free_slots != 0) {
+                size_t slot = group * kGroup + __builtin_ctz(free_slots);
+                control[slot] = tag;
+                slots[slot] = key;
+                ++count;
+                return false;
+            }
+        }
+    }
+
+    size_t size() const { return count; }
+    size_t capacity() const { return slots.size(); }
+
+    void clear() {
+        control.clear();
+        slots.clear();
+        count = 0;
+    }
+
+private:
+    std::vector<uint8_t> control;
+    std::vector<Key> slots;
+    size_t count = 0;
+
+    static uint32_t matchByte(const uint8_t* ctrl, uint8_t value) {
+#if defined(DATALOOM_X86_SIMD) && defined(__SSE2__)
+        __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(static_cast<char>(value)))));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < kGroup; ++i) {
+            if (ctrl[i] == value) mask |= 1u << i;
+        }
+        return mask;
+#endif
+    }
+
+    void grow() {
+        std::vector<uint8_t> old_control = std::move(control);
+        std::vector<Key> old_slots = std::move(slots);
+        size_t capacity = old_slots.empty() ? kGroup * 4 : old_slots.size() * 2;
+        control.assign(capacity, kEmpty);
+        slots.assign(capacity, Key{});
+        count = 0;
+        for (size_t i = 0; i < old_slots.size(); ++i) {
+            if (old_control[i] != kEmpty) {
+                checkAndInsert(old_slots[i], hashKey(old_slots[i]));
+            }
+        }
+    }
+};
+
+// How a ShardedKeySet packs its keys. Packing is injective on the values it
+// accepts, so two packed keys are equal exactly when the strings are.
+enum class KeyPacking {
+    Alphanumeric,  // Up to 21 characters of [0-9A-Z], 6 bits each (CURP)
+    Digits         // Up to 16 decimal digits, 4 bits each (control number)
+};
+
+// Hash-partitioned key set used for duplicate detection. Each shard is only
+// touched by one worker at a time, so shards need no locking. Well-formed keys
+// live in flat packed tables; anything that does not pack (lowercase, stray
+// punctuation, too long) falls back to a string set in the same shard.
+class ShardedKeySet {
+public:
+    static constexpr size_t kShards = 64;
+
+    explicit ShardedKeySet(KeyPacking packing) : packing(packing) {}
+
+    KeyPacking keyPacking() const { return packing; }
+
+    size_t shardOf(std::string_view key) const {
+        return hashOf(key) >> 58;
+    }
+
+    // Returns true if the key was already present
+    bool checkAndInsert(size_t shard, std::string_view key) {
+        Shard& target = shards[shard];
+        if (packing == KeyPacking::Alphanumeric) {
+            PackedKey128 packed;
+            if (packAlphanumeric(key, packed)) {
+                return target.wide.checkAndInsert(packed, hashKey(packed));
+            }
+        } else {
+            uint64_t packed;
+            if (packDigits(key, packed)) {
+                return target.narrow.checkAndInsert(packed, hashKey(packed));
+            }
+        }
+        return !target.fallback.emplace(key).second;
+    }
+
+    size_t size() const {
+        size_t total = 0;
+        for (const auto& shard : shards) {
+            total += shard.wide.size() + shard.narrow.size() + shard.fallback.size();
+        }
+        return total;
+    }
+
+    // Fill of the packed tables, for --stats
+    struct Occupancy {
+        size_t keys = 0;
+        size_t slots = 0;
+        size_t fallback_keys = 0;
+        double max_shard_load = 0;
+    };
+
+    Occupancy occupancy() const {
+        Occupancy result;
+        for (const auto& shard : shards) {
+            size_t keys = shard.wide.size() + shard.narrow.size();
+            size_t slots = shard.wide.capacity() + shard.narrow.capacity();
+            result.keys += keys;
+            result.slots += slots;
+            result.fallback_keys += shard.fallback.size();
+            if (slots > 0) result.max_shard_load = std::max(result.max_shard_load, static_cast<double>(keys) / slots);
+        }
+        return result;
+    }
+
+    void clear() {
+        for (auto& shard : shards) {
+            shard.wide.clear();
+            shard.narrow.clear();
+            shard.fallback.clear();
+        }
+    }
+
+    // Character codes start at 1 so a shorter key never packs like a longer one
+    static bool packAlphanumeric(std::string_view key, PackedKey128& out) {
+        if (key.size() > 21) return false;
+        out = PackedKey128{};
+        for (size_t i = 0; i < key.size(); ++i) {
+            char c = key[i];
+            uint64_t code;
+            if (c >= '0' && c <= '9') code = static_cast<uint64_t>(c - '0') + 1;
+            else if (c >= 'A' && c <= 'Z') code = static_cast<uint64_t>(c - 'A') + 11;
+            else return false;
+            size_t bit = i * 6;
+            if (bit < 60) out.lo |= code << bit;
+            else out.hi |= code << (bit - 60);
+        }
+        return true;
+    }
+
+    static bool packDigits(std::string_view key, uint64_t& out) {
+        if (key.size() > 16) return false;
+        out = 0;
+        for (size_t i = 0; i < key.size(); ++i) {
+            char c = key[i];
+            if (c < '0' || c > '9') return false;
+            out |= static_cast<uint64_t>(c - '0' + 1) << (i * 4);
+        }
+        return true;
+    }
+
+private:
+    struct Shard {
+        FlatKeySet<PackedKey128> wide;
+        FlatKeySet<uint64_t> narrow;
+        std::unordered_set<std::string> fallback;
+    };
+
+    KeyPacking packing;
+    std::array<Shard, kShards> shards;
+
+    uint64_t hashOf(std::string_view key) const {
+        if (packing == KeyPacking::Alphanumeric) {
+            PackedKey128 packed;
+            if (packAlphanumeric(key, packed)) return hashKey(packed);
+        } else {
+            uint64_t packed;
+            if (packDigits(key, packed)) return hashKey(packed);
+        }
+        return mixKey(std::hash<std::string_view>{}(key));
+    }
+};
+
+// Keys accepted by earlier runs (--history), so weekly batches are checked
+// against every prior batch without reloading old CSVs. The index file holds
+// sorted packed CURPs, sorted packed control numbers and the few keys that do
+// not pack, in native byte order:
+//
+//   "DLHIST1\n" | u64 curps | u64 control numbers | u64 other bytes
+//   PackedKey128[curps] | uint64_t[control numbers]
+//   other: { u8 packing, u32 length, bytes }...
+//
+// The packed arrays are searched in place in the mapping. Keys recorded during
+// a run are merged in by commit(), which writes a new file next to the old one
+// and renames it over, so a failed or interrupted run leaves the index intact.
+class HistoryIndex {
+public:
+    // A missing file is an empty index that commit() will create
+    bool open(const std::string& index_path, std::string& error) {
+        path = index_path;
+        file.close();
+        wide = nullptr;
+        narrow = nullptr;
+        wide_count = narrow_count = 0;
+        other.clear();
+        pending_wide.clear();
+        pending_narrow.clear();
+        pending_other.clear();
+
+        std::ifstream probe(path, std::ios::binary);
+        if (!probe.is_open()) return true;
+        probe.close();
+
+        if (!file.open(path)) {
+            error = "Cannot open history index " + path;
+            return false;
+        }
+        std::string_view bytes = file.view();
+        uint64_t header[3];
+        if (bytes.size() < kHeaderSize || bytes.compare(0, sizeof(kMagic) - 1, kMagic) != 0) {
+            error = path + " is not a duplicate history index";
+            return false;
+        }
+        std::memcpy(header, bytes.data() + 8, sizeof(header));
+        wide_count = header[0];
+        narrow_count = header[1];
+        uint64_t other_bytes = header[2];
+        if (bytes.size() != kHeaderSize + wide_count * sizeof(PackedKey128) + narrow_count * sizeof(uint64_t) + other_bytes) {
+            error = "History index " + path + " is truncated or corrupt";
+            return false;
+        }
+
+        const char* cursor = bytes.data() + kHeaderSize;
+        wide = reinterpret_cast<const PackedKey128*>(cursor);
+        cursor += wide_count * sizeof(PackedKey128);
+        narrow = reinterpret_cast<const uint64_t*>(cursor);
+        cursor += narrow_count * sizeof(uint64_t);
+        const char* end = bytes.data() + bytes.size();
+        while (cursor < end) {
+            uint32_t length;
+            if (end - cursor < 5) break;
+            std::memcpy(&length, cursor + 1, sizeof(length));
+            if (static_cast<size_t>(end - cursor - 5) < length) break;
+            other.emplace_back(static_cast<KeyPacking>(*cursor), std::string(cursor + 5, length));
+            cursor += 5 + length;
+        }
+        if (cursor != end) {
+            error = "History index " + path + " is truncated or corrupt";
+            return false;
+        }
+        std::sort(other.begin(), other.end());
+        return true;
+    }
+
+    size_t size() const {
+        return wide_count + narrow_count + other.size();
+    }
+
+    // Safe to call from several threads; the index is read-only during validation
+    bool contains(KeyPacking packing, std::string_view key) const {
+        if (packing == KeyPacking::Alphanumeric) {
+            PackedKey128 packed;
+            if (ShardedKeySet::packAlphanumeric(key, packed)) {
+                return std::binary_search(wide, wide + wide_count, packed);
+            }
+        } else {
+            uint64_t packed;
+            if (ShardedKeySet::packDigits(key, packed)) {
+                return std::binary_search(narrow, narrow + narrow_count, packed);
+            }
+        }
+        auto it = std::lower_bound(other.begin(), other.end(), std::make_pair(packing, key),
+            [](const OtherKey& lhs, const std::pair<KeyPacking, std::string_view>& rhs) {
+                return lhs.first != rhs.first ? lhs.first < rhs.first : std::string_view(lhs.second) < rhs.second;
+            });
+        return it != other.end() && it->first == packing && it->second == key;
+    }
+
+    // Queue an accepted key for the next commit()
+    void record(KeyPacking packing, std::string_view key) {
+        if (packing == KeyPacking::Alphanumeric) {
+            PackedKey128 packed;
+            if (ShardedKeySet::packAlphanumeric(key, packed)) {
+                pending_wide.push_back(packed);
+                return;
+            }
+        } else {
+            uint64_t packed;
+            if (ShardedKeySet::packDigits(key, packed)) {
+                pending_narrow.push_back(packed);
+                return;
+            }
+        }
+        pending_other.emplace_back(packing, std::string(key));
+    }
+
+    // Merge the recorded keys into the index file. Returns the number of keys
+    // that were new, or -1 with error set.
+    long long commit(std::string& error) {
+        std::vector<PackedKey128> merged_wide = mergeSorted(wide, wide_count, pending_wide);
+        std::vector<uint64_t> merged_narrow = mergeSorted(narrow, narrow_count, pending_narrow);
+        std::vector<OtherKey> merged_other = mergeSorted(other.data(), other.size(), pending_other);
+        long long added = static_cast<long long>(merged_wide.size() + merged_narrow.size() + merged_other.size() - size());
+
+        std::string temp_path = path + ".tmp";
+        {
+            std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+            if (!out.is_open()) {
+                error = "Cannot create file " + temp_path;
+                return -1;
+            }
+            uint64_t other_bytes = 0;
+            for (const auto& key : merged_other) other_bytes += 5 + key.second.size();
+            uint64_t header[3] = {merged_wide.size(), merged_narrow.size(), other_bytes};
+            out.write(kMagic, sizeof(kMagic) - 1);
+            out.write(reinterpret_cast<const char*>(header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(merged_wide.data()), merged_wide.size() * sizeof(PackedKey128));
+            out.write(reinterpret_cast<const char*>(merged_narrow.data()), merged_narrow.size() * sizeof(uint64_t));
+            for (const auto& key : merged_other) {
+                char packing = static_cast<char>(key.first);
+                uint32_t length = static_cast<uint32_t>(key.second.size());
+                out.write(&packing, 1);
+                out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+                out.write(key.second.data(), key.second.size());
+            }
+            out.flush();
+            if (!out.good()) {
+                error = "Failed to write " + temp_path;
+                std::remove(temp_path.c_str());
+                return -1;
+            }
+        }
+
+#ifndef _WIN32
+        int fd = ::open(temp_path.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            fsync(fd);
+            ::close(fd);
+        }
+#else
+        file.close();
+        std::remove(path.c_str());
+#endif
+        if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+            error = "Cannot replace history index " + path;
+            std::remove(temp_path.c_str());
+            return -1;
+        }
+        return open(path, error) ? added : -1;
+    }
+
+private:
+    using OtherKey = std::pair<KeyPacking, std::string>;
+
+    static constexpr char kMagic[] = "DLHIST1\n";
+    static constexpr size_t kHeaderSize = 8 + 3 * sizeof(uint64_t);
+
+    std::string path;
+    MappedFile file;
+    const PackedKey128* wide = nullptr;
+    const uint64_t* narrow = nullptr;
+    size_t wide_count = 0;
+    size_t narrow_count = 0;
+    std::vector<OtherKey> other;
+    std::vector<PackedKey128> pending_wide;
+    std::vector<uint64_t> pending_narrow;
+    std::vector<OtherKey> pending_other;
+
+    template <typename Key>
+    static std::vector<Key> mergeSorted(const Key* existing, size_t count, std::vector<Key>& pending) {
+        std::sort(pending.begin(), pending.end());
+        pending.erase(std::unique(pending.begin(), pending.end()), pending.end());
+        std::vector<Key> merged;
+        merged.reserve(count + pending.size());
+        std::set_union(existing, existing + count, pending.begin(), pending.end(), std::back_inserter(merged));
+        return merged;
+    }
+};
+
+// Validation results of earlier runs (--cache), keyed by a hash of each row's
+// cells and duplicate flags. A row whose key is found is not revalidated: its
+// status, corrected cells, errors and log lines are replayed from the record.
+// Each run writes the records of all its rows to a new file that replaces the
+// old one once the run succeeds, so rows that left the input age out.
+//
+//   "DLCACHE1" | u64 context | u64 records | record...
+//   record:  u64 key | u32 payload bytes | payload
+//   payload: u8 status
+//            n cells  { col, length, bytes }...
+//            n errors { col, u8 code, u8 args, { length, bytes }... }...
+//            length, log lines without their "Row N: " prefix
+//
+// Counts, columns and lengths in the payload are LEB128 varints.
+//
+// The context hashes everything else a result depends on (headers, schema,
+// log level, this format), and records from another context are ignored.
+class RowCache {
+public:
+    static constexpr uint64_t kVersion = 1;
+
+    // One record; when parsed, the strings point into the mapped cache file
+    struct CachedRow {
+        struct Error {
+            uint32_t col;
+            ErrorCode code;
+            uint8_t arg_count;
+            size_t arg_begin;
+        };
+
+        RowStatus status = RowStatus::Valid;
+        std::vector<std::pair<uint32_t, std::string_view>> cells;
+        std::vector<Error> errors;
+        std::vector<std::string_view> args;
+        std::string_view log;
+
+        void clear() {
+            status = RowStatus::Valid;
+            cells.clear();
+            errors.clear();
+            args.clear();
+            log = std::string_view();
+        }
+    };
+
+    RowCache() = default;
+    RowCache(const RowCache&) = delete;
+    RowCache& operator=(const RowCache&) = delete;
+
+    ~RowCache() {
+        if (out.is_open()) {
+            out.close();
+            std::remove(temp_path.c_str());
+        }
+    }
+
+    // A missing file is an empty cache. On a damaged file the cache starts
+    // empty and error says why; it can still be written.
+    bool open(const std::string& cache_path, std::string& error) {
+        path = cache_path;
+        temp_path = path + ".tmp";
+        index.clear();
+        file.close();
+
+        std::ifstream probe(path, std::ios::binary);
+        if (!probe.is_open()) return true;
+        probe.close();
+
+        if (!file.open(path)) {
+            error = "Cannot open revalidation cache " + path;
+            return false;
+        }
+        std::string_view bytes = file.view();
+        if (bytes.size() < kHeaderSize || bytes.compare(0, sizeof(kMagic) - 1, kMagic) != 0) {
+            error = path + " is not a revalidation cache";
+            file.close();
+            return false;
+        }
+        uint64_t header[2];
+        std::memcpy(header, bytes.data() + 8, sizeof(header));
+        stored_context = header[0];
+
+        index.reserve(header[1]);
+        size_t offset = kHeaderSize;
+        while (offset < bytes.size()) {
+            uint64_t key;
+            uint32_t length;
+            if (bytes.size() - offset < kRecordHeader) break;
+            std::memcpy(&key, bytes.data() + offset, sizeof(key));
+            std::memcpy(&length, bytes.data() + offset + sizeof(key), sizeof(length));
+            if (bytes.size() - offset - kRecordHeader < length) break;
+            index.emplace(key, bytes.substr(offset, kRecordHeader + length));
+            offset += kRecordHeader + length;
+        }
+        if (offset != bytes.size()) {
+            error = "Revalidation cache " + path + " is truncated; revalidating every row";
+            index.clear();
+            file.close();
+            return false;
+        }
+        return true;
+    }
+
+    // Rows available from the previous run
+    size_t size() const {
+        return index.size();
+    }
+
+    // Drop the loaded records unless they were produced under run_context
+    bool bind(uint64_t run_context) {
+        context = run_context;
+        if (stored_context != run_context) {
+            index.clear();
+            return false;
+        }
+        return true;
+    }
+
+    // The whole record (key and payload) for key, or an empty view.
+    // Safe to call from several threads.
+    std::string_view find(uint64_t key) const {
+        auto it = index.find(key);
+        return it != index.end() ? it->second : std::string_view();
+    }
+
+    // Fails on a record that does not parse, which is then treated as a miss
+    static bool parse(std::string_view record, CachedRow& row) {
+        row.clear();
+        Reader in{record.substr(kRecordHeader)};
+        row.status = in.u8() ? RowStatus::Problematic : RowStatus::Valid;
+        for (uint32_t count = in.varint(); count > 0 && in.ok; --count) {
+            uint32_t col = in.varint();
+            row.cells.emplace_back(col, in.text());
+        }
+        for (uint32_t count = in.varint(); count > 0 && in.ok; --count) {
+            CachedRow::Error error;
+            error.col = in.varint();
+            uint8_t code = in.u8();
+            error.code = static_cast<ErrorCode>(code);
+            error.arg_count = in.u8();
+            error.arg_begin = row.args.size();
+            if (code >= std::size(kErrorInfo)) return false;
+            for (uint8_t k = 0; k < error.arg_count; ++k) {
+                row.args.push_back(in.text());
+            }
+            row.errors.push_back(error);
+        }
+        row.log = in.text();
+        return in.ok && in.rest.empty();
+    }
+
+    static void appendRecord(std::string& records, uint64_t key, const CachedRow& row) {
+        size_t start = records.size();
+        uint32_t length = 0;
+        records.append(reinterpret_cast<const char*>(&key), sizeof(key));
+        records.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        records.push_back(row.status == RowStatus::Problematic ? 1 : 0);
+        putVarint(records, row.cells.size());
+        for (const auto& [col, value] : row.cells) {
+            putVarint(records, col);
+            putText(records, value);
+        }
+        putVarint(records, row.errors.size());
+        for (const auto& error : row.errors) {
+            putVarint(records, error.col);
+            records.push_back(static_cast<char>(error.code));
+            records.push_back(static_cast<char>(error.arg_count));
+            for (size_t k = 0; k < error.arg_count; ++k) {
+                putText(records, row.args[error.arg_begin + k]);
+            }
+        }
+        putText(records, row.log);
+        length = static_cast<uint32_t>(records.size() - start - kRecordHeader);
+        std::memcpy(&records[start + sizeof(key)], &length, sizeof(length));
+    }
+
+    // Start the replacement file; records are streamed into it as blocks finish
+    bool beginWrite(std::string& error) {
+        out.open(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            error = "Cannot create file " + temp_path;
+            return false;
+        }
+        uint64_t header[2] = {context, 0};
+        out.write(kMagic, sizeof(kMagic) - 1);
+        out.write(reinterpret_cast<const char*>(header), sizeof(header));
+        written = 0;
+        return true;
+    }
+
+    void append(const std::string& records, size_t count) {
+        out.write(records.data(), records.size());
+        written += count;
+    }
+
+    // Finish the replacement file and move it over the old cache
+    bool commit(std::string& error) {
+        uint64_t count = written;
+        out.seekp(8 + sizeof(uint64_t));
+        out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        out.close();
+        if (out.fail()) {
+            error = "Failed to write " + temp_path;
+            std::remove(temp_path.c_str());
+            return false;
+        }
+#ifndef _WIN32
+        int fd = ::open(temp_path.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            fsync(fd);
+            ::close(fd);
+        }
+#else
+        file.close();
+        std::remove(path.c_str());
+#endif
+        if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+            error = "Cannot replace revalidation cache " + path;
+            std::remove(temp_path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    size_t recordsWritten() const {
+        return written;
+    }
+
+private:
+    static constexpr char kMagic[] = "DLCACHE1";
+    static constexpr size_t kHeaderSize = 8 + 2 * sizeof(uint64_t);
+    static constexpr size_t kRecordHeader = sizeof(uint64_t) + sizeof(uint32_t);
+
+    // Bounds-checked cursor over a payload; reads past the end clear ok
+    struct Reader {
+        std::string_view rest;
+        bool ok = true;
+
+        uint8_t u8() {
+            if (rest.empty()) return fail();
+            uint8_t value = static_cast<uint8_t>(rest[0]);
+            rest.remove_prefix(1);
+            return value;
+        }
+
+        uint32_t varint() {
+            uint32_t value = 0;
+            for (int shift = 0; shift < 35; shift += 7) {
+                uint8_t byte = u8();
+                value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+                if (!(byte & 0x80)) return value;
+            }
+            return fail();
+        }
+
+        std::string_view text() {
+            uint32_t length = varint();
+            if (rest.size() < length) {
+                fail();
+                return std::string_view();
+            }
+            std::string_view value = rest.substr(0, length);
+            rest.remove_prefix(length);
+            return value;
+        }
+
+        uint8_t fail() {
+            ok = false;
+            rest = std::string_view();
+            return 0;
+        }
+    };
+
+    static void putVarint(std::string& out, size_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    static void putText(std::string& out, std::string_view value) {
+        putVarint(out, value.size());
+        out.append(value);
+    }
+
+    std::string path;
+    std::string temp_path;
+    MappedFile file;
+    std::unordered_map<uint64_t, std::string_view> index;
+    uint64_t stored_context = 0;
+    uint64_t context = 0;
+    std::ofstream out;
+    size_t written = 0;
 };
 
-// Log manager class to handle both console and file logging
-class LogManager {
+// Heap allocations made through operator new. The executable replaces the
+// global operator new below to count them; the library leaves the host
+// process's allocator alone, so there the counts stay zero. Every thread
+// counts into its own cache line, taken on its first allocation and summed
+// on read, so validation threads never contend on the counters. Slots are
+// reused only past kSlots threads, and keep the counts of exited threads.
+struct AllocationCounter {
+#ifdef DATALOOM_LIBRARY
+    static constexpr bool kCounted = false;
+#else
+    static constexpr bool kCounted = true;
+#endif
+
+    static void count(size_t size) {
+        if (slot_index == kUnassigned) {
+            slot_index = next_slot.fetch_add(1, std::memory_order_relaxed) % kSlots;
+        }
+        Slot& slot = slots[slot_index];
+        slot.calls.fetch_add(1, std::memory_order_relaxed);
+        slot.bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    static uint64_t calls() {
+        uint64_t total = 0;
+        for (const Slot& slot : slots) total += slot.calls.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    static uint64_t bytes() {
+        uint64_t total = 0;
+        for (const Slot& slot : slots) total += slot.bytes.load(std::memory_order_relaxed);
+        return total;
+    }
+
 private:
-    std::ofstream log_file;
-    std::string log_file_path;
-    
+    static constexpr size_t kSlots = 256;
+    static constexpr size_t kUnassigned = SIZE_MAX;
+
+    // Zero as static storage; no initializers, which a nested class cannot
+    // have here
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> calls;
+        std::atomic<uint64_t> bytes;
+    };
+
+    static inline Slot slots[kSlots];
+    static inline std::atomic<size_t> next_slot{0};
+    static inline thread_local size_t slot_index = kUnassigned;
+};
+
+// Kept out of line so the compiler never pairs an inlined free() with new
+#ifndef DATALOOM_LIBRARY
+[[gnu::noinline]] void* operator new(std::size_t size) {
+    AllocationCounter::count(size);
+    for (;;) {
+        if (void* block = std::malloc(size ? size : 1)) return block;
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) throw std::bad_alloc();
+        handler();
+    }
+}
+
+[[gnu::noinline]] void operator delete(void* block) noexcept {
+    std::free(block);
+}
+
+[[gnu::noinline]] void operator delete(void* block, std::size_t) noexcept {
+    std::free(block);
+}
+#endif
+
+// Per-phase measurements for --stats, written as JSON at the end of a run.
+// Phases are timed only at their boundaries (wall clock, process CPU time,
+// allocations, peak RSS). Validator families run per cell, so they are timed
+// on one row in kSampleEvery and scaled up to every validated row; with the
+// rest this keeps collection well under 1% of a run.
+class RunStats {
+private:
+    // Process-wide counters at one instant
+    struct Reading {
+        uint64_t wall_ns = 0;
+        double cpu = 0;
+        uint64_t allocations = 0;
+        uint64_t allocated_bytes = 0;
+        size_t peak_rss = 0;
+
+        static Reading now() {
+            Reading reading;
+            reading.wall_ns = nanoseconds();
+#ifndef _WIN32
+            struct rusage usage;
+            if (getrusage(RUSAGE_SELF, &usage) == 0) {
+                reading.cpu = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+                              (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+                reading.peak_rss = static_cast<size_t>(usage.ru_maxrss) * 1024;  // Linux reports KiB
+            }
+#else
+            reading.cpu = static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+#endif
+            reading.allocations = AllocationCounter::calls();
+            reading.allocated_bytes = AllocationCounter::bytes();
+            return reading;
+        }
+    };
+
 public:
-    LogManager() = default;
-    
-    bool initialize(const std::string& filepath) {
-        log_file_path = filepath;
-        log_file.open(filepath);
-        if (!log_file.is_open()) {
-            std::cerr << "ERROR: Cannot create log file " + filepath << std::endl;
+    static constexpr size_t kSampleEvery = 64;
+    static constexpr size_t kFieldKinds = std::size(kValidatorNames);
+
+    // Validator time, in nanoseconds, of the sampled rows
+    struct Samples {
+        std::array<uint64_t, kFieldKinds> field_ns{};
+        uint64_t cross_field_ns = 0;
+        uint64_t name_curp_ns = 0;
+        size_t sampled_rows = 0;
+        size_t validated_rows = 0;
+
+        void merge(const Samples& other) {
+            for (size_t k = 0; k < kFieldKinds; ++k) field_ns[k] += other.field_ns[k];
+            cross_field_ns += other.cross_field_ns;
+            name_curp_ns += other.name_curp_ns;
+            sampled_rows += other.sampled_rows;
+            validated_rows += other.validated_rows;
+        }
+    };
+
+    struct KeySetStats {
+        std::string name;
+        ShardedKeySet::Occupancy occupancy;
+    };
+
+    // Times the enclosing block as one call of a phase; a null stats is a no-op
+    class Scope {
+    public:
+        Scope(RunStats* stats, const char* phase) : stats(stats), phase(phase) {
+            if (stats) start = Reading::now();
+        }
+
+        ~Scope() {
+            if (stats) stats->add(phase, start, Reading::now());
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        RunStats* stats;
+        const char* phase;
+        Reading start;
+    };
+
+    static uint64_t nanoseconds() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    RunStats() : started(Reading::now()) {}
+
+    Samples samples;
+    std::array<size_t, kFieldKinds> field_columns{};
+    std::vector<KeySetStats> key_sets;
+    LogManager::Counters logging;
+    std::string input;
+    size_t input_bytes = 0;
+    size_t rows = 0;
+    size_t threads = 1;
+    bool streamed = false;
+
+    bool write(const std::string& path, std::string& error) const {
+        Reading now = Reading::now();
+        double wall = seconds(now.wall_ns - started.wall_ns);
+        double cpu = now.cpu - started.cpu;
+
+        std::string out = "{\n  \"input\": ";
+        JsonLinesWriter::appendString(out, input);
+        out += ",\n  \"mode\": ";
+        out += streamed ? "\"stream\"" : "\"in_memory\"";
+        number(out, ",\n  \"threads\": ", threads);
+        number(out, ",\n  \"rows\": ", rows);
+        number(out, ",\n  \"input_bytes\": ", input_bytes);
+        number(out, ",\n  \"wall_seconds\": ", wall);
+        number(out, ",\n  \"cpu_seconds\": ", cpu);
+        number(out, ",\n  \"rows_per_second\": ", perSecond(rows, wall));
+        number(out, ",\n  \"bytes_per_second\": ", perSecond(input_bytes, wall));
+        resources(out, ",\n  ", now, started);
+
+        out += ",\n  \"phases\": [";
+        for (size_t p = 0; p < phases.size(); ++p) {
+            const Phase& phase = phases[p];
+            out += p ? ",\n    {\"name\": \"" : "\n    {\"name\": \"";
+            out += phase.name;
+            out += '"';
+            number(out, ", \"calls\": ", phase.calls);
+            number(out, ", \"wall_seconds\": ", phase.wall);
+            number(out, ", \"cpu_seconds\": ", phase.cpu);
+            number(out, ", \"rows_per_second\": ", perSecond(rows, phase.wall));
+            if (std::strcmp(phase.name, "loadData") == 0) {
+                number(out, ", \"bytes_per_second\": ", perSecond(input_bytes, phase.wall));
+            }
+            number(out, ", \"allocations\": ", phase.allocations);
+            number(out, ", \"allocated_bytes\": ", phase.allocated_bytes);
+            number(out, ", \"peak_rss_bytes\": ", phase.peak_rss);
+            if (std::strcmp(phase.name, "validateRows") == 0) {
+                out += ",\n     \"breakdown\": ";
+                breakdown(out, phase);
+            }
+            out += '}';
+        }
+        out += "\n  ]";
+
+        out += ",\n  \"hash_sets\": {";
+        for (size_t k = 0; k < key_sets.size(); ++k) {
+            const auto& set = key_sets[k].occupancy;
+            out += k ? ",\n    \"" : "\n    \"";
+            out += key_sets[k].name;
+            out += "\": {";
+            number(out, "\"keys\": ", set.keys);
+            number(out, ", \"slots\": ", set.slots);
+            number(out, ", \"load_factor\": ", set.slots ? static_cast<double>(set.keys) / set.slots : 0.0);
+            number(out, ", \"max_shard_load_factor\": ", set.max_shard_load);
+            number(out, ", \"unpacked_keys\": ", set.fallback_keys);
+            out += '}';
+        }
+        out += "\n  }";
+
+        number(out, ",\n  \"log\": {\"bytes\": ", logging.bytes);
+        number(out, ", \"batches\": ", logging.batches);
+        number(out, ", \"full_ring_waits\": ", logging.full_ring_waits);
+        out += "}\n}\n";
+
+        std::ofstream file(path, std::ios::binary);
+        file.write(out.data(), static_cast<std::streamsize>(out.size()));
+        file.close();
+        if (!file) {
+            error = "Cannot write stats to " + path;
             return false;
         }
-        log("Log initialized: " + filepath);
         return true;
     }
-    
-    void log(const std::string& message) {
-        // Write to console
-        std::cout << message << std::endl;
-        
-        // Write to log file
-        if (log_file.is_open()) {
-            log_file << message << std::endl;
+
+private:
+    struct Phase {
+        const char* name;
+        size_t calls = 0;
+        double wall = 0;
+        double cpu = 0;
+        uint64_t allocations = 0;
+        uint64_t allocated_bytes = 0;
+        size_t peak_rss = 0;
+    };
+
+    Reading started;
+    std::vector<Phase> phases;
+
+    void add(const char* name, const Reading& start, const Reading& end) {
+        auto phase = std::find_if(phases.begin(), phases.end(),
+                                  [name](const Phase& p) { return std::strcmp(p.name, name) == 0; });
+        if (phase == phases.end()) {
+            phases.push_back(Phase{name});
+            phase = phases.end() - 1;
         }
+        phase->calls++;
+        phase->wall += seconds(end.wall_ns - start.wall_ns);
+        phase->cpu += end.cpu - start.cpu;
+        phase->allocations += end.allocations - start.allocations;
+        phase->allocated_bytes += end.allocated_bytes - start.allocated_bytes;
+        phase->peak_rss = std::max(phase->peak_rss, end.peak_rss);
     }
-    
-    void log_auto_correction(size_t row_num, const std::string& action, const std::string& original, const std::string& corrected) {
-        std::string msg = "Row " + std::to_string(row_num + 1) + ": AUTO-CORRECTED: " + action + ": '" + original + "' -> '" + corrected + "'";
-        log(msg);
+
+    // Validator families, cross-field rules and name/CURP checks, each scaled
+    // from the sampled rows to every validated row. CPU time is the scaled
+    // thread time; wall time is the phase's wall time split in proportion.
+    void breakdown(std::string& out, const Phase& phase) const {
+        std::vector<std::pair<std::string_view, uint64_t>> parts;
+        for (size_t k = 1; k < kFieldKinds; ++k) {
+            if (field_columns[k] > 0) parts.emplace_back(kValidatorNames[k].name, samples.field_ns[k]);
+        }
+        parts.emplace_back("validateCrossFieldRules", samples.cross_field_ns);
+        parts.emplace_back("validateNamesWithCURP", samples.name_curp_ns);
+        std::stable_sort(parts.begin(), parts.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+
+        uint64_t sampled_ns = 0;
+        for (const auto& part : parts) sampled_ns += part.second;
+        double scale = samples.sampled_rows ? static_cast<double>(samples.validated_rows) / samples.sampled_rows : 0.0;
+
+        out += "{\"sample_every\": ";
+        out += std::to_string(kSampleEvery);
+        number(out, ", \"sampled_rows\": ", samples.sampled_rows);
+        number(out, ", \"validated_rows\": ", samples.validated_rows);
+        out += ", \"parts\": [";
+        for (size_t i = 0; i < parts.size(); ++i) {
+            double cpu = seconds(parts[i].second) * scale;
+            out += i ? ",\n       {\"name\": \"" : "\n       {\"name\": \"";
+            out += parts[i].first;
+            out += '"';
+            for (size_t k = 1; k < kFieldKinds; ++k) {
+                if (kValidatorNames[k].name == parts[i].first) number(out, ", \"columns\": ", field_columns[k]);
+            }
+            number(out, ", \"wall_seconds\": ", sampled_ns ? phase.wall * parts[i].second / sampled_ns : 0.0);
+            number(out, ", \"cpu_seconds\": ", cpu);
+            number(out, ", \"rows_per_second\": ", perSecond(samples.validated_rows, cpu));
+            out += '}';
+        }
+        out += "]}";
     }
-    
-    void log_auto_fill(size_t row_num, const std::string& action, const std::string& value) {
-        std::string msg = "Row " + std::to_string(row_num + 1) + ": AUTO-FILLED: " + action + " with '" + value + "'";
-        log(msg);
+
+    static void resources(std::string& out, const char* separator, const Reading& end, const Reading& start) {
+        out += separator;
+        number(out, "\"peak_rss_bytes\": ", end.peak_rss);
+        out += separator;
+        if (AllocationCounter::kCounted) {
+            number(out, "\"allocations\": ", end.allocations - start.allocations);
+            out += separator;
+            number(out, "\"allocated_bytes\": ", end.allocated_bytes - start.allocated_bytes);
+        } else {
+            out += "\"allocations\": null";
+        }
     }
-    
-    void log_cleaned(size_t row_num, const std::string& field, const std::string& original, const std::string& cleaned) {
-        std::string msg = "Row " + std::to_string(row_num + 1) + ": CLEANED " + field + ": '" + original + "' -> '" + cleaned + "'";
-        log(msg);
+
+    static double seconds(uint64_t nanoseconds) {
+        return nanoseconds / 1e9;
     }
-    
-    void log_error(size_t row_num, const std::string& error) {
-        std::string msg = "Row " + std::to_string(row_num + 1) + ": ERROR: " + error;
-        log(msg);
+
+    static double perSecond(double count, double seconds) {
+        return seconds > 0 ? count / seconds : 0.0;
     }
-    
-    void log_error(const std::string& error) {
-        std::string msg = "ERROR: " + error;
-        log(msg);
+
+    static void number(std::string& out, const char* key, uint64_t value) {
+        out += key;
+        out += std::to_string(value);
     }
-    
-    void log_warning(size_t row_num, const std::string& warning) {
-        std::string msg = "Row " + std::to_string(row_num + 1) + ": WARNING: " + warning;
-        log(msg);
+
+    static void number(std::string& out, const char* key, double value) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.6g", value);
+        out += key;
+        out += text;
     }
-    
-    void log_warning(const std::string& warning) {
-        std::string msg = "WARNING: " + warning;
-        log(msg);
+};
+
+// Thread pool behind every parallelFor: a processor's own workers, or in
+// batch mode one pool for all files. Jobs (whole files) wait in one FIFO
+// queue and start in submission order. Work a job forks (row blocks) goes on the
+// forking worker's own deque: the owner pops from the back, idle workers
+// steal from the front, so the blocks of one large file spread over every
+// core while small files run beside it. A worker waiting on its forks runs
+// forked work, never a whole job, so a job cannot end up nested inside
+// another one.
+class WorkStealingPool {
+public:
+    // Workers are named `track_name w` in --trace timelines
+    explicit WorkStealingPool(size_t worker_count, const char* track_name = "worker") {
+        size_t count = std::max<size_t>(1, worker_count);
+        for (size_t w = 0; w < count; ++w) {
+            deques.push_back(std::make_unique<Deque>());
+        }
+        for (size_t w = 0; w < count; ++w) {
+            threads.emplace_back([this, w, track_name] { workerLoop(w, track_name); });
+        }
     }
-    
-    void log_info(const std::string& info) {
-        std::string msg = "INFO: " + info;
-        log(msg);
+
+    ~WorkStealingPool() {
+        waitIdle();
+        {
+            std::lock_guard<std::mutex> lock(jobs_mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& thread : threads) {
+            thread.join();
+        }
     }
-    
-    void log_summary(const std::string& summary) {
-        std::string msg = "SUMMARY: " + summary;
-        log(msg);
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    size_t size() const {
+        return deques.size();
     }
-    
-    void close() {
-        if (log_file.is_open()) {
-            log_file.close();
+
+    void submit(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(jobs_mutex);
+            jobs.push_back(std::move(job));
+            unfinished_jobs++;
         }
+        wake.notify_one();
     }
-    
-    ~LogManager() {
-        close();
+
+    // Block until every submitted job has finished
+    void waitIdle() {
+        std::unique_lock<std::mutex> lock(jobs_mutex);
+        idle.wait(lock, [this] { return unfinished_jobs == 0; });
+    }
+
+    // Run task(0) .. task(count - 1) as forks of the calling worker and return
+    // once all have run. Outside the pool the forks go on the first deque.
+    void parallelFor(size_t count, const std::function<void(size_t)>& task) {
+        std::atomic<size_t> remaining{count};
+        Deque& own = *deques[ownDeque()];
+        {
+            std::lock_guard<std::mutex> lock(own.mutex);
+            for (size_t i = 0; i < count; ++i) {
+                own.forks.push_back({&task, i, &remaining});
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(jobs_mutex);
+            fork_epoch.fetch_add(1, std::memory_order_relaxed);
+        }
+        wake.notify_all();
+        helpUntil([&remaining] { return remaining.load(std::memory_order_acquire) == 0; });
+    }
+
+    // Run forked work until done() holds
+    void helpUntil(const std::function<bool()>& done) {
+        size_t self = ownDeque();
+        while (!done()) {
+            if (!runFork(self)) std::this_thread::yield();
+        }
+    }
+
+private:
+    struct Fork {
+        const std::function<void(size_t)>* task;
+        size_t index;
+        std::atomic<size_t>* remaining;
+    };
+
+    struct Deque {
+        std::mutex mutex;
+        std::deque<Fork> forks;
+    };
+
+    static inline thread_local WorkStealingPool* current_pool = nullptr;
+    static inline thread_local size_t current_worker = 0;
+
+    std::vector<std::unique_ptr<Deque>> deques;
+    std::vector<std::thread> threads;
+    std::mutex jobs_mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::deque<std::function<void()>> jobs;
+    size_t unfinished_jobs = 0;
+    bool stopping = false;
+    // Bumped under jobs_mutex whenever forks are pushed, so a worker that
+    // found no fork cannot sleep through new ones
+    std::atomic<uint64_t> fork_epoch{0};
+
+    size_t ownDeque() const {
+        return current_pool == this ? current_worker : 0;
     }
+
+    // Run one fork: the newest of our own, else the oldest of another worker's
+    bool runFork(size_t self) {
+        Fork fork;
+        bool found = false;
+        for (size_t k = 0; k < deques.size() && !found; ++k) {
+            Deque& victim = *deques[(self + k) % deques.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.forks.empty()) continue;
+            if (k == 0) {
+                fork = victim.forks.back();
+                victim.forks.pop_back();
+            } else {
+                fork = victim.forks.front();
+                victim.forks.pop_front();
+            }
+            found = true;
+        }
+        if (!found) return false;
+        (*fork.task)(fork.index);
+        fork.remaining->fetch_sub(1, std::memory_order_acq_rel);
+        return true;
+    }
+
+    void workerLoop(size_t w, const char* track_name) {
+        current_pool = this;
+        current_worker = w;
+        DATALOOM_TRACE_THREAD(Tracer::kWorkerTrack + static_cast<uint32_t>(w), track_name, w);
+        for (;;) {
+            uint64_t epoch = fork_epoch.load(std::memory_order_relaxed);
+            if (runFork(w)) continue;
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(jobs_mutex);
+                if (jobs.empty()) {
+                    if (stopping) return;
+                    wake.wait(lock, [&] {
+                        return stopping || !jobs.empty() || fork_epoch.load(std::memory_order_relaxed) != epoch;
+                    });
+                    continue;
+                }
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+            {
+                std::lock_guard<std::mutex> lock(jobs_mutex);
+                unfinished_jobs--;
+            }
+            idle.notify_all();
+        }
+    }
+};
+
+// Duplicate detection shared by every file of a batch (--shared-dedup). Files
+// check their keys one at a time in manifest order, so a key is reported in
+// every file after the one where it first appears, exactly as if the inputs
+// had been concatenated, however the files are scheduled.
+class SharedKeySets {
+public:
+    explicit SharedKeySets(size_t files) : finished(files, false) {}
+
+    ShardedKeySet curps{KeyPacking::Alphanumeric};
+    ShardedKeySet control_numbers{KeyPacking::Digits};
+
+    bool isTurnOf(size_t file) const {
+        return next.load(std::memory_order_acquire) == file;
+    }
+
+    // The file is done with the sets (or never needed them); safe to repeat
+    void finish(size_t file) {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished[file] = true;
+        size_t turn = next.load(std::memory_order_relaxed);
+        while (turn < finished.size() && finished[turn]) turn++;
+        next.store(turn, std::memory_order_release);
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<bool> finished;
+    std::atomic<size_t> next{0};
 };
 
 class DataProcessor {
 private:
     ExcelData data;
     std::map<std::string, std::string> options;
-    std::unordered_set<std::string> curp_set;
-    std::unordered_set<std::string> control_number_set;
+    ShardedKeySet curp_set{KeyPacking::Alphanumeric};
+    ShardedKeySet control_number_set{KeyPacking::Digits};
+    std::shared_ptr<HistoryIndex> history;
+    std::shared_ptr<RowCache> row_cache;
+    std::string cache_records;
+    size_t cache_record_count = 0;
+    std::atomic<size_t> cache_hits{0};
     std::vector<std::string> validation_summary;
+    std::shared_ptr<const ValidationSchema> schema;
+    ValidationPlan plan;
     std::vector<bool> valid_rows;
-    std::vector<size_t> problematic_rows;
     std::shared_ptr<LogManager> logger;
+    CsvReader reader;
+    std::unique_ptr<XlsxReader> xlsx;
+    size_t input_row_count = 0;
+    size_t row_base = 0;
+    size_t summary_rows = 0;
+    size_t summary_valid_rows = 0;
+    size_t summary_problematic = 0;
+    size_t summary_total_errors = 0;
+    std::vector<size_t> summary_column_errors;
+    size_t thread_count = 1;
+    std::vector<int> dedup_slot;
+    std::vector<size_t> dedup_columns;
+    std::vector<ShardedKeySet*> dedup_sets;
+    size_t dedup_width = 0;
+    std::vector<uint8_t> duplicate_flags;
+    std::vector<IdClasses> curp_classes;
+    RunStats* stats = nullptr;
+    WorkStealingPool* pool = nullptr;
+    std::unique_ptr<WorkStealingPool> own_pool;
+    SharedKeySets* shared_keys = nullptr;
+    size_t shared_file = 0;
+
+    // Where an earlier copy of a dedup key was seen
+    enum class DuplicateSource : uint8_t { None, Input, History };
+
+    static std::shared_ptr<const ValidationSchema> builtInSchema() {
+        static const auto built_in = std::make_shared<const ValidationSchema>(ValidationSchema::builtIn());
+        return built_in;
+    }
+
+    void configureThreads() {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+        if (options.count("threads")) {
+            try {
+                thread_count = std::max(1ul, std::stoul(options["threads"]));
+            } catch (...) {
+                logger->log_warning("Invalid --threads value '" + options["threads"] + "', using " + 
+                                    std::to_string(thread_count));
+            }
+        }
+    }
+
+    static constexpr size_t kRowsPerChunk = 4096;
+    static constexpr size_t kCacheFlushBytes = 1 << 20;
+
+    // Per-chunk output of parallel validation, merged back in row order
+    struct ChunkResult {
+        std::string log_lines;
+        CellArena arena;
+        ErrorStore errors;
+        std::string cache_records;
+        size_t cache_record_count = 0;
+        RunStats::Samples samples;
+    };
+    static inline thread_local ChunkResult* active_chunk = nullptr;
 
 public:
     DataProcessor(const std::map<std::string, std::string>& opts, std::shared_ptr<LogManager> log_mgr) 
@@ -123,71 +5727,238 @@ public:
         if (!logger) {
             logger = std::make_shared<LogManager>();
         }
+
+        schema = builtInSchema();
+        configureThreads();
+    }
+
+    // Forget the previous dataset and take new options, so one instance can
+    // serve many jobs. Buffers keep their capacity and the arena its blocks,
+    // so a warm processor allocates little for an input of similar size.
+    void reset(const std::map<std::string, std::string>& opts) {
+        options = opts;
+        configureThreads();
+        schema = builtInSchema();
+        history.reset();
+        row_cache.reset();
+        cache_records.clear();
+        cache_record_count = 0;
+        cache_hits = 0;
+        data.headers.clear();
+        data.clearRows();
+        data.source.close();
+        reader = CsvReader();
+        xlsx.reset();
+        input_row_count = 0;
+        row_base = 0;
+        resetValidationState();
+    }
+
+    std::vector<std::string> getHeaders() const {
+        return data.headers;
+    }
+
+    std::vector<std::vector<std::string>> getProblematicRows() const {
+        std::vector<std::vector<std::string>> result;
+        for (size_t i = 0; i < data.rowCount(); ++i) {
+            if (data.row_status[i] == RowStatus::Problematic) {
+                auto& row = result.emplace_back();
+                for (const auto& column : data.columns) {
+                    row.emplace_back(column[i]);
+                }
+            }
+        }
+        return result;
+    }
+
+    // Must be set before the input is opened
+    void setSchema(std::shared_ptr<const ValidationSchema> validation_schema) {
+        schema = std::move(validation_schema);
+    }
+
+    // Check dedup keys against earlier runs and record the accepted ones
+    void setHistory(std::shared_ptr<HistoryIndex> history_index) {
+        history = std::move(history_index);
+    }
+
+    // Time phases and sample validators into stats (--stats); null turns it off
+    void setStats(RunStats* run_stats) {
+        stats = run_stats;
+    }
+
+    // Add the totals only known at the end of a run to stats
+    void collectStats(const std::string& inputFile) {
+        stats->input = inputFile;
+        stats->input_bytes = data.source.view().size();
+        stats->rows = summary_rows;
+        stats->threads = thread_count;
+        stats->field_columns.fill(0);
+        for (FieldKind kind : plan.columns) {
+            stats->field_columns[static_cast<size_t>(kind)]++;
+        }
+        stats->key_sets = {{"curp", curp_set.occupancy()}, {"control_number", control_number_set.occupancy()}};
+        logger->flush();
+        stats->logging = logger->counters();
+    }
+
+    // Run parallel work as forks on a batch pool instead of a pool of our own
+    void setPool(WorkStealingPool* batch_pool) {
+        pool = batch_pool;
+        thread_count = pool->size();
+    }
+
+    // Check duplicates against sets shared by a batch, as file number `file`
+    void setSharedKeys(SharedKeySets* keys, size_t file) {
+        shared_keys = keys;
+        shared_file = file;
+    }
+
+    // Reuse the results of unchanged rows and record every row for the next run
+    void setRowCache(std::shared_ptr<RowCache> cache) {
+        row_cache = std::move(cache);
     }
 
-    std::vector<std::vector<std::string>> getValidationErrors() const {
-        return data.validation_errors;
+    size_t getCacheHits() const {
+        return cache_hits.load();
     }
 
-    std::vector<std::string> getHeaders() const {
-        return data.headers;
+    size_t getProcessedCount() const {
+        return summary_rows;
     }
 
-    std::vector<std::vector<std::string>> getProblematicRows() const {
-        std::vector<std::vector<std::string>> result;
-        for (size_t i : problematic_rows) {
-            if (i < data.rows.size()) {
-                result.push_back(data.rows[i]);
+    size_t getProblematicCount() const {
+        return summary_problematic;
+    }
+
+    // Columns sharing a header are reported together, by header name
+    std::map<std::string, size_t> errorCountsByField() const {
+        std::map<std::string, size_t> error_counts;
+        for (size_t j = 0; j < summary_column_errors.size() && j < data.headers.size(); ++j) {
+            if (summary_column_errors[j] > 0) {
+                error_counts[data.headers[j]] += summary_column_errors[j];
             }
         }
-        return result;
+        return error_counts;
     }
 
-    std::string trimTrailingComma(const std::string& str) {
-        if (str.empty()) return str;
-        
-        size_t end = str.length();
-        while (end > 0 && str[end - 1] == ',') {
-            end--;
-        }
-        
-        return str.substr(0, end);
+    // Rows, cells and errors in memory, for embedders
+    const ExcelData& getData() const {
+        return data;
     }
 
-    bool loadData(const std::string& inputFile) {
-        std::ifstream file(inputFile);
-        if (!file.is_open()) {
+    bool openInput(const std::string& inputFile) {
+        RunStats::Scope scope(stats, "loadData");
+        DATALOOM_TRACE_SCOPE("load", "open input");
+        if (!data.source.open(inputFile)) {
             logger->log_error("Cannot open file " + inputFile);
             return false;
         }
+        return openSource(inputFile);
+    }
 
-        std::string line;
+    // Parse the headers of the CSV or XLSX bytes in data.source; name is used in messages
+    bool openSource(const std::string& inputFile) {
+        if (XlsxReader::isWorkbook(data.source.view())) {
+            xlsx = std::make_unique<XlsxReader>();
+            std::string error;
+            if (!xlsx->open(data.source.view(), error)) {
+                logger->log_error("Cannot read workbook " + inputFile + ": " + error);
+                return false;
+            }
+            logger->log_info("Reading XLSX sheet '" + xlsx->sheetName() + "' (" + 
+                             std::to_string(xlsx->sharedStringCount()) + " shared strings)");
+        } else {
+            xlsx.reset();
+            reader = CsvReader(data.source.view());
+            logger->log_debug(std::string("CSV scanner: ") + StructuralScanner::name());
+        }
+        std::vector<std::string_view> fields;
         
-        // Read headers (first line)
-        if (std::getline(file, line)) {
-            std::stringstream ss(line);
-            std::string header;
-            while (std::getline(ss, header, ',')) {
-                data.headers.push_back(trimTrailingComma(header));
+        // Read headers (first record); trailing empty names come from trailing commas
+        if (readInputRecord(fields)) {
+            while (!fields.empty() && fields.back().empty()) {
+                fields.pop_back();
+            }
+            for (const auto& header : fields) {
+                data.headers.emplace_back(header);
             }
             logger->log_info("Loaded " + std::to_string(data.headers.size()) + " headers");
         }
+        data.columns.resize(data.headers.size());
+        buildValidationPlan();
+        return !row_cache || startRowCache();
+    }
 
-        // Read data rows
-        int row_count = 0;
-        while (std::getline(file, line)) {
-            row_count++;
-            std::vector<std::string> row;
-            std::stringstream ss(line);
-            std::string cell;
-            
-            while (std::getline(ss, cell, ',')) {
-                row.push_back(trimTrailingComma(cell));
+    bool startRowCache() {
+        size_t previous = row_cache->size();
+        if (row_cache->bind(rowCacheContext())) {
+            logger->log_info("Revalidation cache: " + std::to_string(previous) + " rows from the previous run");
+        } else if (previous > 0) {
+            logger->log_info("Revalidation cache was built for other headers, schema or log level; revalidating every row");
+        }
+        std::string error;
+        if (!row_cache->beginWrite(error)) {
+            logger->log_error(error);
+            return false;
+        }
+        return true;
+    }
+
+    // Everything besides a row's own cells that its validation result depends on
+    uint64_t rowCacheContext() const {
+        uint64_t context = hashBytes("dataloom row cache", RowCache::kVersion);
+        for (const auto& header : data.headers) {
+            context = hashBytes(header, context);
+        }
+        context = mixKey(context ^ schema->digest());
+        context = mixKey(context ^ static_cast<uint64_t>(logger->getLevel()));
+        return mixKey(context ^ std::size(kErrorInfo));
+    }
+
+    // Bind every column to its schema rule and cache the columns the cross-field
+    // rules read. Where a header repeats, the first "ctr"/"dis" and the last of
+    // every other code are used, as the old per-row header scans did.
+    void buildValidationPlan() {
+        static const FieldRule unbound;
+        plan = ValidationPlan();
+        plan.columns.reserve(data.headers.size());
+        plan.rules.reserve(data.headers.size());
+        for (size_t j = 0; j < data.headers.size(); ++j) {
+            const FieldRule* rule = schema->find(data.headers[j]);
+            if (!rule) rule = &unbound;
+            FieldKind kind = rule->kind;
+            plan.columns.push_back(kind);
+            plan.rules.push_back(rule);
+            int col = static_cast<int>(j);
+            switch (kind) {
+                case FieldKind::ControlNumber: if (plan.control_number < 0) plan.control_number = col; break;
+                case FieldKind::Disability: if (plan.disability < 0) plan.disability = col; break;
+                case FieldKind::CURP: plan.curp = col; break;
+                case FieldKind::Name: plan.name = col; break;
+                case FieldKind::PaternalLastName: plan.paternal = col; break;
+                case FieldKind::MaternalLastName: plan.maternal = col; break;
+                case FieldKind::Credits: plan.credits = col; break;
+                case FieldKind::Reentry: plan.reentry = col; break;
+                case FieldKind::CurrentAverage: plan.current_average = col; break;
+                case FieldKind::GeneralAverage: plan.general_average = col; break;
+                default: break;
             }
+        }
+    }
+
+    // Append up to max_rows data rows to the block in memory; returns how many were read
+    size_t loadRows(size_t max_rows) {
+        RunStats::Scope scope(stats, "loadData");
+        DATALOOM_TRACE_SCOPE("load", "load rows", {"first_row", static_cast<int64_t>(input_row_count)});
+        std::vector<std::string_view> fields;
+        size_t loaded = 0;
+        while (loaded < max_rows && readInputRecord(fields)) {
+            input_row_count++;
+            std::vector<std::string_view>& row = fields;
             
             // Fix: Ensure row has correct number of columns
             if (row.size() != data.headers.size()) {
-                logger->log_warning("Row " + std::to_string(row_count) + " has " + std::to_string(row.size()) + 
+                logger->log_warning("Row " + std::to_string(input_row_count) + " has " + std::to_string(row.size()) + 
                                    " columns, expected " + std::to_string(data.headers.size()));
                 
                 // Remove empty cells at the end (from trailing commas)
@@ -197,74 +5968,129 @@ public:
                 
                 // Final resize if needed
                 if (row.size() < data.headers.size()) {
-                    row.resize(data.headers.size(), "");
-                    logger->log_info("Padded row " + std::to_string(row_count) + " with empty cells");
+                    row.resize(data.headers.size());
+                    logger->log_info("Padded row " + std::to_string(input_row_count) + " with empty cells");
                 } else if (row.size() > data.headers.size()) {
                     row.resize(data.headers.size());
-                    logger->log_info("Truncated row " + std::to_string(row_count) + " to " + 
+                    logger->log_info("Truncated row " + std::to_string(input_row_count) + " to " + 
                                     std::to_string(data.headers.size()) + " columns");
                 }
             }
             
-            data.rows.push_back(row);
-            data.validation_errors.push_back(std::vector<std::string>(row.size(), ""));
+            data.appendRow(row);
+            loaded++;
         }
+        return loaded;
+    }
 
-        file.close();
-        logger->log_info("Loaded " + std::to_string(data.rows.size()) + " rows from " + inputFile);
+    // Next record of the CSV or XLSX input
+    bool readInputRecord(std::vector<std::string_view>& fields) {
+        if (!xlsx) return reader.readRecord(fields, data.arena);
+        if (xlsx->readRecord(fields, data.arena)) return true;
+        std::string error = xlsx->takeError();
+        if (!error.empty()) logger->log_error("Stopped reading the workbook after row " + 
+                                              std::to_string(input_row_count) + ": " + error);
+        return false;
+    }
+
+    bool loadData(const std::string& inputFile) {
+        if (!openInput(inputFile)) {
+            return false;
+        }
+        loadRows(std::numeric_limits<size_t>::max());
+        logger->log_info("Loaded " + std::to_string(data.rowCount()) + " rows from " + inputFile);
         return true;
     }
 
-    bool saveData(const std::string& outputFile) {
-        std::ofstream file(outputFile);
-        if (!file.is_open()) {
-            logger->log_error("Cannot create file " + outputFile);
+    // Like loadData, from CSV or XLSX bytes the caller keeps alive for as long
+    // as this processor; cells point into them
+    bool loadBuffer(std::string_view bytes, const std::string& name) {
+        data.source.borrow(bytes);
+        bool opened;
+        {
+            RunStats::Scope scope(stats, "loadData");
+            DATALOOM_TRACE_SCOPE("load", "open input");
+            opened = openSource(name);
+        }
+        if (!opened) {
             return false;
         }
+        loadRows(std::numeric_limits<size_t>::max());
+        logger->log_info("Loaded " + std::to_string(data.rowCount()) + " rows from " + name);
+        return true;
+    }
 
-        // Debug: Log what we're writing
-        logger->log_info("Saving data to " + outputFile);
-        logger->log_info("Total rows: " + std::to_string(data.rows.size()));
-        logger->log_info("Problematic rows count: " + std::to_string(problematic_rows.size()));
-        
-        // Debug first few rows
-        for (size_t i = 0; i < std::min(data.rows.size(), (size_t)3); ++i) {
-            std::string row_debug = "Row " + std::to_string(i) + ": ";
-            for (size_t j = 0; j < std::min(data.rows[i].size(), (size_t)3); ++j) {
-                if (j > 0) row_debug += ", ";
-                row_debug += data.rows[i][j];
-            }
-            logger->log_info(row_debug);
+    // Write every row in one pass: valid rows to outputFile and, when a path
+    // is given, problematic rows and rows annotated with their errors
+    bool saveData(const std::string& outputFile, const std::string& problematicFile = "", 
+                  const std::string& annotatedFile = "") {
+        OutputFiles outputs;
+        if (!openOutputs(outputs, outputFile, problematicFile, annotatedFile)) {
+            return false;
         }
 
-        // Write only valid rows
-        int valid_count = 0;
-        for (size_t i = 0; i < data.rows.size(); ++i) {
-            if (std::find(problematic_rows.begin(), problematic_rows.end(), i) != problematic_rows.end()) {
-                logger->log_info("Skipping problematic row: " + std::to_string(i));
-                continue;
-            }
+        logger->log_info("Saving data to " + outputFile);
+        if (logger->enabled(LogLevel::Debug)) {
+            logger->log_debug("Total rows: " + std::to_string(data.rowCount()));
+            logger->log_debug("Problematic rows count: " + 
+                              std::to_string(std::count(data.row_status.begin(), data.row_status.end(), RowStatus::Problematic)));
             
-            const auto& row = data.rows[i];
-            logger->log_info("Writing row: " + std::to_string(i));
-            for (size_t j = 0; j < row.size(); ++j) {
-                if (j > 0) file << ",";
-                file << escapeCSV(row[j]);
+            // First few rows
+            for (size_t i = 0; i < std::min(data.rowCount(), (size_t)3); ++i) {
+                std::string row_debug = "Row " + std::to_string(row_base + i) + ": ";
+                for (size_t j = 0; j < std::min(data.columns.size(), (size_t)3); ++j) {
+                    if (j > 0) row_debug += ", ";
+                    row_debug += data.columns[j][i];
+                }
+                logger->log_debug(row_debug);
             }
-            file << "\n";
-            valid_count++;
         }
 
-        file.close();
-        logger->log_info("Saved " + std::to_string(valid_count) + " valid records to " + outputFile);
-        return true;
+        writeRows(outputs);
+        return closeOutputs(outputs, outputFile, problematicFile, annotatedFile);
+    }
+
+    // Bounded-memory pipeline: load, validate, correct and write block_size rows
+    // at a time. Only duplicate detection and summary counters outlive a block.
+    bool processStream(const std::string& inputFile, const std::string& outputFile, size_t block_size,
+                       const std::string& problematicFile = "", const std::string& annotatedFile = "") {
+        if (!openInput(inputFile)) {
+            return false;
+        }
+
+        OutputFiles outputs;
+        if (!openOutputs(outputs, outputFile, problematicFile, annotatedFile)) {
+            return false;
+        }
+
+        logger->log_info("Streaming " + inputFile + " to " + outputFile + " in blocks of " + 
+                         std::to_string(block_size) + " rows");
+        logger->log_info("Starting validation process...");
+        logger->log_info("Validating all fields...");
+        resetValidationState();
+
+        while (loadRows(block_size) > 0) {
+            DATALOOM_TRACE_SCOPE("pipeline", "process block", {"first_row", static_cast<int64_t>(row_base)},
+                                 {"rows", static_cast<int64_t>(data.rowCount())});
+            validateLoadedRows();
+            if (history) recordAcceptedKeys();
+            applyTextOptions();
+            writeRows(outputs);
+            releaseBlock();
+        }
+
+        printValidationSummary();
+        logger->log_info("Validation process completed");
+        logger->log_info("Loaded " + std::to_string(input_row_count) + " rows from " + inputFile);
+
+        return closeOutputs(outputs, outputFile, problematicFile, annotatedFile);
     }
 
-    std::string escapeCSV(const std::string& value) {
-        if (value.find(',') != std::string::npos || 
-            value.find('"') != std::string::npos || 
-            value.find('\n') != std::string::npos) {
-            std::string escaped = value;
+    static std::string escapeCSV(std::string_view value) {
+        if (value.find(',') != std::string_view::npos || 
+            value.find('"') != std::string_view::npos || 
+            value.find('\n') != std::string_view::npos) {
+            std::string escaped(value);
             size_t pos = 0;
             while ((pos = escaped.find('"', pos)) != std::string::npos) {
                 escaped.replace(pos, 1, "\"\"");
@@ -272,13 +6098,20 @@ public:
             }
             return "\"" + escaped + "\"";
         }
-        return value;
+        return std::string(value);
     }
 
     void processData() {
         logger->log_info("Starting validation process...");
         validateAllFields();
-        
+        if (history) recordAcceptedKeys();
+        applyTextOptions();
+        logger->log_info("Validation process completed");
+    }
+
+    void applyTextOptions() {
+        RunStats::Scope scope(stats, "applyTextOptions");
+        DATALOOM_TRACE_SCOPE("transform", "text options");
         // Text replacement (if specified)
         if (options.find("find") != options.end() && options.find("replace") != options.end()) {
             logger->log_info("Applying text replacement: '" + options["find"] + "' -> '" + options["replace"] + "'");
@@ -290,257 +6123,801 @@ public:
             logger->log_info("Applying case transformation: " + options["case"]);
             transformTextCase(options["case"]);
         }
-        
-        logger->log_info("Validation process completed");
     }
 
-    bool saveProblematicRows(const std::string& outputFile) {
-        if (problematic_rows.empty()) {
-            logger->log_info("No problematic records to save");
+    // Case-insensitive test of a path's extension (".csv")
+    static bool hasExtension(const std::string& path, std::string_view extension) {
+        if (path.size() < extension.size()) return false;
+        std::string suffix = path.substr(path.size() - extension.size());
+        std::transform(suffix.begin(), suffix.end(), suffix.begin(), ::tolower);
+        return suffix == extension;
+    }
+
+private:
+    // One destination of the writer pass: CSV text, an .xlsx workbook when the
+    // path ends in .xlsx, or an Arrow IPC file (see isArrowPath); the error
+    // report is JSON Lines unless it is Arrow. Optional outputs stay closed.
+    struct OutputFile {
+        std::ofstream csv;
+        std::unique_ptr<XlsxWriter> xlsx;
+        std::unique_ptr<ArrowWriter> arrow;
+        std::unique_ptr<JsonLinesWriter> json;
+        size_t count = 0;
+
+        bool is_open() const {
+            return csv.is_open() || xlsx != nullptr || arrow != nullptr || json != nullptr;
+        }
+    };
+
+    struct OutputFiles {
+        OutputFile valid;
+        OutputFile problematic;
+        OutputFile annotated;
+        OutputFile errors;
+    };
+
+    static bool isXlsxPath(const std::string& path) {
+        return hasExtension(path, ".xlsx");
+    }
+
+    // Paths ending in .arrow, and every output but workbooks with --output-format arrow
+    bool isArrowPath(const std::string& path) {
+        if (hasExtension(path, ".arrow")) return true;
+        auto format = options.find("output-format");
+        return format != options.end() && format->second == "arrow" && !isXlsxPath(path);
+    }
+
+    // Columns bound to a validator with few distinct values (semester, gender,
+    // yes/no, disability, re-entry) are dictionary-encoded in Arrow outputs
+    ArrowWriter::Type arrowColumnType(const std::string& header) const {
+        const FieldRule* rule = schema->find(header);
+        switch (rule ? rule->kind : FieldKind::None) {
+            case FieldKind::Integer:
+            case FieldKind::Gender:
+            case FieldKind::YesNo:
+            case FieldKind::Disability:
+            case FieldKind::Reentry:
+                return ArrowWriter::Type::Dictionary;
+            default:
+                return ArrowWriter::Type::Utf8;
+        }
+    }
+
+    // Open one output; workbooks always start with the header row, CSV files
+    // only when csv_header is set (the valid output has none)
+    bool openOutput(OutputFile& output, const std::string& path, const std::string& sheet, bool csv_header,
+                    std::string_view first = std::string_view(), std::string_view last = std::string_view()) {
+        if (isArrowPath(path)) {
+            std::vector<ArrowWriter::Field> fields;
+            if (!first.empty()) fields.push_back({std::string(first), ArrowWriter::Type::UInt64});
+            for (const auto& header : data.headers) fields.push_back({header, arrowColumnType(header)});
+            if (!last.empty()) fields.push_back({std::string(last), ArrowWriter::Type::Utf8});
+            return openArrow(output, path, std::move(fields));
+        }
+        if (isXlsxPath(path)) {
+            output.xlsx = std::make_unique<XlsxWriter>();
+            if (!output.xlsx->open(path, sheet)) {
+                output.xlsx.reset();
+                logger->log_error("Cannot create file " + path);
+                return false;
+            }
+            output.xlsx->beginRow();
+            if (!first.empty()) output.xlsx->cell(first, XlsxWriter::CellStyle::Header);
+            for (const auto& header : data.headers) output.xlsx->cell(header, XlsxWriter::CellStyle::Header);
+            if (!last.empty()) output.xlsx->cell(last, XlsxWriter::CellStyle::Header);
+            output.xlsx->endRow();
             return true;
         }
+        output.csv.open(path);
+        if (!output.csv.is_open()) {
+            logger->log_error("Cannot create file " + path);
+            return false;
+        }
+        if (csv_header) {
+            if (!first.empty()) output.csv << first << ",";
+            writeCSVRow(output.csv, data.headers, last);
+        }
+        return true;
+    }
 
-        std::ofstream file(outputFile);
-        if (!file.is_open()) {
-            logger->log_error("Cannot create file " + outputFile);
+    bool openArrow(OutputFile& output, const std::string& path, std::vector<ArrowWriter::Field> fields) {
+        output.arrow = std::make_unique<ArrowWriter>();
+        if (!output.arrow->open(path, std::move(fields))) {
+            output.arrow.reset();
+            logger->log_error("Cannot create file " + path);
             return false;
         }
+        return true;
+    }
 
-        // Write headers
-        for (size_t i = 0; i < data.headers.size(); ++i) {
-            if (i > 0) file << ",";
-            file << escapeCSV(data.headers[i]);
+    bool openOutputs(OutputFiles& outputs, const std::string& outputFile, const std::string& problematicFile, 
+                     const std::string& annotatedFile) {
+        RunStats::Scope scope(stats, "saveData");
+        DATALOOM_TRACE_SCOPE("write", "open outputs");
+        if (!openOutput(outputs.valid, outputFile, "Valid records", false)) {
+            return false;
         }
-        file << "\n";
+        if (!problematicFile.empty() && !openOutput(outputs.problematic, problematicFile, "Problematic records", true)) {
+            return false;
+        }
+        if (!annotatedFile.empty() && !openOutput(outputs.annotated, annotatedFile, "Rows with errors", true, "row", "errors")) {
+            return false;
+        }
+        // --errors-output: one record per validation error
+        auto errorsFile = options.find("errors-output");
+        if (errorsFile == options.end()) {
+            return true;
+        }
+        if (isArrowPath(errorsFile->second)) {
+            return openArrow(outputs.errors, errorsFile->second, {{"row", ArrowWriter::Type::UInt64},
+                                                                   {"column", ArrowWriter::Type::Dictionary},
+                                                                   {"code", ArrowWriter::Type::Dictionary},
+                                                                   {"message", ArrowWriter::Type::Utf8}});
+        }
+        outputs.errors.json = std::make_unique<JsonLinesWriter>();
+        if (!outputs.errors.json->open(errorsFile->second)) {
+            outputs.errors.json.reset();
+            logger->log_error("Cannot create file " + errorsFile->second);
+            return false;
+        }
+        return true;
+    }
+
+    bool closeOutput(OutputFile& output, const std::string& path, const std::string& what) {
+        if (output.xlsx || output.arrow || output.json) {
+            std::string error;
+            bool written = output.xlsx ? output.xlsx->close(error)
+                         : output.arrow ? output.arrow->close(error)
+                                        : output.json->close(error);
+            output.xlsx.reset();
+            output.arrow.reset();
+            output.json.reset();
+            if (!written) {
+                logger->log_error("Cannot write " + path + ": " + error);
+                return false;
+            }
+        } else {
+            output.csv.close();
+        }
+        logger->log_info("Saved " + std::to_string(output.count) + " " + what + " to " + path);
+        return true;
+    }
+
+    bool closeOutputs(OutputFiles& outputs, const std::string& outputFile, const std::string& problematicFile, 
+                      const std::string& annotatedFile) {
+        RunStats::Scope scope(stats, "saveData");
+        DATALOOM_TRACE_SCOPE("write", "close outputs");
+        bool written = closeOutput(outputs.valid, outputFile, "valid records");
+        if (outputs.problematic.is_open()) {
+            written = closeOutput(outputs.problematic, problematicFile, "problematic records") && written;
+        }
+        if (outputs.annotated.is_open()) {
+            written = closeOutput(outputs.annotated, annotatedFile, "rows with validation errors") && written;
+        }
+        if (outputs.errors.is_open()) {
+            written = closeOutput(outputs.errors, options["errors-output"], "validation errors") && written;
+        }
+        return written;
+    }
+
+    // One scan over the rows in memory, routing each row by its status. With
+    // --highlight-errors, cells with validation errors are filled in workbook outputs.
+    void writeRows(OutputFiles& outputs) {
+        RunStats::Scope scope(stats, "saveData");
+        DATALOOM_TRACE_SCOPE("write", "write rows", {"first_row", static_cast<int64_t>(row_base)},
+                             {"rows", static_cast<int64_t>(data.rowCount())});
+        bool annotate = outputs.annotated.is_open();
+        bool highlight = options.count("highlight-errors") &&
+                         (outputs.valid.xlsx || outputs.problematic.xlsx || outputs.annotated.xlsx);
+        const auto& entries = data.errors.entries;
+        size_t next_error = 0;
+        bool trace_rows = logger->enabled(LogLevel::Debug);
+        std::string annotation;
+        std::string cell_messages;
+        std::vector<uint8_t> flagged(data.columns.size());
+        for (size_t i = 0; i < data.rowCount(); ++i) {
+            size_t row_idx = row_base + i;
+            RowView row = data.row(i);
 
-        // Write problematic rows
-        for (size_t i : problematic_rows) {
-            if (i < data.rows.size()) {
-                const auto& row = data.rows[i];
+            size_t begin = next_error;
+            while (next_error < entries.size() && entries[next_error].row == row_idx) {
+                next_error++;
+            }
+            const uint8_t* errors = nullptr;
+            if (highlight && begin < next_error) {
+                std::fill(flagged.begin(), flagged.end(), 0);
+                for (size_t k = begin; k < next_error; ++k) {
+                    if (entries[k].col < flagged.size()) flagged[entries[k].col] = 1;
+                }
+                errors = flagged.data();
+            }
+
+            if (data.row_status[i] == RowStatus::Problematic) {
+                if (trace_rows) logger->log_debug("Skipping problematic row: " + std::to_string(row_idx));
+                if (outputs.problematic.is_open()) {
+                    writeRecord(outputs.problematic, row, errors);
+                }
+            } else {
+                if (trace_rows) logger->log_debug("Writing row: " + std::to_string(row_idx));
+                writeRecord(outputs.valid, row, errors);
+            }
+
+            if (annotate && begin < next_error) {
+                // "code: message; message | code: message" for every cell with errors
+                annotation.clear();
                 for (size_t j = 0; j < row.size(); ++j) {
-                    if (j > 0) file << ",";
-                    file << escapeCSV(row[j]);
+                    cell_messages.clear();
+                    data.errors.appendCellMessages(cell_messages, begin, next_error, j);
+                    if (cell_messages.empty()) continue;
+                    if (!annotation.empty()) annotation += " | ";
+                    annotation += j < data.headers.size() ? data.headers[j] : std::to_string(j);
+                    annotation += ": ";
+                    annotation += cell_messages;
+                }
+                writeRecord(outputs.annotated, row, errors, row_idx + 1, annotation);
+            }
+
+            if (outputs.errors.is_open()) {
+                for (size_t k = begin; k < next_error; ++k) {
+                    cell_messages.clear();
+                    data.errors.appendMessage(cell_messages, entries[k]);
+                    writeError(outputs.errors, row_idx + 1, entries[k], cell_messages);
                 }
-                file << "\n";
             }
         }
+    }
 
-        file.close();
-        logger->log_info("Saved " + std::to_string(problematic_rows.size()) + " problematic records to " + outputFile);
-        return true;
+    // One record of the error report: row number, column code, error id, message
+    void writeError(OutputFile& output, size_t number, const ErrorStore::Entry& entry, std::string_view message) {
+        output.count++;
+        std::string_view column = entry.col < data.headers.size() ? std::string_view(data.headers[entry.col])
+                                                                  : std::string_view();
+        std::string_view code = kErrorInfo[static_cast<size_t>(entry.code)].id;
+        if (output.arrow) {
+            ArrowWriter& report = *output.arrow;
+            report.value(static_cast<uint64_t>(number));
+            report.value(column);
+            report.value(code);
+            report.value(message);
+            report.endRow();
+            return;
+        }
+        JsonLinesWriter& report = *output.json;
+        report.beginRecord();
+        report.field("row", static_cast<uint64_t>(number));
+        report.field("column", column);
+        report.field("code", code);
+        report.field("message", message);
+        report.endRecord();
+    }
+
+    // A row to a CSV, workbook or Arrow output, optionally between its row
+    // number and a trailing extra cell; errors flags the cells to highlight
+    void writeRecord(OutputFile& output, const RowView& row, const uint8_t* errors,
+                     size_t number = 0, std::string_view last = std::string_view()) {
+        output.count++;
+        if (output.arrow) {
+            ArrowWriter& table = *output.arrow;
+            if (number) table.value(static_cast<uint64_t>(number));
+            for (size_t j = 0; j < row.size(); ++j) table.value(row[j]);
+            if (number) table.value(last);  // Numbered rows always carry the trailing column
+            table.endRow();
+            return;
+        }
+        if (!output.xlsx) {
+            if (number) output.csv << number << ",";
+            writeCSVRow(output.csv, row, last);
+            return;
+        }
+        XlsxWriter& sheet = *output.xlsx;
+        sheet.beginRow();
+        if (number) sheet.cell(std::to_string(number));
+        for (size_t j = 0; j < row.size(); ++j) {
+            bool error = errors && j < data.columns.size() && errors[j];
+            sheet.cell(row[j], error ? XlsxWriter::CellStyle::Error : XlsxWriter::CellStyle::Plain);
+        }
+        if (!last.empty()) sheet.cell(last);
+        sheet.endRow();
+    }
+
+    template <typename Cells>
+    void writeCSVRow(std::ostream& file, const Cells& cells, std::string_view extra = std::string_view()) {
+        for (size_t j = 0; j < cells.size(); ++j) {
+            if (j > 0) file << ",";
+            writeCSVField(file, cells[j]);
+        }
+        if (!extra.empty()) {
+            file << ",";
+            writeCSVField(file, extra);
+        }
+        file << "\n";
+    }
+
+    // Like escapeCSV, but writes the value straight from its view unless it needs quoting
+    void writeCSVField(std::ostream& file, std::string_view value) {
+        if (value.find_first_of(",\"\n") == std::string_view::npos) {
+            file << value;
+        } else {
+            file << escapeCSV(value);
+        }
+    }
+
+    // Drop the block in memory once it has been written, including the input
+    // pages it was parsed from
+    void releaseBlock() {
+        row_base += data.rowCount();
+        data.clearRows();
+        data.source.release(xlsx ? xlsx->position() : reader.position());
     }
 
-private:
     void validateAllFields() {
         logger->log_info("Validating all fields...");
+        resetValidationState();
+        validateLoadedRows();
+        printValidationSummary();
+    }
+
+    // Duplicate detection and summary counters span every block of a run
+    void resetValidationState() {
         curp_set.clear();
         control_number_set.clear();
         validation_summary.clear();
+        summary_rows = 0;
+        summary_valid_rows = 0;
+        summary_problematic = 0;
+        summary_total_errors = 0;
+        summary_column_errors.clear();
+    }
 
-        for (size_t i = 0; i < data.rows.size(); ++i) {
-            auto& row = data.rows[i];
-            
-            // Get CURP value for cross-validation
-            std::string curp_value = "";
-            std::string nombres_value = "";
-            std::string a_paterno_value = "";
-            std::string a_materno_value = "";
+    // Validate the rows in memory on thread_count workers. Rows are split into
+    // chunks; each chunk buffers its log lines and corrected cells, and chunks
+    // are committed in row order so the log and outputs are identical to a
+    // single-threaded run. Row status bytes are written in place.
+    void validateLoadedRows() {
+        detectDuplicates();
+
+        RunStats::Scope scope(stats, "validateRows");
+        DATALOOM_TRACE_SCOPE("validate", "validate rows", {"first_row", static_cast<int64_t>(row_base)},
+                             {"rows", static_cast<int64_t>(data.rowCount())});
+        size_t rows = data.rowCount();
+        if (plan.curp >= 0) {
+            curp_classes.resize(rows);
+        } else {
+            curp_classes.clear();
+        }
+
+        size_t chunks = (rows + kRowsPerChunk - 1) / kRowsPerChunk;
+        if (thread_count <= 1 || chunks <= 1) {
+            validateRange(0, rows);
+            if (row_cache) flushCacheRecords();
+            accumulateSummary();
+            return;
+        }
+
+        // Commit in waves so buffered log lines stay bounded on large inputs
+        size_t wave = thread_count * 8;
+        for (size_t first = 0; first < chunks; first += wave) {
+            size_t count = std::min(wave, chunks - first);
+            std::vector<ChunkResult> results(count);
+
+            parallelFor(count, [&](size_t c) {
+                ChunkResult& result = results[c];
+                LogManager::Capture capture(result.log_lines);
+                active_chunk = &result;
+                size_t begin = (first + c) * kRowsPerChunk;
+                validateRange(begin, std::min(rows, begin + kRowsPerChunk));
+                active_chunk = nullptr;
+            });
+
+            DATALOOM_TRACE_SCOPE("validate", "commit blocks", {"blocks", static_cast<int64_t>(count)});
+            for (auto& result : results) {
+                if (stats) stats->samples.merge(result.samples);
+                logger->replay(result.log_lines);
+                data.arena.absorb(std::move(result.arena));
+                data.errors.append(std::move(result.errors));
+                if (row_cache) row_cache->append(result.cache_records, result.cache_record_count);
+            }
+        }
+        accumulateSummary();
+    }
+
+    // Validate local rows [begin, end), classifying their CURPs in one batch first
+    void validateRange(size_t begin, size_t end) {
+        DATALOOM_TRACE_SCOPE("validate", "validate block", {"first_row", static_cast<int64_t>(row_base + begin)},
+                             {"rows", static_cast<int64_t>(end - begin)});
+        if (!curp_classes.empty()) {
+            IdClasses::classifyColumn(data.columns[plan.curp], begin, end, curp_classes.data() + begin);
+        }
+        if (row_cache) {
+            validateRangeCached(begin, end);
+            return;
+        }
+        RunStats::Samples* samples = activeSamples();
+        if (samples) samples->validated_rows += end - begin;
+        for (size_t i = begin; i < end; ++i) {
+            validateRow(row_base + i, sampleRow(samples, row_base + i));
+        }
+    }
+
+    // Where the validator samples of the calling thread go, or null without --stats
+    RunStats::Samples* activeSamples() const {
+        if (!stats) return nullptr;
+        return active_chunk ? &active_chunk->samples : &stats->samples;
+    }
+
+    static RunStats::Samples* sampleRow(RunStats::Samples* samples, size_t row_idx) {
+        return samples && row_idx % RunStats::kSampleEvery == 0 ? samples : nullptr;
+    }
+
+    // validateRange through the revalidation cache: rows with a record are
+    // replayed, the rest are validated with their output captured into a new
+    // record. Rows whose log lines cannot be replayed are left out of the cache.
+    void validateRangeCached(size_t begin, size_t end) {
+        std::string& records = active_chunk ? active_chunk->cache_records : cache_records;
+        size_t& record_count = active_chunk ? active_chunk->cache_record_count : cache_record_count;
+        const ErrorStore& errors = active_chunk ? active_chunk->errors : data.errors;
+        RowCache::CachedRow cached;
+        std::vector<std::string_view> before(data.columns.size());
+        std::string lines;
+        std::string stripped;
+        size_t hits = 0;
+        RunStats::Samples* samples = activeSamples();
+        for (size_t i = begin; i < end; ++i) {
+            if (!active_chunk && records.size() >= kCacheFlushBytes) {
+                flushCacheRecords();
+            }
+            size_t row_idx = row_base + i;
+            uint64_t key = rowCacheKey(i);
+            std::string_view record = row_cache->find(key);
+            if (!record.empty() && RowCache::parse(record, cached)) {
+                applyCachedRow(row_idx, cached);
+                records.append(record);
+                record_count++;
+                hits++;
+                continue;
+            }
+
+            for (size_t j = 0; j < before.size(); ++j) {
+                before[j] = data.columns[j][i];
+            }
+            size_t first_error = errors.entries.size();
+            lines.clear();
+            {
+                LogManager::Capture capture(lines);
+                validateRow(row_idx, sampleRow(samples, row_idx));
+            }
+            if (samples) samples->validated_rows++;
+            logger->replay(lines);
+
+            cached.clear();
+            stripped.clear();
+            if (!LogManager::stripRowPrefix(row_idx, lines, stripped)) continue;
+            cached.status = data.row_status[i];
+            for (size_t j = 0; j < before.size(); ++j) {
+                std::string_view after = data.columns[j][i];
+                if (after.data() != before[j].data() || after.size() != before[j].size()) {
+                    cached.cells.emplace_back(static_cast<uint32_t>(j), after);
+                }
+            }
+            for (size_t k = first_error; k < errors.entries.size(); ++k) {
+                const auto& entry = errors.entries[k];
+                cached.errors.push_back({entry.col, entry.code, entry.arg_count, cached.args.size()});
+                errors.appendArguments(cached.args, entry);
+            }
+            cached.log = stripped;
+            RowCache::appendRecord(records, key, cached);
+            record_count++;
+        }
+        cache_hits += hits;
+    }
+
+    // Single-threaded validation streams its records out as it goes
+    void flushCacheRecords() {
+        row_cache->append(cache_records, cache_record_count);
+        cache_records.clear();
+        cache_record_count = 0;
+    }
+
+    // Revalidation cache key: the row's cells plus its duplicate flags, which
+    // depend on the rest of the input
+    uint64_t rowCacheKey(size_t i) const {
+        uint64_t key = 0;
+        for (const auto& column : data.columns) {
+            key = hashBytes(column[i], key);
+        }
+        if (dedup_width > 0) {
+            const char* flags = reinterpret_cast<const char*>(duplicate_flags.data() + i * dedup_width);
+            key = hashBytes(std::string_view(flags, dedup_width), key);
+        }
+        return key;
+    }
+
+    void applyCachedRow(size_t row_idx, const RowCache::CachedRow& cached) {
+        if (cached.status == RowStatus::Problematic) {
+            markProblematic(row_idx);
+        }
+        for (const auto& [col, value] : cached.cells) {
+            if (col < data.columns.size()) setCell(row_idx, col, value);
+        }
+        for (const auto& error : cached.errors) {
+            addError(row_idx, error.col, error.code, cached.args.data() + error.arg_begin, error.arg_count);
+        }
+        logger->log_row_lines(row_idx, cached.log);
+    }
+
+    // Run task(0) .. task(count - 1) on up to thread_count threads. Without
+    // a batch pool the processor starts its own on first use and keeps it;
+    // the calling thread runs tasks too, so it has thread_count - 1 workers.
+    void parallelFor(size_t count, const std::function<void(size_t)>& task) {
+        if (!pool && thread_count > 1 && count > 1) {
+            own_pool = std::make_unique<WorkStealingPool>(thread_count - 1);
+            pool = own_pool.get();
+        }
+        if (!pool) {
+            for (size_t i = 0; i < count; ++i) task(i);
+            return;
+        }
+        pool->parallelFor(count, task);
+    }
+
+    // Resolve duplicate control numbers and CURPs for the rows in memory before
+    // the row validators run. Keys are bucketed by shard in parallel, then every
+    // shard replays its keys in row order, so the first occurrence still wins.
+    // A first occurrence that an earlier run accepted is flagged as History.
+    void detectDuplicates() {
+        RunStats::Scope scope(stats, "detectDuplicates");
+        DATALOOM_TRACE_SCOPE("dedup", "detect duplicates", {"first_row", static_cast<int64_t>(row_base)},
+                             {"rows", static_cast<int64_t>(data.rowCount())});
+        dedup_slot.assign(plan.columns.size(), -1);
+        std::vector<size_t>& cols = dedup_columns;
+        std::vector<ShardedKeySet*>& sets = dedup_sets;
+        cols.clear();
+        sets.clear();
+        for (size_t j = 0; j < plan.columns.size(); ++j) {
+            FieldKind kind = plan.columns[j];
+            if (kind == FieldKind::ControlNumber || kind == FieldKind::CURP) {
+                dedup_slot[j] = static_cast<int>(cols.size());
+                cols.push_back(j);
+                if (shared_keys) {
+                    sets.push_back(kind == FieldKind::ControlNumber ? &shared_keys->control_numbers : &shared_keys->curps);
+                } else {
+                    sets.push_back(kind == FieldKind::ControlNumber ? &control_number_set : &curp_set);
+                }
+            }
+        }
+
+        size_t rows = data.rowCount();
+        dedup_width = cols.size();
+        duplicate_flags.assign(rows * dedup_width, 0);
+        if (cols.empty() || rows == 0) {
+            if (shared_keys) shared_keys->finish(shared_file);
+            return;
+        }
+
+        size_t chunks = (rows + kRowsPerChunk - 1) / kRowsPerChunk;
+        std::vector<std::array<std::vector<uint32_t>, ShardedKeySet::kShards>> buckets(chunks);
+        parallelFor(chunks, [&](size_t c) {
+            size_t begin = c * kRowsPerChunk;
+            size_t end = std::min(rows, begin + kRowsPerChunk);
+            DATALOOM_TRACE_SCOPE("dedup", "bucket keys", {"first_row", static_cast<int64_t>(row_base + begin)},
+                                 {"rows", static_cast<int64_t>(end - begin)});
+            for (size_t i = begin; i < end; ++i) {
+                for (size_t k = 0; k < cols.size(); ++k) {
+                    std::string_view key = data.columns[cols[k]][i];
+                    if (key.empty()) continue;  // Empty values are reported, not deduplicated
+                    buckets[c][sets[k]->shardOf(key)].push_back(static_cast<uint32_t>((i - begin) * dedup_width + k));
+                }
+            }
+        });
+
+        // Files sharing sets take their turn here, in batch order
+        if (shared_keys) {
+            SharedKeySets& keys = *shared_keys;
+            size_t file = shared_file;
+            DATALOOM_TRACE_SCOPE("dedup", "wait for turn", {"file", static_cast<int64_t>(file)});
+            pool->helpUntil([&keys, file] { return keys.isTurnOf(file); });
+        }
+        parallelFor(ShardedKeySet::kShards, [&](size_t shard) {
+            DATALOOM_TRACE_SCOPE("dedup", "check shard", {"shard", static_cast<int64_t>(shard)});
+            for (size_t c = 0; c < chunks; ++c) {
+                for (uint32_t offset : buckets[c][shard]) {
+                    size_t slot = c * kRowsPerChunk * dedup_width + offset;
+                    size_t i = slot / dedup_width;
+                    size_t k = slot % dedup_width;
+                    std::string_view key = data.columns[cols[k]][i];
+                    DuplicateSource source = DuplicateSource::None;
+                    if (sets[k]->checkAndInsert(shard, key)) {
+                        source = DuplicateSource::Input;
+                    } else if (history && history->contains(sets[k]->keyPacking(), key)) {
+                        source = DuplicateSource::History;
+                    }
+                    duplicate_flags[slot] = static_cast<uint8_t>(source);
+                }
+            }
+        });
+        if (shared_keys) shared_keys->finish(shared_file);
+    }
+
+    DuplicateSource duplicateSource(size_t row_idx, size_t col_idx) const {
+        int slot = dedup_slot[col_idx];
+        if (slot < 0) return DuplicateSource::None;
+        return static_cast<DuplicateSource>(duplicate_flags[(row_idx - row_base) * dedup_width + slot]);
+    }
+
+    // Queue the dedup keys of the rows that passed validation for the history
+    // index; run before text options so the raw keys are recorded
+    void recordAcceptedKeys() {
+        RunStats::Scope scope(stats, "recordAcceptedKeys");
+        DATALOOM_TRACE_SCOPE("dedup", "record accepted keys");
+        for (size_t i = 0; i < data.rowCount(); ++i) {
+            if (data.row_status[i] == RowStatus::Problematic) continue;
+            for (size_t k = 0; k < dedup_columns.size(); ++k) {
+                std::string_view key = data.columns[dedup_columns[k]][i];
+                if (!key.empty()) history->record(dedup_sets[k]->keyPacking(), key);
+            }
+        }
+    }
+
+    void markProblematic(size_t row_idx) {
+        // Each row owns its status byte, so chunks can mark rows without locking
+        data.row_status[row_idx - row_base] = RowStatus::Problematic;
+    }
+
+    // With sample set, the validators' time is added to it (--stats)
+    void validateRow(size_t i, RunStats::Samples* sample = nullptr) {
+        RowView row = rowAt(i);
+        uint64_t started = sample ? RunStats::nanoseconds() : 0;
+        
+        // Validate each field with the validator its column was bound to
+        for (size_t j = 0; j < plan.columns.size() && j < row.size(); ++j) {
+            std::string_view value = row[j];
             
-            int nombres_idx = -1, a_paterno_idx = -1, a_materno_idx = -1;
+            const FieldRule& rule = *plan.rules[j];
             
-            // Validate each field based on header position
-            for (size_t j = 0; j < data.headers.size() && j < row.size(); ++j) {
-                std::string header = data.headers[j];
-                std::string value = row[j];
-                
-                if (header == "ctr") {
-                    validateControlNumber(value, i, j);
-                } else if (header == "cur") {
-                    validateCURP(value, i, j);
-                    curp_value = value;
-                } else if (header == "nom") {
-                    validateName(value, i, j, "Name");
-                    nombres_value = value;
-                    nombres_idx = j;
-                } else if (header == "app") {
-                    validateLastName(value, i, j, "Paternal Last Name");
-                    a_paterno_value = value;
-                    a_paterno_idx = j;
-                } else if (header == "apm") {
+            switch (plan.columns[j]) {
+                case FieldKind::ControlNumber: validateControlNumber(value, i, j, rule); break;
+                case FieldKind::CURP: validateCURP(value, i, j); break;
+                case FieldKind::Name: validateName(value, i, j, rule); break;
+                case FieldKind::PaternalLastName: validateLastName(value, i, j, rule); break;
+                case FieldKind::MaternalLastName:
                     // Maternal last name can be empty, but if not empty, validate
                     if (!value.empty()) {
-                        validateName(value, i, j, "Maternal Last Name");
+                        validateName(value, i, j, rule);
                     }
-                    a_materno_value = value;
-                    a_materno_idx = j;
-                } else if (header == "sem") {
-                    validateSemester(value, i, j);
-                } else if (header == "sex") {
-                    validateGender(value, i, j);
-                } else if (header == "psa1") {
-                    validateAverage(value, i, j, "Current Average");
-                } else if (header == "pge") {
-                    validateAverage(value, i, j, "General Average");
-                } else if (header == "cac") {
-                    validateCredits(value, i, j);
-                } else if (header == "res") {
-                    validateYesNo(value, i, j, "Professional Residences");
-                } else if (header == "ema") {
-                    validateEmail(value, i, j);
-                } else if (header == "rfc") {
-                    validateRFC(value, i, j);
-                } else if (header == "cel") {
-                    validatePhone(value, i, j);
-                } else if (header == "dis") {
-                    validateYesNo(value, i, j, "Disability");
-                } else if (header == "tipo_discapacidad") {
-                    validateDisabilityType(value, i, j);
-                } else if (header == "lengua_indigena") {
-                    validateYesNo(value, i, j, "Indigenous Language");
-                } else if (header == "reingreso") {
-                    validateYesNo(value, i, j, "Re-entry");
-                } else if (header == "movilidad") {
-                    
-                }
+                    break;
+                case FieldKind::Integer: validateInteger(value, i, j, rule); break;
+                case FieldKind::Gender: validateGender(value, i, j, rule); break;
+                case FieldKind::Decimal:
+                case FieldKind::CurrentAverage:
+                case FieldKind::GeneralAverage: validateAverage(value, i, j, rule); break;
+                case FieldKind::Credits: validateCredits(value, i, j, rule); break;
+                case FieldKind::YesNo:
+                case FieldKind::Disability:
+                case FieldKind::Reentry: validateYesNo(value, i, j, rule); break;
+                case FieldKind::Email: validateEmail(value, i, j, rule); break;
+                case FieldKind::RFC: validateRFC(value, i, j, rule); break;
+                case FieldKind::Phone: validatePhone(value, i, j, rule); break;
+                case FieldKind::DisabilityType: validateDisabilityType(value, i, j, rule); break;
+                case FieldKind::None:
+                    break;
             }
-            
-            // Cross-field validations
-            validateCrossFieldRules(i);
-            
-            // Validate names with CURP
-            if (!curp_value.empty()) {
-                if (!nombres_value.empty() && nombres_idx != -1) {
-                    validateNameWithCURP(nombres_value, curp_value, i, nombres_idx);
-                }
-                if (!a_paterno_value.empty() && a_paterno_idx != -1) {
-                    validatePaternalLastNameWithCURP(a_paterno_value, curp_value, i, a_paterno_idx);
-                }
-                if (a_materno_idx != -1) {
-                    validateMaternalLastNameWithCURP(a_materno_value, curp_value, i, a_materno_idx);
-                }
+            if (sample) lap(sample->field_ns[static_cast<size_t>(plan.columns[j])], started);
+        }
+        
+        // Cross-field validations
+        validateCrossFieldRules(i);
+        if (sample) lap(sample->cross_field_ns, started);
+        
+        // Validate names with CURP (validators never modify these columns, so
+        // the cells still hold the values checked above)
+        std::string_view curp_value = plan.curp >= 0 ? row[plan.curp] : std::string_view();
+        if (!curp_value.empty()) {
+            if (plan.name >= 0 && !row[plan.name].empty()) {
+                validateNameWithCURP(row[plan.name], curp_value, i, plan.name);
+            }
+            if (plan.paternal >= 0 && !row[plan.paternal].empty()) {
+                validatePaternalLastNameWithCURP(row[plan.paternal], curp_value, i, plan.paternal);
+            }
+            if (plan.maternal >= 0) {
+                validateMaternalLastNameWithCURP(row[plan.maternal], curp_value, i, plan.maternal);
             }
         }
-        
-        printValidationSummary();
+        if (sample) {
+            lap(sample->name_curp_ns, started);
+            sample->sampled_rows++;
+        }
+    }
+
+    // Add the time since started to total and restart the clock
+    static void lap(uint64_t& total, uint64_t& started) {
+        uint64_t now = RunStats::nanoseconds();
+        total += now - started;
+        started = now;
     }
 
-    void validateControlNumber(const std::string& value, size_t row_idx, size_t col_idx) {
+    void validateControlNumber(std::string_view value, size_t row_idx, size_t col_idx, const FieldRule& rule) {
         if (value.empty()) {
-            addError(row_idx, col_idx, "Control number cannot be empty");
+            addError(row_idx, col_idx, ErrorCode::ControlNumberEmpty);
             logger->log_warning(row_idx, "Control number is empty");
             return;
         }
         
         // Check length (typical control numbers are 8-12 digits)
-        if (value.length() < 8 || value.length() > 12) {
-            addError(row_idx, col_idx, "Control number should be 8-12 digits");
-            logger->log_warning(row_idx, "Control number length invalid: " + value);
+        if (value.length() < rule.min_length || value.length() > rule.max_length) {
+            addError(row_idx, col_idx, ErrorCode::ControlNumberLength, 
+                     {std::to_string(rule.min_length), std::to_string(rule.max_length)});
+            logger->log_warning(row_idx, {"Control number length invalid: ", value});
         }
         
-        // Check for duplicates
-        if (control_number_set.find(value) != control_number_set.end()) {
-            addError(row_idx, col_idx, "Duplicate control number found");
-            logger->log_warning(row_idx, "Duplicate control number: " + value);
-        } else {
-            control_number_set.insert(value);
+        // Check for duplicates (resolved up front by detectDuplicates)
+        DuplicateSource duplicate = duplicateSource(row_idx, col_idx);
+        if (duplicate == DuplicateSource::Input) {
+            addError(row_idx, col_idx, ErrorCode::ControlNumberDuplicate);
+            logger->log_warning(row_idx, {"Duplicate control number: ", value});
+        } else if (duplicate == DuplicateSource::History) {
+            addError(row_idx, col_idx, ErrorCode::ControlNumberInHistory);
+            logger->log_warning(row_idx, {"Control number accepted in an earlier batch: ", value});
         }
     }
 
-    void validateCURP(const std::string& value, size_t row_idx, size_t col_idx) {
+    void validateCURP(std::string_view value, size_t row_idx, size_t col_idx) {
         bool has_curp_error = false;
 
         if (value.empty()) {
-            addError(row_idx, col_idx, "CURP cannot be empty");
+            addError(row_idx, col_idx, ErrorCode::CurpEmpty);
             has_curp_error = true;
             logger->log_error(row_idx, "CURP is empty");
-            problematic_rows.push_back(row_idx);
+            markProblematic(row_idx);
             return;
         }
         
-        // Check for duplicates
-        if (curp_set.find(value) != curp_set.end()) {
-            addError(row_idx, col_idx, "Duplicate CURP found");
+        // Check for duplicates (resolved up front by detectDuplicates)
+        DuplicateSource duplicate = duplicateSource(row_idx, col_idx);
+        if (duplicate == DuplicateSource::Input) {
+            addError(row_idx, col_idx, ErrorCode::CurpDuplicate);
             has_curp_error = true;
-            logger->log_warning(row_idx, "Duplicate CURP: " + value);
-        } else {
-            curp_set.insert(value);
+            logger->log_warning(row_idx, {"Duplicate CURP: ", value});
+        } else if (duplicate == DuplicateSource::History) {
+            addError(row_idx, col_idx, ErrorCode::CurpInHistory);
+            has_curp_error = true;
+            logger->log_warning(row_idx, {"CURP accepted in an earlier batch: ", value});
         }
         
         // Basic CURP structure validation (18 characters, alphanumeric)
         if (value.length() != 18) {
-            addError(row_idx, col_idx, "CURP must be exactly 18 characters");
-            logger->log_warning(row_idx, "CURP length invalid: " + 
-                               std::to_string(value.length()) + " (should be 18)");
+            addError(row_idx, col_idx, ErrorCode::CurpLength);
+            LogManager::Number length(value.length());
+            logger->log_warning(row_idx, {"CURP length invalid: ", length.view(), " (should be 18)"});
         }
-        
-        if (!std::all_of(value.begin(), value.end(), [](char c) {
-            return std::isalnum(c);
-        })) {
-            addError(row_idx, col_idx, "CURP contains invalid characters");
+
+        // Position classes come from the batch pass over the CURP column when
+        // there was one
+        IdClasses classes = (static_cast<int>(col_idx) == plan.curp && !curp_classes.empty()) ? 
+            curp_classes[row_idx - row_base] : IdClasses::classify(value);
+        bool all_alnum = value.length() <= 32 ? IdClasses::all(classes.alnum(), 0, static_cast<int>(value.length())) :
+            std::all_of(value.begin(), value.end(), isAsciiAlnum);
+        if (!all_alnum) {
+            addError(row_idx, col_idx, ErrorCode::CurpCharacters);
             has_curp_error = true;
             logger->log_warning(row_idx, "CURP contains invalid characters");
         }
         
-        // Validate CURP format: 4 letters, 6 digits, 1 letter, 1 digit, 1 letter, 4 digits
+        // Validate CURP format: 4 letters, 6 digits, 2 letters, 4 + 2 alphanumerics
         if (value.length() == 18 && !has_curp_error) {
-            // First 4 characters should be letters
-            for (int i = 0; i < 4; i++) {
-                if (!std::isalpha(value[i])) {
-                    addError(row_idx, col_idx, "CURP format invalid: first 4 characters should be letters");
-                    logger->log_warning(row_idx, "CURP first 4 chars should be letters");
-                    break;
-                }
-            }
-            
-            // Next 6 characters should be digits (birth date)
-            for (int i = 4; i < 10; i++) {
-                if (!std::isdigit(value[i])) {
-                    addError(row_idx, col_idx, "CURP format invalid: characters 5-10 should be digits (birth date)");
-                    logger->log_warning(row_idx, "CURP date should be digits");
-                    break;
-                }
-            }
-            
-            // Character 11 should be a letter (gender)
-            if (!std::isalpha(value[10])) {
-                addError(row_idx, col_idx, "CURP format invalid: character 11 should be a letter (gender)");
-                logger->log_warning(row_idx, "CURP gender should be letter");
-            }
-            
-            // Character 12 should be a letter (state)
-            if (!std::isalpha(value[11])) {
-                addError(row_idx, col_idx, "CURP format invalid: character 12 should be a letter (state)");
-                logger->log_warning(row_idx, "CURP state should be letter");
-            }
-            
-            // Characters 13-16 should be alphanumeric
-            for (int i = 12; i < 16; i++) {
-                if (!std::isalnum(value[i])) {
-                    addError(row_idx, col_idx, "CURP format invalid: characters 13-16 should be alphanumeric");
-                    logger->log_warning(row_idx, "CURP characters 13-16 invalid");
-                    break;
-                }
-            }
-            
-            // Last 2 characters should be digits
-            for (int i = 16; i < 18; i++) {
-                if (!std::isalnum(value[i])) {
-                    addError(row_idx, col_idx, "CURP format invalid: last 2 characters should be digits");
-                    logger->log_warning(row_idx, "CURP last 2 chars should be digits");
-                    break;
-                }
-            }
+            reportSegments(kCurpFormat, kCurpFormat.pattern.violations(value, classes), 0, 
+                           kCurpFormat.pattern.segmentCount(), row_idx, col_idx);
         }
 
         if (has_curp_error){
-            problematic_rows.push_back(row_idx);
+            markProblematic(row_idx);
         }
     }
 
-    void validateName(const std::string& value, size_t row_idx, size_t col_idx, const std::string& field_name) {
+    void validateName(std::string_view value, size_t row_idx, size_t col_idx, const FieldRule& rule) {
+        const std::string& field_name = rule.label;
         if (value.empty()) {
-            addError(row_idx, col_idx, field_name + " cannot be empty");
-            logger->log_warning(row_idx, field_name + " is empty");
+            addError(row_idx, col_idx, ErrorCode::FieldEmpty, {field_name});
+            logger->log_warning(row_idx, {field_name, " is empty"});
             return;
         }
         
@@ -549,8 +6926,8 @@ private:
         for (size_t i = 0; i < value.length(); i++) {
             unsigned char c = value[i];
             
-            // Basic ASCII letters and punctuation
-            if (std::isalpha(c) || std::isspace(c) || c == '.' || c == '-' || c == '\'') {
+            // Basic ASCII letters and punctuation (the rule's character class)
+            if (rule.chars[c]) {
                 continue;
             }
             
@@ -585,31 +6962,31 @@ private:
         }
         
         if (has_invalid_chars) {
-            addError(row_idx, col_idx, field_name + " contains invalid characters");
-            logger->log_warning(row_idx, field_name + " contains invalid characters");
+            addError(row_idx, col_idx, ErrorCode::NameCharacters, {field_name});
+            logger->log_warning(row_idx, {field_name, " contains invalid characters"});
         }
         
         // Check minimum length
-        if (value.length() < 2) {
-            addError(row_idx, col_idx, field_name + " is too short");
-            logger->log_warning(row_idx, field_name + " is too short");
+        if (value.length() < rule.min_length) {
+            addError(row_idx, col_idx, ErrorCode::NameTooShort, {field_name});
+            logger->log_warning(row_idx, {field_name, " is too short"});
             return;
         }
         
         // Check for excessive repeated letters (3 or more consecutive identical letters)
         if (hasExcessiveRepeatedLetters(value)) {
-            addError(row_idx, col_idx, field_name + " contains excessive repeated letters");
-            logger->log_warning(row_idx, field_name + " has excessive repeated letters");
+            addError(row_idx, col_idx, ErrorCode::NameRepeatedLetters, {field_name});
+            logger->log_warning(row_idx, {field_name, " has excessive repeated letters"});
         }
         
         // Check for numbers in names
         if (containsNumbers(value)) {
-            addError(row_idx, col_idx, field_name + " contains numbers");
-            logger->log_warning(row_idx, field_name + " contains numbers");
+            addError(row_idx, col_idx, ErrorCode::NameDigits, {field_name});
+            logger->log_warning(row_idx, {field_name, " contains numbers"});
         }
     }
     
-    bool hasExcessiveRepeatedLetters(const std::string& str) {
+    bool hasExcessiveRepeatedLetters(std::string_view str) {
         if (str.length() < 3) return false;
             
         for (size_t i = 0; i < str.length() - 2; i++) {
@@ -624,7 +7001,7 @@ private:
         return false;
     }
         
-    bool containsNumbers(const std::string& str) {
+    bool containsNumbers(std::string_view str) {
         for (char c : str) {
             if (std::isdigit(c)) {
                 return true;
@@ -633,7 +7010,7 @@ private:
         return false;
     }
 
-    void validateNameWithCURP(const std::string& nombres_value, const std::string& curp_value, 
+    void validateNameWithCURP(std::string_view nombres_value, std::string_view curp_value, 
                          size_t row_idx, size_t nombres_col_idx) {
         if (nombres_value.empty() || curp_value.empty() || curp_value.length() < 4) {
             return;
@@ -641,11 +7018,11 @@ private:
         
         // Get the first character of the first name
         char first_char_nombre = ' ';
-        std::string first_name = nombres_value;
+        std::string_view first_name = nombres_value;
         
         // Extract first name if there are multiple names
         size_t space_pos = first_name.find(' ');
-        if (space_pos != std::string::npos) {
+        if (space_pos != std::string_view::npos) {
             first_name = first_name.substr(0, space_pos);
         }
         
@@ -662,18 +7039,15 @@ private:
         // Validate: 4th CURP character should match first name initial or be 'X'
         if (first_char_nombre != ' ') {
             if (fourth_char_curp != first_char_nombre && fourth_char_curp != 'X') {
-                addError(row_idx, nombres_col_idx, 
-                        "First name initial '" + std::string(1, first_char_nombre) + 
-                        "' doesn't match CURP 4th character '" + std::string(1, fourth_char_curp) + 
-                        "' (should match or be 'X')");
-                logger->log_warning(row_idx, "Name-CURP mismatch: '" + 
-                                   std::string(1, first_char_nombre) + "' vs '" + 
-                                   std::string(1, fourth_char_curp) + "'");
+                addError(row_idx, nombres_col_idx, ErrorCode::FirstNameCurpMismatch, 
+                         {std::string_view(&first_char_nombre, 1), std::string_view(&fourth_char_curp, 1)});
+                logger->log_warning(row_idx, {"Name-CURP mismatch: '", std::string_view(&first_char_nombre, 1), "' vs '",
+                                              std::string_view(&fourth_char_curp, 1), "'"});
             }
         }
     }
 
-    void validatePaternalLastNameWithCURP(const std::string& a_paterno_value, const std::string& curp_value, 
+    void validatePaternalLastNameWithCURP(std::string_view a_paterno_value, std::string_view curp_value, 
                                         size_t row_idx, size_t a_paterno_col_idx) {
         if (a_paterno_value.empty() || curp_value.empty() || curp_value.length() < 2) {
             return;
@@ -719,22 +7093,20 @@ private:
         
         // Validate: First CURP character should match first letter of paternal last name
         if (first_char_paterno != ' ' && first_char_curp != first_char_paterno) {
-            addError(row_idx, a_paterno_col_idx, 
-                    "Paternal last name first letter '" + std::string(1, first_char_paterno) + 
-                    "' doesn't match CURP 1st character '" + std::string(1, first_char_curp) + "'");
+            addError(row_idx, a_paterno_col_idx, ErrorCode::PaternalCurpMismatch, 
+                     {std::string_view(&first_char_paterno, 1), std::string_view(&first_char_curp, 1)});
             logger->log_warning(row_idx, "Paternal last name-CURP mismatch");
         }
         
         // Validate: Second CURP character should match first vowel of paternal last name (or 'X')
         if (first_vowel_paterno != ' ' && second_char_curp != first_vowel_paterno) {
-            addError(row_idx, a_paterno_col_idx, 
-                    "Paternal last name first vowel '" + std::string(1, first_vowel_paterno) + 
-                    "' doesn't match CURP 2nd character '" + std::string(1, second_char_curp) + "'");
+            addError(row_idx, a_paterno_col_idx, ErrorCode::PaternalVowelCurpMismatch, 
+                     {std::string_view(&first_vowel_paterno, 1), std::string_view(&second_char_curp, 1)});
             logger->log_warning(row_idx, "Paternal last name vowel-CURP mismatch");
         }
     }
 
-    void validateMaternalLastNameWithCURP(const std::string& a_materno_value, const std::string& curp_value, 
+    void validateMaternalLastNameWithCURP(std::string_view a_materno_value, std::string_view curp_value, 
                                         size_t row_idx, size_t a_materno_col_idx) {
         if (curp_value.empty() || curp_value.length() < 3) {
             return;
@@ -760,134 +7132,151 @@ private:
         if (a_materno_value.empty()) {
             // If no maternal last name, CURP should use 'X'
             if (third_char_curp != 'X') {
-                addError(row_idx, a_materno_col_idx, 
-                        "No maternal last name but CURP 3rd character is '" + std::string(1, third_char_curp) + 
-                        "' (should be 'X')");
+                addError(row_idx, a_materno_col_idx, ErrorCode::MaternalMissingCurp, 
+                         {std::string_view(&third_char_curp, 1)});
                 logger->log_warning(row_idx, "No maternal last name but CURP not 'X'");
             }
         } else {
             // If maternal last name exists, should match first letter or be 'X'
             if (first_char_materno != ' ' && third_char_curp != first_char_materno && third_char_curp != 'X') {
-                addError(row_idx, a_materno_col_idx, 
-                        "Maternal last name first letter '" + std::string(1, first_char_materno) + 
-                        "' doesn't match CURP 3rd character '" + std::string(1, third_char_curp) + 
-                        "' (should match or be 'X')");
+                addError(row_idx, a_materno_col_idx, ErrorCode::MaternalCurpMismatch, 
+                         {std::string_view(&first_char_materno, 1), std::string_view(&third_char_curp, 1)});
                 logger->log_warning(row_idx, "Maternal last name-CURP mismatch");
             }
         }
     }
 
-    void validateLastName(const std::string& value, size_t row_idx, size_t col_idx, const std::string& field_name) {
+    void validateLastName(std::string_view value, size_t row_idx, size_t col_idx, const FieldRule& rule) {
         if (value.empty()) {
-            addError(row_idx, col_idx, "At least one last name is required");
+            addError(row_idx, col_idx, ErrorCode::LastNameRequired);
             logger->log_warning(row_idx, "Last name is required");
             return;
         }
-        validateName(value, row_idx, col_idx, field_name);
+        validateName(value, row_idx, col_idx, rule);
     }
 
-    void validateSemester(const std::string& value, size_t row_idx, size_t col_idx) {
+    // Integer within [rule.min, rule.max], e.g. the semester
+    void validateInteger(std::string_view value, size_t row_idx, size_t col_idx, const FieldRule& rule) {
+        const std::string& field_name = rule.label;
         if (value.empty()) {
-            addError(row_idx, col_idx, "Semester cannot be empty");
-            logger->log_warning(row_idx, "Semester is empty");
+            addError(row_idx, col_idx, ErrorCode::FieldEmpty, {field_name});
+            logger->log_warning(row_idx, {field_name, " is empty"});
             return;
         }
         
         try {
-            int semester = std::stoi(value);
-            if (semester < 1 || semester > 100) {
-                addError(row_idx, col_idx, "Semester must be between 1 and 100");
-                logger->log_warning(row_idx, "Semester out of range: " + value);
+            int number = std::stoi(std::string(value));
+            if (number < rule.min || number > rule.max) {
+                addError(row_idx, col_idx, ErrorCode::OutOfRange, 
+                         {field_name, formatBound(rule.min, false), formatBound(rule.max, false)});
+                logger->log_warning(row_idx, {field_name, " out of range: ", value});
             }
         } catch (...) {
-            addError(row_idx, col_idx, "Semester must be an integer number");
-            logger->log_warning(row_idx, "Semester not integer: " + value);
+            addError(row_idx, col_idx, ErrorCode::NotInteger, {field_name});
+            logger->log_warning(row_idx, {field_name, " not integer: ", value});
+        }
+    }
+
+    // Range bounds in messages: "1 and 100" for integers, "0.0 and 100.0" for decimals
+    static std::string formatBound(double bound, bool decimal) {
+        std::ostringstream out;
+        if (bound == std::floor(bound)) {
+            out << std::fixed << std::setprecision(decimal ? 1 : 0) << bound;
+        } else {
+            out << bound;
         }
+        return out.str();
     }
 
-    void validateGender(const std::string& value, size_t row_idx, size_t col_idx) {
-        std::string original_value = value;
-        std::string corrected_value = value;
+    void validateGender(std::string_view value, size_t row_idx, size_t col_idx, const FieldRule& rule) {
+        std::string_view original_value = value;
+        std::string_view corrected_value = value;
         
         if (value == "M" || value == "m") {
             corrected_value = "H";
-            data.rows[row_idx][col_idx] = "H";
+            setCell(row_idx, col_idx, "H");
             logger->log_auto_correction(row_idx, "Gender", original_value, "H");
         }
         
         if (value == "F" || value == "f") {
             corrected_value = "M";
-            data.rows[row_idx][col_idx] = "M";
+            setCell(row_idx, col_idx, "M");
             logger->log_auto_correction(row_idx, "Gender", original_value, "M");
         }
         
         if (value.empty()) {
-            corrected_value = "H";
-            data.rows[row_idx][col_idx] = "H";
-            addError(row_idx, col_idx, "Gender cannot be empty, Added 'H' by default");
-            logger->log_auto_fill(row_idx, "Gender", "H");
+            setCell(row_idx, col_idx, rule.default_value);
+            addError(row_idx, col_idx, ErrorCode::GenderEmpty, {rule.default_value});
+            logger->log_auto_fill(row_idx, "Gender", rule.default_value);
             return;
         }
         
         if (corrected_value != "H" && corrected_value != "M") {
-            addError(row_idx, col_idx, "Gender must be 'H' or 'M'");
-            logger->log_warning(row_idx, "Invalid gender: " + value);
+            addError(row_idx, col_idx, ErrorCode::GenderInvalid);
+            logger->log_warning(row_idx, {"Invalid gender: ", value});
         }
     }
 
-    void validateAverage(const std::string& value, size_t row_idx, size_t col_idx, const std::string& field_name) {
+    void validateAverage(std::string_view value, size_t row_idx, size_t col_idx, const FieldRule& rule) {
+        const std::string& field_name = rule.label;
         if (value.empty()) {
-            addError(row_idx, col_idx, field_name + " cannot be empty");
-            logger->log_warning(row_idx, field_name + " is empty");
+            addError(row_idx, col_idx, ErrorCode::FieldEmpty, {field_name});
+            logger->log_warning(row_idx, {field_name, " is empty"});
             return;
         }
         
         try {
-            float avg = std::stof(value);
-            if (avg < 0.0f || avg > 100.0f) {
-                addError(row_idx, col_idx, field_name + " must be between 0.0 and 100.0");
-                logger->log_warning(row_idx, field_name + " out of range: " + value);
+            float avg = std::stof(std::string(value));
+            if (avg < rule.min || avg > rule.max) {
+                addError(row_idx, col_idx, ErrorCode::OutOfRange, 
+                         {field_name, formatBound(rule.min, true), formatBound(rule.max, true)});
+                logger->log_warning(row_idx, {field_name, " out of range: ", value});
             }
             // Removed all auto-correction code for decimal places
             
         } catch (...) {
-            addError(row_idx, col_idx, field_name + " must be a valid number (e.g., 89.87)");
-            logger->log_warning(row_idx, field_name + " not a number: " + value);
+            addError(row_idx, col_idx, ErrorCode::NotNumber, {field_name});
+            logger->log_warning(row_idx, {field_name, " not a number: ", value});
         }
     }
 
-    void validateCredits(const std::string& value, size_t row_idx, size_t col_idx) {
+    void validateCredits(std::string_view value, size_t row_idx, size_t col_idx, const FieldRule& rule) {
         if (value.empty()) {
-            addError(row_idx, col_idx, "Accumulated credits cannot be empty");
+            addError(row_idx, col_idx, ErrorCode::FieldEmpty, {"Accumulated credits"});
             logger->log_warning(row_idx, "Credits is empty");
             return;
         }
         
         try {
-            int credits = std::stoi(value);
-            if (credits < 0) {
-                addError(row_idx, col_idx, "Credits cannot be negative");
-                logger->log_warning(row_idx, "Credits negative: " + value);
+            int credits = std::stoi(std::string(value));
+            if (credits < rule.min) {
+                if (rule.min == 0) {
+                    addError(row_idx, col_idx, ErrorCode::CreditsNegative);
+                } else {
+                    addError(row_idx, col_idx, ErrorCode::CreditsBelowMinimum, {formatBound(rule.min, false)});
+                }
+                logger->log_warning(row_idx, {"Credits negative: ", value});
             }
             
             // For new students, credits should be 0
             // This will be validated in cross-field validation
         } catch (...) {
-            addError(row_idx, col_idx, "Credits must be an integer number");
-            logger->log_warning(row_idx, "Credits not integer: " + value);
+            addError(row_idx, col_idx, ErrorCode::NotInteger, {"Credits"});
+            logger->log_warning(row_idx, {"Credits not integer: ", value});
         }
     }
 
-    void validateYesNo(const std::string& value, size_t row_idx, size_t col_idx, const std::string& field_name) {
-        std::string original_value = value;
-        std::string cleaned_value = value;
+    void validateYesNo(std::string_view value, size_t row_idx, size_t col_idx, const FieldRule& rule) {
+        const std::string& field_name = rule.label;
+        std::string_view original_value = value;
+        std::string_view cleaned_value = value;
         
-        // If empty, auto-fill with "N"
+        // If empty, auto-fill with the rule's default ("N")
         if (value.empty()) {
-            cleaned_value = "N";
-            data.rows[row_idx][col_idx] = "N";
-            addError(row_idx, col_idx, field_name + " was empty - auto-filled with 'N'");
-            logger->log_auto_fill(row_idx, field_name, "N");
+            cleaned_value = rule.default_value;
+            setCell(row_idx, col_idx, rule.default_value);
+            addError(row_idx, col_idx, ErrorCode::AutoFilled, {field_name, rule.default_value});
+            logger->log_auto_fill(row_idx, field_name, rule.default_value);
         }
         
         // Trim whitespace
@@ -901,7 +7290,7 @@ private:
         }
         
         // Convert to uppercase for validation
-        std::string uppercase_value = cleaned_value;
+        std::string uppercase_value(cleaned_value);
         std::transform(uppercase_value.begin(), uppercase_value.end(), uppercase_value.begin(), ::toupper);
         
         // Check if valid (S or N)
@@ -909,46 +7298,43 @@ private:
             // Try to correct common variations
             if (uppercase_value == "SI" || uppercase_value == "YES" || uppercase_value == "Y" || uppercase_value == "1") {
                 cleaned_value = "S";
-                data.rows[row_idx][col_idx] = "S";
+                setCell(row_idx, col_idx, "S");
                 logger->log_auto_correction(row_idx, field_name, original_value, "S");
             } else if (uppercase_value == "NO" || uppercase_value == "0") {
                 cleaned_value = "N";
-                data.rows[row_idx][col_idx] = "N";
+                setCell(row_idx, col_idx, "N");
                 logger->log_auto_correction(row_idx, field_name, original_value, "N");
             } else {
-                addError(row_idx, col_idx, field_name + " must be 'S' or 'N' (was: '" + value + "')");
-                logger->log_warning(row_idx, field_name + " invalid: " + value);
+                addError(row_idx, col_idx, ErrorCode::YesNoInvalid, {field_name, value});
+                logger->log_warning(row_idx, {field_name, " invalid: ", value});
             }
         } else if (cleaned_value != uppercase_value) {
             // Auto-correct case if needed
-            data.rows[row_idx][col_idx] = uppercase_value;
+            setCell(row_idx, col_idx, uppercase_value);
             if (original_value != uppercase_value) {
                 logger->log_auto_correction(row_idx, field_name, original_value, uppercase_value);
             }
         }
     }
 
-    void validateEmail(const std::string& value, size_t row_idx, size_t col_idx) {
+    void validateEmail(std::string_view value, size_t row_idx, size_t col_idx, const FieldRule& rule) {
         // Extract control number from the same row
-        std::string control_number = "";
-        for (size_t j = 0; j < data.headers.size(); j++) {
-            if (data.headers[j] == "ctr" && j < data.rows[row_idx].size()) {
-                control_number = data.rows[row_idx][j];
-                break;
-            }
+        std::string control_number;
+        if (plan.control_number >= 0) {
+            control_number = rowAt(row_idx)[plan.control_number];
         }
         
         // Build expected email
-        std::string expected_email = "al" + control_number + "@ite.edu.mx";
+        std::string expected_email = rule.prefix + control_number + rule.suffix;
         std::transform(expected_email.begin(), expected_email.end(), expected_email.begin(), ::tolower);
         
         // Check if empty or incorrect
         if (value.empty() || value != expected_email) {
             // Auto-fix to expected email
-            data.rows[row_idx][col_idx] = expected_email;
+            setCell(row_idx, col_idx, expected_email);
             
             if (value.empty()) {
-                addError(row_idx, col_idx, "Email was empty - auto-filled with " + expected_email);
+                addError(row_idx, col_idx, ErrorCode::EmailAutoFilled, {expected_email});
                 logger->log_auto_fill(row_idx, "Email", expected_email);
             } else {
                 logger->log_auto_correction(row_idx, "Email", value, expected_email);
@@ -956,21 +7342,19 @@ private:
         }
     }
 
-    void validateRFC(const std::string& value, size_t row_idx, size_t col_idx) {
+    void validateRFC(std::string_view value, size_t row_idx, size_t col_idx, const FieldRule& rule) {
         // First, check if empty
         if (value.empty()) {
-            data.rows[row_idx][col_idx] = "XAXX010101000";
-            addError(row_idx, col_idx, "RFC was empty - auto-filled with XAXX010101000");
-            logger->log_auto_fill(row_idx, "RFC", "XAXX010101000");
+            setCell(row_idx, col_idx, rule.default_value);
+            addError(row_idx, col_idx, ErrorCode::RfcEmpty, {rule.default_value});
+            logger->log_auto_fill(row_idx, "RFC", rule.default_value);
             return;
         }
         
         // Clean the value - remove non-printable characters
         std::string cleaned_value;
         for (char c : value) {
-            unsigned char uc = static_cast<unsigned char>(c);
-            if (std::isprint(uc) || std::isalnum(uc) || c == ' ' || 
-                c == '-' || c == '&') {
+            if (isAsciiPrint(c)) {
                 cleaned_value += c;
             }
         }
@@ -981,9 +7365,9 @@ private:
         
         if (start == std::string::npos || cleaned_value.empty()) {
             // After cleaning, it's empty or only whitespace
-            data.rows[row_idx][col_idx] = "XAXX010101000";
-            addError(row_idx, col_idx, "RFC invalid - auto-filled with XAXX010101000");
-            logger->log_auto_fill(row_idx, "RFC (invalid chars)", "XAXX010101000");
+            setCell(row_idx, col_idx, rule.default_value);
+            addError(row_idx, col_idx, ErrorCode::RfcInvalid, {rule.default_value});
+            logger->log_auto_fill(row_idx, "RFC (invalid chars)", rule.default_value);
             return;
         }
         
@@ -991,28 +7375,26 @@ private:
         
         // Check length - use cleaned value
         if (cleaned_value.length() < 10) {
-            data.rows[row_idx][col_idx] = "XAXX010101000";
-            addError(row_idx, col_idx, "RFC invalid length - auto-filled with XAXX010101000");
-            logger->log_auto_fill(row_idx, "RFC (wrong length: " + std::to_string(cleaned_value.length()) + ")", "XAXX010101000");
+            setCell(row_idx, col_idx, rule.default_value);
+            addError(row_idx, col_idx, ErrorCode::RfcLength, {rule.default_value});
+            logger->log_auto_fill(row_idx, "RFC (wrong length: " + std::to_string(cleaned_value.length()) + ")", rule.default_value);
             return;
         }
         
         // Check for valid characters (alphanumeric, hyphen, and ampersand)
         if (!std::all_of(cleaned_value.begin(), cleaned_value.end(), [](char c) {
-            unsigned char uc = static_cast<unsigned char>(c);
-            return std::isalnum(uc) || c == '-' || c == '&';
+            return isAsciiAlnum(c) || c == '-' || c == '&';
         })) {
-            addError(row_idx, col_idx, "RFC contains invalid characters (only letters, numbers, '-', and '&' allowed)");
+            addError(row_idx, col_idx, ErrorCode::RfcCharacters);
             logger->log_warning(row_idx, "RFC invalid characters");
             return;
         }
         
         // Check if all letters are uppercase
         if (!std::all_of(cleaned_value.begin(), cleaned_value.end(), [](char c) {
-            unsigned char uc = static_cast<unsigned char>(c);
-            return !std::isalpha(uc) || std::isupper(uc);
+            return !isAsciiAlpha(c) || isAsciiUpper(c);
         })) {
-            addError(row_idx, col_idx, "RFC must be in uppercase letters");
+            addError(row_idx, col_idx, ErrorCode::RfcLowercase);
             logger->log_warning(row_idx, "RFC not uppercase");
             return;
         }
@@ -1027,172 +7409,107 @@ private:
         }
     }
 
-    void validatePersonaFisicaRFC(const std::string& value, size_t row_idx, size_t col_idx) {
-        // First 4 characters should be letters
-        for (int i = 0; i < 4; i++) {
-            if (!std::isalpha(value[i])) {
-                addError(row_idx, col_idx, "RFC persona física: first 4 characters should be letters");
-                logger->log_warning(row_idx, "RFC first 4 chars not letters");
-                break;
-            }
-        }
-        
-        // Next 6 characters should be digits (date: YYMMDD)
-        for (int i = 4; i < 10; i++) {
-            if (!std::isdigit(value[i])) {
-                addError(row_idx, col_idx, "RFC persona física: characters 5-10 should be digits (date YYMMDD)");
-                logger->log_warning(row_idx, "RFC date not digits");
-                break;
-            }
-        }
-        
-        // Validate date components
-        if (value.length() >= 10) {
-            std::string year_str = value.substr(4, 2);
-            std::string month_str = value.substr(6, 2);
-            std::string day_str = value.substr(8, 2);
-            
-            try {
-                int month = std::stoi(month_str);
-                int day = std::stoi(day_str);
-                
-                // Basic date validation
-                if (month < 1 || month > 12) {
-                    addError(row_idx, col_idx, "RFC: invalid month in date (should be 01-12)");
-                    logger->log_warning(row_idx, "RFC invalid month");
-                }
-                if (day < 1 || day > 31) {
-                    addError(row_idx, col_idx, "RFC: invalid day in date (should be 01-31)");
-                    logger->log_warning(row_idx, "RFC invalid day");
-                }
-            } catch (...) {
-                addError(row_idx, col_idx, "RFC: invalid date format");
-                logger->log_warning(row_idx, "RFC invalid date format");
-            }
-        }
-        
-        // Last 3 characters should be alphanumeric (homoclave)
-        for (int i = 10; i < 13; i++) {
-            if (!std::isalnum(value[i])) {
-                addError(row_idx, col_idx, "RFC persona física: last 3 characters should be alphanumeric (homoclave)");
-                logger->log_warning(row_idx, "RFC homoclave invalid");
-                break;
-            }
-        }
+    // 4 letters, 6 digits (YYMMDD), 3 alphanumerics (homoclave)
+    void validatePersonaFisicaRFC(std::string_view value, size_t row_idx, size_t col_idx) {
+        uint32_t violated = kRfcFisicaFormat.pattern.violations(value, IdClasses::classify(value));
+        reportSegments(kRfcFisicaFormat, violated, 0, 2, row_idx, col_idx);
+        validateRFCDate(value, row_idx, col_idx);
+        reportSegments(kRfcFisicaFormat, violated, 2, 3, row_idx, col_idx);
     }
 
-    void validatePersonaMoralRFC(const std::string& value, size_t row_idx, size_t col_idx) {
-        // First character should be hyphen
-        if (value[0] != '-') {
-            addError(row_idx, col_idx, "RFC persona moral: first character should be '-'");
-            logger->log_warning(row_idx, "RFC should start with '-'");
+    // '-', 3 letters, 6 digits (YYMMDD), 2 alphanumerics (homoclave)
+    void validatePersonaMoralRFC(std::string_view value, size_t row_idx, size_t col_idx) {
+        uint32_t violated = kRfcMoralFormat.pattern.violations(value, IdClasses::classify(value));
+        if (violated & 1) {
+            reportSegments(kRfcMoralFormat, violated, 0, 1, row_idx, col_idx);
             return;
         }
-        
-        // Next 3 characters should be letters
-        for (int i = 1; i < 4; i++) {
-            if (!std::isalpha(value[i])) {
-                addError(row_idx, col_idx, "RFC persona moral: characters 2-4 should be letters");
-                logger->log_warning(row_idx, "RFC characters 2-4 not letters");
-                break;
+        reportSegments(kRfcMoralFormat, violated, 1, 3, row_idx, col_idx);
+        validateRFCDate(value, row_idx, col_idx);
+        reportSegments(kRfcMoralFormat, violated, 3, 4, row_idx, col_idx);
+    }
+
+    // One error and warning per violated segment in [first, last), in order
+    void reportSegments(const IdFormat& format, uint32_t violated, int first, int last, size_t row_idx, size_t col_idx) {
+        for (int s = first; s < last; ++s) {
+            if (violated & (uint32_t(1) << s)) {
+                addError(row_idx, col_idx, format.checks[s].code);
+                logger->log_warning(row_idx, format.checks[s].warning);
             }
         }
-        
-        // Next 6 characters should be digits (date: YYMMDD)
-        for (int i = 4; i < 10; i++) {
-            if (!std::isdigit(value[i])) {
-                addError(row_idx, col_idx, "RFC persona moral: characters 5-10 should be digits (date YYMMDD)");
-                logger->log_warning(row_idx, "RFC date not digits");
-                break;
-            }
+    }
+
+    // Month (characters 7-8) must be 01-12 and day (characters 9-10) 01-31
+    void validateRFCDate(std::string_view value, size_t row_idx, size_t col_idx) {
+        int month = 0;
+        int day = 0;
+        if (!parseDatePart(value[6], value[7], month) || !parseDatePart(value[8], value[9], day)) {
+            addError(row_idx, col_idx, ErrorCode::RfcDateFormat);
+            logger->log_warning(row_idx, "RFC invalid date format");
+            return;
         }
-        
-        // Validate date components
-        if (value.length() >= 10) {
-            std::string year_str = value.substr(4, 2);
-            std::string month_str = value.substr(6, 2);
-            std::string day_str = value.substr(8, 2);
-            
-            try {
-                int month = std::stoi(month_str);
-                int day = std::stoi(day_str);
-                
-                // Basic date validation
-                if (month < 1 || month > 12) {
-                    addError(row_idx, col_idx, "RFC: invalid month in date (should be 01-12)");
-                    logger->log_warning(row_idx, "RFC invalid month");
-                }
-                if (day < 1 || day > 31) {
-                    addError(row_idx, col_idx, "RFC: invalid day in date (should be 01-31)");
-                    logger->log_warning(row_idx, "RFC invalid day");
-                }
-            } catch (...) {
-                addError(row_idx, col_idx, "RFC: invalid date format");
-                logger->log_warning(row_idx, "RFC invalid date format");
-            }
+        if (month < 1 || month > 12) {
+            addError(row_idx, col_idx, ErrorCode::RfcMonth);
+            logger->log_warning(row_idx, "RFC invalid month");
         }
-        
-        // Last 3 characters should be alphanumeric (homoclave)
-        for (int i = 10; i < 12; i++) {
-            if (!std::isalnum(value[i])) {
-                addError(row_idx, col_idx, "RFC persona moral: last 3 characters should be alphanumeric (homoclave)");
-                logger->log_warning(row_idx, "RFC homoclave invalid");
-                break;
-            }
+        if (day < 1 || day > 31) {
+            addError(row_idx, col_idx, ErrorCode::RfcDay);
+            logger->log_warning(row_idx, "RFC invalid day");
         }
     }
 
-    void validatePhone(const std::string& value, size_t row_idx, size_t col_idx) {
+    void validatePhone(std::string_view value, size_t row_idx, size_t col_idx, const FieldRule& rule) {
         // Clean the phone number first
         std::string cleaned_phone;
         for (char c : value) {
-            if (std::isdigit(c)) {
+            if (isAsciiDigit(c)) {
                 cleaned_phone += c;
             }
             // Skip common phone number separators
             else if (c != ' ' && c != '-' && c != '(' && c != ')' && c != '.') {
                 // If there are other invalid characters, add an error
-                addError(row_idx, col_idx, "Phone number contains invalid character: '" + std::string(1, c) + "'");
-                logger->log_warning(row_idx, "Phone contains invalid char: '" + std::string(1, c) + "'");
+                addError(row_idx, col_idx, ErrorCode::PhoneCharacter, {std::string_view(&c, 1)});
+                logger->log_warning(row_idx, {"Phone contains invalid char: '", std::string_view(&c, 1), "'"});
             }
         }
         
         // Check if empty after cleaning OR if original was empty
         if (value.empty() || cleaned_phone.empty()) {
-            // Auto-fill with "1234567890"
-            data.rows[row_idx][col_idx] = "1234567890";
-            addError(row_idx, col_idx, "Phone number was empty/invalid - auto-filled with '1234567890'");
-            logger->log_auto_fill(row_idx, "Phone", "1234567890");
+            // Auto-fill with the rule's default ("1234567890")
+            setCell(row_idx, col_idx, rule.default_value);
+            addError(row_idx, col_idx, ErrorCode::PhoneAutoFilled, {rule.default_value});
+            logger->log_auto_fill(row_idx, "Phone", rule.default_value);
             return;
         }
         
         // Update the cell with cleaned phone number if different
         if (cleaned_phone != value) {
-            data.rows[row_idx][col_idx] = cleaned_phone;
+            setCell(row_idx, col_idx, cleaned_phone);
             logger->log_cleaned(row_idx, "Phone", value, cleaned_phone);
         }
         
-        // Check for exactly 10 digits
-        if (cleaned_phone.length() != 10) {
-            addError(row_idx, col_idx, "Phone number must be exactly 10 digits (after cleaning: " + cleaned_phone + ", length: " + std::to_string(cleaned_phone.length()) + ")");
-            logger->log_warning(row_idx, "Phone wrong length: " + std::to_string(cleaned_phone.length()));
+        // Check for exactly 10 digits (rule.min_length == rule.max_length by default)
+        if (cleaned_phone.length() < rule.min_length || cleaned_phone.length() > rule.max_length) {
+            std::string expected = rule.min_length == rule.max_length ? 
+                "exactly " + std::to_string(rule.min_length) : 
+                std::to_string(rule.min_length) + "-" + std::to_string(rule.max_length);
+            addError(row_idx, col_idx, ErrorCode::PhoneLength, {expected, cleaned_phone, std::to_string(cleaned_phone.length())});
+            LogManager::Number length(cleaned_phone.length());
+            logger->log_warning(row_idx, {"Phone wrong length: ", length.view()});
         }
         
         // Final validation: all characters should be digits
-        if (!std::all_of(cleaned_phone.begin(), cleaned_phone.end(), ::isdigit)) {
-            addError(row_idx, col_idx, "Phone number must contain only digits");
+        if (!std::all_of(cleaned_phone.begin(), cleaned_phone.end(), isAsciiDigit)) {
+            addError(row_idx, col_idx, ErrorCode::PhoneDigits);
             logger->log_warning(row_idx, "Phone contains non-digits");
         }
     }
 
-    void validateDisabilityType(const std::string& value, size_t row_idx, size_t col_idx) {
+    void validateDisabilityType(std::string_view value, size_t row_idx, size_t col_idx, const FieldRule& rule) {
         // Find disability field in the same row
-        std::string disability = "";
-        for (size_t j = 0; j < data.headers.size(); j++) {
-            if (data.headers[j] == "dis" && j < data.rows[row_idx].size()) {  // Changed to "dis"
-                disability = data.rows[row_idx][j];
-                break;
-            }
+        std::string disability;
+        if (plan.disability >= 0) {
+            disability = rowAt(row_idx)[plan.disability];
         }
         
         // Convert disability to uppercase for comparison
@@ -1201,20 +7518,20 @@ private:
         
         // If disability is "S", disability type cannot be empty
         if (disability_upper == "S" && value.empty()) {
-            addError(row_idx, col_idx, "Disability type is required when disability is 'S'");
+            addError(row_idx, col_idx, ErrorCode::DisabilityTypeRequired);
             logger->log_warning(row_idx, "Disability type required when S");
         }
         
         // If disability is "N", disability type should be empty
         if (disability_upper == "N" && !value.empty()) {
-            addError(row_idx, col_idx, "Disability type should be empty when disability is 'N'");
+            addError(row_idx, col_idx, ErrorCode::DisabilityTypeUnexpected);
             logger->log_warning(row_idx, "Disability type should be empty when N");
         }
         
         // If disability type is provided and disability is "S", validate the content
         if (disability_upper == "S" && !value.empty()) {
             // Trim whitespace
-            std::string trimmed_value = value;
+            std::string_view trimmed_value = value;
             size_t start = trimmed_value.find_first_not_of(" \t\n\r");
             size_t end = trimmed_value.find_last_not_of(" \t\n\r");
             if (start != std::string::npos) {
@@ -1223,235 +7540,1155 @@ private:
             
             // Update the cell with trimmed value if different
             if (trimmed_value != value) {
-                data.rows[row_idx][col_idx] = trimmed_value;
+                setCell(row_idx, col_idx, trimmed_value);
                 logger->log_cleaned(row_idx, "Disability type", value, trimmed_value);
             }
             
-            // Validate characters (allow letters, spaces, hyphens, periods)
-            if (!std::all_of(trimmed_value.begin(), trimmed_value.end(), [](char c) {
-                return std::isalpha(static_cast<unsigned char>(c)) || 
-                    std::isspace(static_cast<unsigned char>(c)) || 
-                    c == '-' || c == '.';
+            // Validate characters (by default letters, spaces, hyphens, periods)
+            if (!std::all_of(trimmed_value.begin(), trimmed_value.end(), [&rule](char c) {
+                return rule.chars[static_cast<unsigned char>(c)];
             })) {
-                addError(row_idx, col_idx, "Disability type contains invalid characters (only letters, spaces, hyphens, and periods allowed)");
-                logger->log_warning(row_idx, "Disability type invalid chars: " + trimmed_value);
+                static const CharClass default_chars = FieldRule::defaults(FieldKind::DisabilityType, "").chars;
+                addError(row_idx, col_idx, rule.chars == default_chars ? 
+                         ErrorCode::DisabilityTypeCharacters : ErrorCode::DisabilityTypeCustomCharacters);
+                logger->log_warning(row_idx, {"Disability type invalid chars: ", trimmed_value});
+            }
+        }
+    }
+
+    void validateCrossFieldRules(size_t row_idx) {
+        RowView row = rowAt(row_idx);
+        
+        int credits_idx = plan.credits, reentry_idx = plan.reentry;
+        int avg_curr_idx = plan.current_average, avg_gen_idx = plan.general_average;
+        
+        // Validate new entry students (reingreso = "N")
+        if (reentry_idx >= 0 && credits_idx >= 0 && avg_curr_idx >= 0 && avg_gen_idx >= 0) {
+            if (row[reentry_idx] == "N") {
+                // New students should have 0 credits and 0 averages
+                if (row[credits_idx] != "0") {
+                    addError(row_idx, credits_idx, ErrorCode::NewStudentCredits);
+                    logger->log_warning(row_idx, "New student credits not 0");
+                }
+                if (row[avg_curr_idx] != "0.00") {
+                    addError(row_idx, avg_curr_idx, ErrorCode::NewStudentCurrentAverage);
+                    logger->log_warning(row_idx, "New student current avg not 0.00");
+                }
+                if (row[avg_gen_idx] != "0.00") {
+                    addError(row_idx, avg_gen_idx, ErrorCode::NewStudentGeneralAverage);
+                    logger->log_warning(row_idx, "New student general avg not 0.00");
+                }
+            }
+        }
+        
+        // Validate at least one last name exists
+        int paterno_idx = plan.paternal, materno_idx = plan.maternal;
+        
+        if (paterno_idx >= 0 && materno_idx >= 0) {
+            if (row[paterno_idx].empty() && row[materno_idx].empty()) {
+                addError(row_idx, paterno_idx, ErrorCode::LastNamesRequired);
+                logger->log_warning(row_idx, "Both last names empty");
+            }
+        }
+    }
+
+    // Auto-corrections copy the new value into owned storage; the original view
+    // (and any local copies of it) stay valid for the rest of the row.
+    void setCell(size_t row_idx, size_t col_idx, std::string_view value) {
+        CellArena& arena = active_chunk ? active_chunk->arena : data.arena;
+        rowAt(row_idx)[col_idx] = arena.store(value);
+    }
+
+    // Row indices are global to the input; data only holds rows from row_base on
+    RowView rowAt(size_t row_idx) {
+        return data.row(row_idx - row_base);
+    }
+
+    void addError(size_t row_idx, size_t col_idx, ErrorCode code, std::initializer_list<std::string_view> args = {}) {
+        addError(row_idx, col_idx, code, args.begin(), args.size());
+    }
+
+    void addError(size_t row_idx, size_t col_idx, ErrorCode code, const std::string_view* args, size_t arg_count) {
+        if (col_idx < rowAt(row_idx).size()) {
+            (active_chunk ? active_chunk->errors : data.errors).add(row_idx, col_idx, code, args, arg_count);
+        }
+    }
+
+    // Fold the error counters of the rows currently loaded into the run-wide summary
+    void accumulateSummary() {
+        const ErrorStore& errors = data.errors;
+        summary_total_errors += errors.error_cells;
+        summary_valid_rows += data.rowCount() - errors.error_rows;
+        if (summary_column_errors.size() < errors.column_error_cells.size()) {
+            summary_column_errors.resize(errors.column_error_cells.size(), 0);
+        }
+        for (size_t j = 0; j < errors.column_error_cells.size(); ++j) {
+            summary_column_errors[j] += errors.column_error_cells[j];
+        }
+        summary_rows += data.rowCount();
+        summary_problematic += std::count(data.row_status.begin(), data.row_status.end(), RowStatus::Problematic);
+    }
+
+    void printValidationSummary() {
+        RunStats::Scope scope(stats, "printValidationSummary");
+        DATALOOM_TRACE_SCOPE("validate", "validation summary");
+        logger->log_summary("=== VALIDATION SUMMARY ===");
+        logger->log_summary("Total records processed: " + std::to_string(summary_rows));
+        logger->log_summary("Valid records: " + std::to_string(summary_valid_rows));
+        logger->log_summary("Records with errors: " + std::to_string(summary_rows - summary_valid_rows));
+        logger->log_summary("Total validation errors: " + std::to_string(summary_total_errors));
+        
+        logger->log_summary("Errors by field:");
+        for (const auto& [field, count] : errorCountsByField()) {
+            logger->log_summary("  " + field + ": " + std::to_string(count) + " errors");
+        }
+        logger->log_summary("==========================");
+    }
+
+    void replaceTextPattern(const std::string& oldPattern, const std::string& newPattern) {
+        int replacements = 0;
+        for (size_t j = 0; j < data.columns.size(); ++j) {
+            for (size_t i = 0; i < data.rowCount(); ++i) {
+                if (data.columns[j][i].find(oldPattern) == std::string_view::npos) {
+                    continue;
+                }
+                std::string cell(data.columns[j][i]);
+                size_t pos = 0;
+                while ((pos = cell.find(oldPattern, pos)) != std::string::npos) {
+                    cell.replace(pos, oldPattern.length(), newPattern);
+                    pos += newPattern.length();
+                    replacements++;
+                }
+                setCell(row_base + i, j, cell);
+            }
+        }
+        if (replacements > 0) {
+            logger->log_info("Text replacement: " + std::to_string(replacements) + " occurrences replaced");
+        }
+    }
+
+    void transformTextCase(const std::string& caseType) {
+        logger->log_info("Applying case transformation: " + caseType);
+        for (size_t j = 0; j < data.columns.size(); ++j) {
+            for (size_t i = 0; i < data.rowCount(); ++i) {
+                std::string cell(data.columns[j][i]);
+                if (caseType == "uppercase") {
+                    std::transform(cell.begin(), cell.end(), cell.begin(), ::toupper);
+                } else if (caseType == "lowercase") {
+                    std::transform(cell.begin(), cell.end(), cell.begin(), ::tolower);
+                } else if (caseType == "title_case") {
+                    bool newWord = true;
+                    for (char& c : cell) {
+                        if (std::isspace(c)) {
+                            newWord = true;
+                        } else if (newWord) {
+                            c = std::toupper(c);
+                            newWord = false;
+                        } else {
+                            c = std::tolower(c);
+                        }
+                    }
+                }
+                if (cell != data.columns[j][i]) {
+                    setCell(row_base + i, j, cell);
+                }
+            }
+        }
+    }
+};
+
+// Function to parse command line arguments: "--key value", "--key=value" or a bare "--flag"
+std::map<std::string, std::string> parseArguments(int argc, const char* const argv[], int first = 4) {
+    std::map<std::string, std::string> options;
+    
+    for (int i = first; i < argc; ++i) {
+        if (argv[i][0] == '-' && argv[i][1] == '-') {
+            std::string key = argv[i] + 2;
+            size_t eq = key.find('=');
+            if (eq != std::string::npos) {
+                options[key.substr(0, eq)] = key.substr(eq + 1);
+            } else if (i + 1 < argc && !(argv[i + 1][0] == '-' && argv[i + 1][1] == '-')) {
+                options[key] = argv[++i];
+            } else {
+                options[key] = "true";
+            }
+        }
+    }
+    
+    return options;
+}
+
+#if !defined(_WIN32) && !defined(DATALOOM_LIBRARY)
+// --serve: validation jobs over a Unix domain socket, one request per
+// connection. A request is a command line ("JOB" or "STATS"), then "key value"
+// header lines ending with an empty line; for JOB the keys are the command
+// line options without "--" plus input/output paths, and "data <n>" sends n
+// bytes of CSV or XLSX inline after the empty line. A reply starts with
+// "OK ..." or "ERROR <reason>"; job replies then carry the job's log as
+// "log <n>" and n bytes. Each worker keeps one DataProcessor and its log
+// warm across jobs.
+class JobServer {
+public:
+    JobServer(std::string socket_path, size_t worker_count)
+        : path(std::move(socket_path)), workers(std::max<size_t>(1, worker_count)) {}
+
+    // Serve until a SHUTDOWN request; false if the socket cannot be set up
+    bool run(std::string& error) {
+        sockaddr_un address{};
+        if (path.size() >= sizeof(address.sun_path)) {
+            error = "socket path is too long: " + path;
+            return false;
+        }
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+        // A socket file left by a previous server is replaced
+        struct stat st;
+        if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+            ::unlink(path.c_str());
+        }
+        listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            listen(listener, 128) != 0) {
+            error = "cannot listen on " + path + ": " + std::strerror(errno);
+            if (listener >= 0) ::close(listener);
+            return false;
+        }
+
+        started = std::chrono::steady_clock::now();
+        std::vector<std::thread> pool;
+        for (size_t w = 0; w < workers; ++w) {
+            pool.emplace_back([this] { workerLoop(); });
+        }
+        std::cout << "Serving validation jobs on " << path << " with " << workers << " workers" << std::endl;
+
+        while (!stopping.load()) {
+            pollfd waiting{listener, POLLIN, 0};
+            if (poll(&waiting, 1, 100) <= 0) continue;
+            int client = accept(listener, nullptr, nullptr);
+            if (client < 0) continue;
+            timeval timeout{kIoTimeoutSeconds, 0};
+            setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                queue.push_back({client, std::chrono::steady_clock::now()});
+            }
+            queue_ready.notify_one();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            queue_ready.notify_all();
+        }
+        for (auto& worker : pool) {
+            worker.join();
+        }
+        ::close(listener);
+        ::unlink(path.c_str());
+        std::cout << "Server stopped after " << jobs_done << " jobs" << std::endl;
+        return true;
+    }
+
+private:
+    static constexpr int kIoTimeoutSeconds = 30;
+    static constexpr size_t kMaxHeaderBytes = 64 * 1024;
+    static constexpr size_t kMaxInlineBytes = size_t(1) << 30;
+    static constexpr size_t kRecentJobs = 4096;
+    static constexpr double kRateWindowSeconds = 60.0;
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Connection {
+        int fd;
+        Clock::time_point accepted;
+    };
+
+    // One finished job, for rates and latency percentiles
+    struct JobSample {
+        Clock::time_point finished;
+        double latency_ms;
+        size_t rows;
+    };
+
+    std::string path;
+    size_t workers;
+    int listener = -1;
+    std::atomic<bool> stopping{false};
+    Clock::time_point started;
+
+    std::mutex queue_mutex;
+    std::condition_variable queue_ready;
+    std::deque<Connection> queue;
+    std::atomic<size_t> busy{0};
+
+    std::mutex stats_mutex;
+    size_t jobs_done = 0;
+    size_t jobs_failed = 0;
+    size_t rows_done = 0;
+    std::vector<JobSample> recent;  // Ring of the last kRecentJobs jobs
+    size_t recent_next = 0;
+
+    std::mutex schema_mutex;
+    std::map<std::string, std::pair<int64_t, std::shared_ptr<const ValidationSchema>>> schemas;
+
+    void workerLoop() {
+        std::string job_log;
+        auto logger = std::make_shared<LogManager>();
+        logger->initialize([&job_log](std::string_view line) {
+            job_log.append(line);
+            job_log.push_back('\n');
+        });
+        DataProcessor processor({}, logger);
+
+        for (;;) {
+            Connection connection;
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                queue_ready.wait(lock, [this] { return !queue.empty() || stopping.load(); });
+                if (queue.empty()) return;
+                connection = queue.front();
+                queue.pop_front();
+            }
+            busy++;
+            job_log.clear();
+            handle(connection, processor, *logger, job_log);
+            busy--;
+            ::close(connection.fd);
+        }
+    }
+
+    void handle(const Connection& connection, DataProcessor& processor, LogManager& logger, std::string& job_log) {
+        std::string request;
+        size_t header_end = std::string::npos;
+        char buffer[64 * 1024];
+        while (header_end == std::string::npos) {
+            if (request.size() > kMaxHeaderBytes) {
+                reply(connection.fd, "ERROR request header is too long\n");
+                return;
+            }
+            ssize_t got = recv(connection.fd, buffer, sizeof(buffer), 0);
+            if (got <= 0) {
+                if (!request.empty()) reply(connection.fd, "ERROR incomplete request\n");
+                return;
+            }
+            request.append(buffer, static_cast<size_t>(got));
+            header_end = request.find("\n\n");
+        }
+
+        std::istringstream header(request.substr(0, header_end + 1));
+        std::string command;
+        std::getline(header, command);
+        std::map<std::string, std::string> fields;
+        for (std::string line; std::getline(header, line);) {
+            size_t space = line.find(' ');
+            fields[line.substr(0, space)] = space == std::string::npos ? "true" : line.substr(space + 1);
+        }
+
+        if (command == "STATS") {
+            reply(connection.fd, "OK\n" + statsJson() + "\n");
+            return;
+        }
+        if (command == "SHUTDOWN") {
+            stopping = true;
+            reply(connection.fd, "OK\n");
+            return;
+        }
+        if (command != "JOB") {
+            reply(connection.fd, "ERROR unknown command '" + command + "'\n");
+            return;
+        }
+
+        // Inline input follows the header
+        std::string inline_data;
+        bool has_data = fields.count("data") > 0;
+        if (has_data) {
+            size_t length = 0;
+            auto result = std::from_chars(fields["data"].data(), fields["data"].data() + fields["data"].size(), length);
+            if (result.ec != std::errc() || length > kMaxInlineBytes) {
+                reply(connection.fd, "ERROR invalid data length\n");
+                return;
+            }
+            inline_data = request.substr(header_end + 2);
+            while (inline_data.size() < length) {
+                ssize_t got = recv(connection.fd, buffer, sizeof(buffer), 0);
+                if (got <= 0) {
+                    reply(connection.fd, "ERROR incomplete inline data\n");
+                    return;
+                }
+                inline_data.append(buffer, static_cast<size_t>(got));
             }
+            inline_data.resize(length);
+        }
+
+        Clock::time_point began = connection.accepted;
+        std::string failure = runJob(fields, has_data ? &inline_data : nullptr, processor, logger);
+        logger.flush();
+        double latency_ms = std::chrono::duration<double, std::milli>(Clock::now() - began).count();
+        const ExcelData& data = processor.getData();
+        size_t rows = failure.empty() ? data.rowCount() : 0;
+        record(latency_ms, rows, failure.empty());
+
+        std::string status;
+        if (failure.empty()) {
+            size_t problematic = processor.getProblematicCount();
+            char timing[32];
+            std::snprintf(timing, sizeof(timing), "%.3f", latency_ms);
+            status = "OK rows=" + std::to_string(rows) + " valid=" + std::to_string(rows - problematic) +
+                     " problematic=" + std::to_string(problematic) + " errors=" +
+                     std::to_string(data.errors.entries.size()) + " ms=" + timing + "\n";
+        } else {
+            status = "ERROR " + failure + "\n";
+        }
+        reply(connection.fd, status + "log " + std::to_string(job_log.size()) + "\n" + job_log);
+    }
+
+    // Runs one job on a warm processor; returns why it failed, or "" on success
+    std::string runJob(std::map<std::string, std::string>& fields, const std::string* inline_data,
+                       DataProcessor& processor, LogManager& logger) {
+        static const std::set<std::string> kJobKeys = {
+            "input", "data", "output", "problematic-output", "annotated-output", "schema", "threads",
+            "log-level", "find", "replace", "case", "highlight-errors", "output-format", "errors-output"
+        };
+        for (const auto& field : fields) {
+            if (!kJobKeys.count(field.first)) return "unsupported job key '" + field.first + "'";
+        }
+        if (!fields.count("output")) return "missing output";
+        if (fields.count("input") == (inline_data != nullptr)) return "give exactly one of input or data";
+
+        LogLevel log_level = LogLevel::Info;
+        if (fields.count("log-level") && !LogManager::parseLevel(fields["log-level"], log_level)) {
+            return "log-level must be one of summary, warn, info, debug";
+        }
+        logger.setLevel(log_level);
+        if (fields.count("output-format") && fields["output-format"] != "csv" && fields["output-format"] != "arrow") {
+            return "output-format must be csv or arrow";
+        }
+
+        // Jobs run side by side, so each validates on one thread unless asked
+        std::map<std::string, std::string> options;
+        for (const char* key : {"threads", "find", "replace", "case", "highlight-errors", "output-format", "errors-output"}) {
+            if (fields.count(key)) options[key] = fields[key];
+        }
+        if (!options.count("threads")) options["threads"] = "1";
+        processor.reset(options);
+
+        if (fields.count("schema")) {
+            std::string error;
+            auto schema = cachedSchema(fields["schema"], error);
+            if (!schema) return error;
+            processor.setSchema(schema);
+        }
+
+        bool loaded = inline_data ? processor.loadBuffer(*inline_data, "inline data")
+                                  : processor.loadData(fields["input"]);
+        if (!loaded) return "cannot load " + (inline_data ? std::string("inline data") : fields["input"]);
+        processor.processData();
+        auto optional = [&fields](const char* key) { return fields.count(key) ? fields[key] : std::string(); };
+        if (!processor.saveData(fields["output"], optional("problematic-output"), optional("annotated-output"))) {
+            return "cannot write " + fields["output"];
         }
+        return std::string();
     }
 
-    void validateCrossFieldRules(size_t row_idx) {
-        auto& row = data.rows[row_idx];
-        
-        // Find field indices
-        int credits_idx = -1, reentry_idx = -1, avg_curr_idx = -1, avg_gen_idx = -1;
-        
-        for (size_t j = 0; j < data.headers.size(); j++) {
-            if (data.headers[j] == "cac") credits_idx = j;
-            else if (data.headers[j] == "reingreso") reentry_idx = j;
-            else if (data.headers[j] == "psa1") avg_curr_idx = j;
-            else if (data.headers[j] == "pge") avg_gen_idx = j;
+    // Schemas are parsed once per file version and shared between workers
+    std::shared_ptr<const ValidationSchema> cachedSchema(const std::string& file, std::string& error) {
+        struct stat st;
+        if (stat(file.c_str(), &st) != 0) {
+            error = "Cannot open schema file " + file;
+            return nullptr;
         }
-        
-        // Validate new entry students (reingreso = "N")
-        if (reentry_idx >= 0 && credits_idx >= 0 && avg_curr_idx >= 0 && avg_gen_idx >= 0) {
-            if (row[reentry_idx] == "N") {
-                // New students should have 0 credits and 0 averages
-                if (row[credits_idx] != "0") {
-                    addError(row_idx, credits_idx, "New students should have 0 accumulated credits");
-                    logger->log_warning(row_idx, "New student credits not 0");
-                }
-                if (row[avg_curr_idx] != "0.00") {
-                    addError(row_idx, avg_curr_idx, "New students should have 0.00 current average");
-                    logger->log_warning(row_idx, "New student current avg not 0.00");
-                }
-                if (row[avg_gen_idx] != "0.00") {
-                    addError(row_idx, avg_gen_idx, "New students should have 0.00 general average");
-                    logger->log_warning(row_idx, "New student general avg not 0.00");
-                }
-            }
+        int64_t version = static_cast<int64_t>(st.st_mtime) * 1000000007LL + st.st_size;
+        std::lock_guard<std::mutex> lock(schema_mutex);
+        auto it = schemas.find(file);
+        if (it != schemas.end() && it->second.first == version) return it->second.second;
+        auto schema = std::make_shared<ValidationSchema>();
+        if (!schema->loadFile(file, error)) return nullptr;
+        schemas[file] = {version, schema};
+        return schema;
+    }
+
+    void record(double latency_ms, size_t rows, bool succeeded) {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        if (!succeeded) {
+            jobs_failed++;
+            return;
         }
-        
-        // Validate at least one last name exists
-        int paterno_idx = -1, materno_idx = -1;
-        for (size_t j = 0; j < data.headers.size(); j++) {
-            if (data.headers[j] == "app") paterno_idx = j;
-            else if (data.headers[j] == "apm") materno_idx = j;
+        jobs_done++;
+        rows_done += rows;
+        JobSample sample{Clock::now(), latency_ms, rows};
+        if (recent.size() < kRecentJobs) {
+            recent.push_back(sample);
+        } else {
+            recent[recent_next] = sample;
         }
-        
-        if (paterno_idx >= 0 && materno_idx >= 0) {
-            if (row[paterno_idx].empty() && row[materno_idx].empty()) {
-                addError(row_idx, paterno_idx, "At least one last name (paternal or maternal) is required");
-                logger->log_warning(row_idx, "Both last names empty");
+        recent_next = (recent_next + 1) % kRecentJobs;
+    }
+
+    // Totals since start; rates over the last minute; latency percentiles
+    // (from accept to reply, queueing included) over the last kRecentJobs jobs
+    std::string statsJson() {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        Clock::time_point now = Clock::now();
+        double uptime = std::chrono::duration<double>(now - started).count();
+        double window = std::min(uptime, kRateWindowSeconds);
+        size_t window_jobs = 0;
+        size_t window_rows = 0;
+        std::vector<double> latencies;
+        latencies.reserve(recent.size());
+        for (const auto& sample : recent) {
+            latencies.push_back(sample.latency_ms);
+            if (std::chrono::duration<double>(now - sample.finished).count() <= kRateWindowSeconds) {
+                window_jobs++;
+                window_rows += sample.rows;
             }
         }
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&latencies](double p) {
+            if (latencies.empty()) return 0.0;
+            size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * latencies.size()));
+            return latencies[std::min(latencies.size(), std::max<size_t>(rank, 1)) - 1];
+        };
+        size_t queued;
+        {
+            std::lock_guard<std::mutex> queue_lock(queue_mutex);
+            queued = queue.size();
+        }
+
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(3);
+        out << "{\"uptime_s\": " << uptime << ", \"workers\": " << workers << ", \"busy\": " << busy.load()
+            << ", \"queued\": " << queued << ", \"jobs\": " << jobs_done << ", \"failed\": " << jobs_failed
+            << ", \"rows\": " << rows_done
+            << ", \"jobs_per_s\": " << (window > 0 ? window_jobs / window : 0.0)
+            << ", \"rows_per_s\": " << (window > 0 ? window_rows / window : 0.0)
+            << ", \"latency_ms\": {\"p50\": " << percentile(50) << ", \"p90\": " << percentile(90)
+            << ", \"p99\": " << percentile(99) << ", \"max\": " << (latencies.empty() ? 0.0 : latencies.back())
+            << "}}";
+        return out.str();
     }
 
-    void addError(size_t row_idx, size_t col_idx, const std::string& error_msg) {
-        if (row_idx < data.validation_errors.size() && col_idx < data.validation_errors[row_idx].size()) {
-            if (!data.validation_errors[row_idx][col_idx].empty()) {
-                data.validation_errors[row_idx][col_idx] += "; ";
-            }
-            data.validation_errors[row_idx][col_idx] += error_msg;
+    static void reply(int fd, const std::string& text) {
+        size_t sent = 0;
+        while (sent < text.size()) {
+            ssize_t n = send(fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) return;
+            sent += static_cast<size_t>(n);
         }
     }
+};
+#endif
 
-    void printValidationSummary() {
-        int total_errors = 0;
-        int valid_rows = 0;
-        
-        for (size_t i = 0; i < data.validation_errors.size(); ++i) {
-            bool row_has_errors = false;
-            for (const auto& error : data.validation_errors[i]) {
-                if (!error.empty()) {
-                    total_errors++;
-                    row_has_errors = true;
+#ifndef DATALOOM_LIBRARY
+// Batch mode (--batch): validate every input of a directory or manifest on
+// one work-stealing pool and report them in one consolidated summary. Each
+// input gets <stem>_valid, <stem>_problematic and <stem>.log in the output
+// directory; batch.log and batch_summary.csv cover the whole batch.
+class BatchRunner {
+public:
+    BatchRunner(std::map<std::string, std::string> batch_options, std::shared_ptr<LogManager> batch_logger)
+        : options(std::move(batch_options)), logger(std::move(batch_logger)) {}
+
+    // A directory contributes its .csv and .xlsx files; any other file is a
+    // manifest of one input path per line (relative to the manifest, # comments)
+    bool collectInputs(const std::string& source, std::string& error) {
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        if (fs::is_directory(source, ec)) {
+            for (const auto& entry : fs::directory_iterator(source, ec)) {
+                std::string path = entry.path().string();
+                if (entry.is_regular_file(ec) && (DataProcessor::hasExtension(path, ".csv") || 
+                                                  DataProcessor::hasExtension(path, ".xlsx"))) {
+                    inputs.push_back(path);
                 }
             }
-            if (!row_has_errors) {
-                valid_rows++;
+            std::sort(inputs.begin(), inputs.end());
+        } else {
+            std::ifstream manifest(source);
+            if (!manifest.is_open()) {
+                error = "Cannot open batch input " + source;
+                return false;
             }
-        }
-        
-        logger->log_summary("=== VALIDATION SUMMARY ===");
-        logger->log_summary("Total records processed: " + std::to_string(data.rows.size()));
-        logger->log_summary("Valid records: " + std::to_string(valid_rows));
-        logger->log_summary("Records with errors: " + std::to_string(data.rows.size() - valid_rows));
-        logger->log_summary("Total validation errors: " + std::to_string(total_errors));
-        
-        // Count errors by field type
-        std::map<std::string, int> error_counts;
-        for (size_t i = 0; i < data.validation_errors.size(); ++i) {
-            for (size_t j = 0; j < data.validation_errors[i].size() && j < data.headers.size(); ++j) {
-                if (!data.validation_errors[i][j].empty()) {
-                    error_counts[data.headers[j]]++;
-                }
+            fs::path base = fs::path(source).parent_path();
+            for (std::string line; std::getline(manifest, line);) {
+                size_t first = line.find_first_not_of(" \t\r");
+                if (first == std::string::npos || line[first] == '#') continue;
+                size_t last = line.find_last_not_of(" \t\r");
+                fs::path input = line.substr(first, last - first + 1);
+                inputs.push_back((input.is_absolute() ? input : base / input).string());
             }
         }
-        
-        logger->log_summary("Errors by field:");
-        for (const auto& [field, count] : error_counts) {
-            logger->log_summary("  " + field + ": " + std::to_string(count) + " errors");
+        if (ec) {
+            error = "Cannot list " + source + ": " + ec.message();
+            return false;
         }
-        logger->log_summary("==========================");
+        if (inputs.empty()) {
+            error = "No .csv or .xlsx inputs in " + source;
+            return false;
+        }
+        return true;
     }
 
-    void replaceTextPattern(const std::string& oldPattern, const std::string& newPattern) {
-        int replacements = 0;
-        for (auto& row : data.rows) {
-            for (auto& cell : row) {
-                size_t pos = 0;
-                while ((pos = cell.find(oldPattern, pos)) != std::string::npos) {
-                    cell.replace(pos, oldPattern.length(), newPattern);
-                    pos += newPattern.length();
-                    replacements++;
-                }
+    // Run every input; false if any failed. Per-file failures are reported in
+    // the summary rather than stopping the batch.
+    bool run(const std::string& output_dir, size_t workers) {
+        std::map<std::string, std::string> file_options;
+        for (const char* key : {"find", "replace", "case", "output-format"}) {
+            if (options.count(key)) file_options[key] = options[key];
+        }
+        LogLevel log_level = LogLevel::Info;
+        if (options.count("log-level")) LogManager::parseLevel(options["log-level"], log_level);
+        bool shared_dedup = options.count("shared-dedup") > 0;
+
+        std::shared_ptr<const ValidationSchema> schema;
+        if (options.count("schema")) {
+            auto loaded = std::make_shared<ValidationSchema>();
+            std::string error;
+            if (!loaded->loadFile(options["schema"], error)) {
+                logger->log_error(error);
+                return false;
             }
+            logger->log_info("Validation schema: " + loaded->name() + " (" + std::to_string(loaded->size()) + " columns)");
+            schema = loaded;
         }
-        if (replacements > 0) {
-            logger->log_info("Text replacement: " + std::to_string(replacements) + " occurrences replaced");
+
+        results.assign(inputs.size(), FileResult());
+        assignOutputs(output_dir, file_options.count("output-format") && file_options["output-format"] == "arrow");
+        std::unique_ptr<SharedKeySets> shared;
+        if (shared_dedup) shared = std::make_unique<SharedKeySets>(inputs.size());
+
+        // Shared sets are checked in manifest order, and jobs start in
+        // submission order, so every earlier file is always already running.
+        // Otherwise the largest files go first so the small ones fill the gaps.
+        std::vector<size_t> order(inputs.size());
+        for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+        if (!shared_dedup) {
+            std::vector<uintmax_t> sizes(inputs.size());
+            for (size_t i = 0; i < inputs.size(); ++i) {
+                std::error_code ec;
+                sizes[i] = std::filesystem::file_size(inputs[i], ec);
+                if (ec) sizes[i] = 0;
+            }
+            std::stable_sort(order.begin(), order.end(), [&sizes](size_t a, size_t b) { return sizes[a] > sizes[b]; });
         }
-    }
 
-    void transformTextCase(const std::string& caseType) {
-        logger->log_info("Applying case transformation: " + caseType);
-        for (auto& row : data.rows) {
-            for (auto& cell : row) {
-                if (caseType == "uppercase") {
-                    std::transform(cell.begin(), cell.end(), cell.begin(), ::toupper);
-                } else if (caseType == "lowercase") {
-                    std::transform(cell.begin(), cell.end(), cell.begin(), ::tolower);
-                } else if (caseType == "title_case") {
-                    bool newWord = true;
-                    for (char& c : cell) {
-                        if (std::isspace(c)) {
-                            newWord = true;
-                        } else if (newWord) {
-                            c = std::toupper(c);
-                            newWord = false;
-                        } else {
-                            c = std::tolower(c);
-                        }
+        logger->log_info("Batch of " + std::to_string(inputs.size()) + " inputs on " + std::to_string(workers) + 
+                         " workers, duplicate detection " + (shared_dedup ? "shared across the batch" : "per file"));
+        auto began = std::chrono::steady_clock::now();
+        std::atomic<size_t> done{0};
+        {
+            WorkStealingPool pool(workers, "batch worker");
+            for (size_t i : order) {
+                pool.submit([&, i] {
+                    runFile(i, pool, file_options, log_level, schema, shared.get());
+                    const FileResult& result = results[i];
+                    std::string progress = "[" + std::to_string(++done) + "/" + std::to_string(inputs.size()) + "] " + inputs[i];
+                    if (result.failure.empty()) {
+                        char timing[32];
+                        std::snprintf(timing, sizeof(timing), "%.3f", result.seconds);
+                        logger->log_info(progress + ": " + std::to_string(result.rows) + " records, " + 
+                                         std::to_string(result.problematic) + " problematic, " + timing + " s");
+                    } else {
+                        logger->log_error(progress + ": " + result.failure);
                     }
-                }
+                });
             }
+            pool.waitIdle();
         }
-    }
-};
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
 
-bool saveValidationErrors(const DataProcessor& processor, const std::string& errorsFile, std::shared_ptr<LogManager> logger) {
-    std::ofstream file(errorsFile);
-    if (!file.is_open()) {
-        logger->log_error("Cannot create errors file " + errorsFile);
-        return false;
+        bool summary_written = writeSummaryTable(output_dir);
+        printSummary(elapsed, shared_dedup);
+        return summary_written && std::all_of(results.begin(), results.end(), 
+                                              [](const FileResult& result) { return result.failure.empty(); });
     }
 
-    auto headers = processor.getHeaders();
-    auto errors = processor.getValidationErrors();
+private:
+    struct FileResult {
+        std::string valid_output;
+        std::string problematic_output;
+        std::string log_output;
+        std::string failure;
+        size_t rows = 0;
+        size_t problematic = 0;
+        size_t errors = 0;
+        double seconds = 0;
+        std::map<std::string, size_t> field_errors;
+    };
+
+    std::map<std::string, std::string> options;
+    std::shared_ptr<LogManager> logger;
+    std::vector<std::string> inputs;
+    std::vector<FileResult> results;
 
-    file << "{\n";
-    file << "  \"headers\": [";
-    for (size_t i = 0; i < headers.size(); ++i) {
-        if (i > 0) file << ", ";
-        file << "\"" << headers[i] << "\"";
+    // Outputs are named after the input; a name used twice gets the input's number
+    void assignOutputs(const std::string& output_dir, bool arrow) {
+        namespace fs = std::filesystem;
+        std::map<std::string, size_t> uses;
+        for (const auto& input : inputs) uses[fs::path(input).stem().string()]++;
+        std::string extension = arrow ? ".arrow" : ".csv";
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            std::string stem = fs::path(inputs[i]).stem().string();
+            if (uses[stem] > 1) stem += "_" + std::to_string(i + 1);
+            fs::path base = fs::path(output_dir) / stem;
+            results[i].valid_output = base.string() + "_valid" + extension;
+            results[i].problematic_output = base.string() + "_problematic" + extension;
+            results[i].log_output = base.string() + ".log";
+        }
     }
-    file << "],\n";
-    
-    file << "  \"errors\": [\n";
-    for (size_t i = 0; i < errors.size(); ++i) {
-        file << "    [";
-        for (size_t j = 0; j < errors[i].size(); ++j) {
-            if (j > 0) file << ", ";
-            // Escape quotes in error messages
-            std::string escaped_error = errors[i][j];
-            size_t pos = 0;
-            while ((pos = escaped_error.find('"', pos)) != std::string::npos) {
-                escaped_error.replace(pos, 1, "\\\"");
-                pos += 2;
+
+    void runFile(size_t i, WorkStealingPool& pool, const std::map<std::string, std::string>& file_options,
+                 LogLevel log_level, const std::shared_ptr<const ValidationSchema>& schema, SharedKeySets* shared) {
+        DATALOOM_TRACE_SCOPE("batch", "file", {"input", static_cast<int64_t>(i)});
+        auto began = std::chrono::steady_clock::now();
+        FileResult& result = results[i];
+
+        // Files run side by side, so each log goes only to its own file
+        std::ofstream log_file(result.log_output);
+        if (!log_file.is_open()) {
+            result.failure = "cannot create " + result.log_output;
+            if (shared) shared->finish(i);
+            return;
+        }
+        auto file_logger = std::make_shared<LogManager>();
+        file_logger->setLevel(log_level);
+        file_logger->initialize([&log_file](std::string_view line) {
+            log_file.write(line.data(), static_cast<std::streamsize>(line.size()));
+            log_file.put('\n');
+        });
+        file_logger->log_info("Input file: " + inputs[i]);
+
+        DataProcessor processor(file_options, file_logger);
+        processor.setPool(&pool);
+        if (shared) processor.setSharedKeys(shared, i);
+        if (schema) processor.setSchema(schema);
+        if (!processor.loadData(inputs[i])) {
+            result.failure = "cannot load " + inputs[i];
+        } else {
+            processor.processData();
+            if (!processor.saveData(result.valid_output, result.problematic_output)) {
+                result.failure = "cannot write " + result.valid_output;
             }
-            file << "\"" << escaped_error << "\"";
         }
-        file << "]";
-        if (i < errors.size() - 1) file << ",";
-        file << "\n";
+        // A file that failed before its duplicate check still lets the next one go
+        if (shared) shared->finish(i);
+
+        result.rows = processor.getProcessedCount();
+        result.problematic = processor.getProblematicCount();
+        result.errors = processor.getData().errors.entries.size();
+        result.field_errors = processor.errorCountsByField();
+        file_logger->close();
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
     }
-    file << "  ]\n";
-    file << "}\n";
 
-    file.close();
-    logger->log_info("Validation errors saved to " + errorsFile);
-    return true;
+    bool writeSummaryTable(const std::string& output_dir) {
+        std::string path = (std::filesystem::path(output_dir) / "batch_summary.csv").string();
+        std::ofstream table(path);
+        table << "input,valid_output,status,records,valid,problematic,errors,seconds\n";
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            const FileResult& result = results[i];
+            char timing[32];
+            std::snprintf(timing, sizeof(timing), "%.3f", result.seconds);
+            table << DataProcessor::escapeCSV(inputs[i]) << ',' << DataProcessor::escapeCSV(result.valid_output) << ','
+                  << (result.failure.empty() ? "ok" : DataProcessor::escapeCSV("failed: " + result.failure)) << ','
+                  << result.rows << ',' << result.rows - result.problematic << ',' << result.problematic << ','
+                  << result.errors << ',' << timing << '\n';
+        }
+        table.close();
+        if (!table) {
+            logger->log_error("Cannot write " + path);
+            return false;
+        }
+        logger->log_info("Per-file results saved to " + path);
+        return true;
+    }
+
+    void printSummary(double elapsed, bool shared_dedup) {
+        size_t failed = 0, rows = 0, problematic = 0, errors = 0;
+        std::map<std::string, size_t> field_errors;
+        for (const auto& result : results) {
+            if (!result.failure.empty()) failed++;
+            rows += result.rows;
+            problematic += result.problematic;
+            errors += result.errors;
+            for (const auto& [field, count] : result.field_errors) field_errors[field] += count;
+        }
+        char timing[64];
+        std::snprintf(timing, sizeof(timing), "%.3f s (%.0f records/s)", elapsed, elapsed > 0 ? rows / elapsed : 0.0);
+
+        logger->log_summary("=== BATCH SUMMARY ===");
+        logger->log_summary("Files processed: " + std::to_string(inputs.size() - failed) + " of " + 
+                            std::to_string(inputs.size()) + (failed ? " (" + std::to_string(failed) + " failed)" : ""));
+        logger->log_summary("Total records: " + std::to_string(rows));
+        logger->log_summary("Valid records saved: " + std::to_string(rows - problematic));
+        logger->log_summary("Problematic records filtered: " + std::to_string(problematic));
+        logger->log_summary("Total validation errors: " + std::to_string(errors));
+        logger->log_summary(std::string("Duplicate detection: ") + (shared_dedup ? "shared across the batch" : "per file"));
+        logger->log_summary("Errors by field:");
+        for (const auto& [field, count] : field_errors) {
+            logger->log_summary("  " + field + ": " + std::to_string(count) + " errors");
+        }
+        logger->log_summary(std::string("Elapsed: ") + timing);
+        logger->log_summary("=====================");
+    }
+};
+#endif
+
+#ifdef DATALOOM_LIBRARY
+#include "dataloom.h"
+
+// State behind a dl_processor handle. The processor is declared after the
+// logger so it is destroyed first.
+struct dl_processor {
+    std::shared_ptr<LogManager> logger;
+    std::unique_ptr<DataProcessor> processor;
+    bool loaded = false;
+    std::string message;  // Backs the view returned by the last dl_error
+};
+
+namespace {
+
+// Runs one API call: exceptions must not cross the C boundary, so they are
+// logged as failures, and the log is flushed so the callback has seen every
+// line by the time the call returns
+template <typename Call>
+int guarded(dl_processor* handle, Call call) {
+    bool succeeded = false;
+    try {
+        succeeded = call();
+    } catch (const std::exception& e) {
+        handle->logger->log_error(e.what());
+    }
+    handle->logger->flush();
+    return succeeded ? 1 : 0;
 }
 
-// Function to parse command line arguments
-std::map<std::string, std::string> parseArguments(int argc, char* argv[]) {
-    std::map<std::string, std::string> options;
-    
-    for (int i = 3; i < argc; i += 2) {
-        if (argv[i][0] == '-' && argv[i][1] == '-') {
-            std::string key = argv[i] + 2;
-            if (i + 1 < argc) {
-                options[key] = argv[i + 1];
+dl_view viewOf(std::string_view text) {
+    return dl_view{text.data(), text.size()};
+}
+
+}  // namespace
+
+extern "C" {
+
+DATALOOM_API dl_processor* dl_create(int argc, const char* const* argv, dl_log_callback log, void* user) {
+    std::unique_ptr<dl_processor> handle;
+    try {
+        handle = std::make_unique<dl_processor>();
+        std::map<std::string, std::string> options = parseArguments(argc, argv, 0);
+        handle->logger = std::make_shared<LogManager>();
+        handle->logger->initialize([log, user](std::string_view line) {
+            if (log) log(line.data(), line.size(), user);
+        });
+
+        LogLevel log_level = LogLevel::Info;
+        if (options.count("log-level") && !LogManager::parseLevel(options["log-level"], log_level)) {
+            handle->logger->log_error("--log-level must be one of summary, warn, info, debug");
+            handle->logger->flush();
+            return nullptr;
+        }
+        handle->logger->setLevel(log_level);
+        handle->processor = std::make_unique<DataProcessor>(options, handle->logger);
+
+        if (options.count("schema")) {
+            auto schema = std::make_shared<ValidationSchema>();
+            std::string error;
+            if (!schema->loadFile(options["schema"], error)) {
+                handle->logger->log_error(error);
+                handle->logger->flush();
+                return nullptr;
             }
+            handle->logger->log_info("Validation schema: " + schema->name() + " (" + std::to_string(schema->size()) + " columns)");
+            handle->processor->setSchema(schema);
         }
+        handle->logger->flush();
+    } catch (const std::exception&) {
+        return nullptr;
     }
-    
-    return options;
+    return handle.release();
+}
+
+DATALOOM_API void dl_destroy(dl_processor* processor) {
+    delete processor;
+}
+
+DATALOOM_API int dl_load(dl_processor* processor, const char* data, size_t size, const char* name) {
+    return guarded(processor, [&] {
+        if (processor->loaded) {
+            processor->logger->log_error("A processor loads one dataset; create another for the next one");
+            return false;
+        }
+        processor->loaded = true;
+        return processor->processor->loadBuffer(std::string_view(data, size), name ? name : "buffer");
+    });
+}
+
+DATALOOM_API int dl_load_file(dl_processor* processor, const char* path) {
+    return guarded(processor, [&] {
+        if (processor->loaded) {
+            processor->logger->log_error("A processor loads one dataset; create another for the next one");
+            return false;
+        }
+        processor->loaded = true;
+        return processor->processor->loadData(path);
+    });
+}
+
+DATALOOM_API int dl_process(dl_processor* processor) {
+    return guarded(processor, [&] {
+        if (!processor->loaded) {
+            processor->logger->log_error("No dataset loaded");
+            return false;
+        }
+        processor->processor->processData();
+        return true;
+    });
+}
+
+DATALOOM_API int dl_save(dl_processor* processor, const char* valid, const char* problematic, const char* annotated) {
+    return guarded(processor, [&] {
+        return processor->processor->saveData(valid, problematic ? problematic : "", annotated ? annotated : "");
+    });
+}
+
+DATALOOM_API size_t dl_row_count(const dl_processor* processor) {
+    return processor->processor->getData().rowCount();
 }
 
+DATALOOM_API size_t dl_column_count(const dl_processor* processor) {
+    return processor->processor->getData().headers.size();
+}
+
+DATALOOM_API size_t dl_problematic_count(const dl_processor* processor) {
+    return processor->processor->getProblematicCount();
+}
+
+DATALOOM_API dl_view dl_header(const dl_processor* processor, size_t column) {
+    const ExcelData& data = processor->processor->getData();
+    return column < data.headers.size() ? viewOf(data.headers[column]) : dl_view{nullptr, 0};
+}
+
+DATALOOM_API dl_view dl_cell(const dl_processor* processor, size_t row, size_t column) {
+    const ExcelData& data = processor->processor->getData();
+    if (column >= data.columns.size() || row >= data.rowCount()) return dl_view{nullptr, 0};
+    return viewOf(data.columns[column][row]);
+}
+
+DATALOOM_API int dl_row_status(const dl_processor* processor, size_t row) {
+    const ExcelData& data = processor->processor->getData();
+    if (row >= data.rowCount()) return -1;
+    return data.row_status[row] == RowStatus::Problematic ? DL_ROW_PROBLEMATIC : DL_ROW_VALID;
+}
+
+DATALOOM_API size_t dl_error_count(const dl_processor* processor) {
+    return processor->processor->getData().errors.entries.size();
+}
+
+DATALOOM_API int dl_error(dl_processor* processor, size_t index, dl_error_info* out) {
+    const ErrorStore& errors = processor->processor->getData().errors;
+    if (index >= errors.entries.size()) return 0;
+    const ErrorStore::Entry& entry = errors.entries[index];
+    processor->message.clear();
+    errors.appendMessage(processor->message, entry);
+    out->row = entry.row;
+    out->column = entry.col;
+    out->code = kErrorInfo[static_cast<size_t>(entry.code)].id;
+    out->message = viewOf(processor->message);
+    return 1;
+}
+
+}  // extern "C"
+
+#else
+
 int main(int argc, char* argv[]) {
-    // Check for exactly 3 arguments
-    if (argc != 4) {
-        std::cerr << "Usage: " << argv[0] << " <input_csv> <valid_output> <process_log>" << std::endl;
+    if (argc >= 3 && std::string(argv[1]) == "--serve") {
+#ifndef _WIN32
+        std::map<std::string, std::string> options = parseArguments(argc, argv, 3);
+        size_t workers = std::max(1u, std::thread::hardware_concurrency());
+        if (options.count("workers")) {
+            try {
+                workers = std::stoul(options["workers"]);
+            } catch (...) {
+                workers = 0;
+            }
+            if (workers == 0) {
+                std::cerr << "ERROR: --workers must be a positive integer" << std::endl;
+                return 1;
+            }
+        }
+        JobServer server(argv[2], workers);
+        std::string error;
+        if (!server.run(error)) {
+            std::cerr << "ERROR: " << error << std::endl;
+            return 1;
+        }
+        return 0;
+#else
+        std::cerr << "ERROR: --serve needs Unix domain sockets" << std::endl;
+        return 1;
+#endif
+    }
+
+    if (argc >= 4 && std::string(argv[1]) == "--batch") {
+        std::map<std::string, std::string> options = parseArguments(argc, argv, 4);
+        static const std::set<std::string> kBatchOptions = {
+            "workers", "shared-dedup", "schema", "log-level", "find", "replace", "case", "output-format", "trace"
+        };
+        for (const auto& option : options) {
+            if (!kBatchOptions.count(option.first)) {
+                std::cerr << "ERROR: --" << option.first << " is not supported in batch mode" << std::endl;
+                return 1;
+            }
+        }
+        size_t workers = std::max(1u, std::thread::hardware_concurrency());
+        if (options.count("workers")) {
+            try {
+                workers = std::stoul(options["workers"]);
+            } catch (...) {
+                workers = 0;
+            }
+            if (workers == 0) {
+                std::cerr << "ERROR: --workers must be a positive integer" << std::endl;
+                return 1;
+            }
+        }
+        LogLevel log_level = LogLevel::Info;
+        if (options.count("log-level") && !LogManager::parseLevel(options["log-level"], log_level)) {
+            std::cerr << "ERROR: --log-level must be one of summary, warn, info, debug" << std::endl;
+            return 1;
+        }
+        if (options.count("output-format") && options["output-format"] != "csv" && options["output-format"] != "arrow") {
+            std::cerr << "ERROR: --output-format must be csv or arrow" << std::endl;
+            return 1;
+        }
+        std::error_code ec;
+        std::filesystem::create_directories(argv[3], ec);
+        if (ec) {
+            std::cerr << "ERROR: Cannot create output directory " << argv[3] << ": " << ec.message() << std::endl;
+            return 1;
+        }
+
+        std::unique_ptr<Tracer> tracer;
+        if (options.count("trace")) {
+            if (!Tracer::kEnabled) {
+                std::cerr << "ERROR: --trace is not available in a build with DATALOOM_NO_TRACE" << std::endl;
+                return 1;
+            }
+            tracer = std::make_unique<Tracer>();
+            tracer->start();
+        }
+
+        // The batch log has the progress and the consolidated summary; the
+        // per-row lines go to each input's own log
+        auto logger = std::make_shared<LogManager>();
+        logger->setLevel(std::min(log_level, LogLevel::Info));
+        if (!logger->initialize((std::filesystem::path(argv[3]) / "batch.log").string())) {
+            return 1;
+        }
+        BatchRunner runner(options, logger);
+        std::string error;
+        if (!runner.collectInputs(argv[2], error)) {
+            logger->log_error(error);
+            return 1;
+        }
+        bool succeeded = runner.run(argv[3], workers);
+
+        if (tracer) {
+            tracer->stop();
+            if (!tracer->write(options["trace"], error)) {
+                logger->log_error(error);
+                return 1;
+            }
+            logger->log_info("Trace written to " + options["trace"]);
+        }
+        logger->close();
+        return succeeded ? 0 : 1;
+    }
+
+    // Check for the 3 required arguments
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0] << " <input_csv> <valid_output> <process_log> [options]" << std::endl;
         std::cerr << std::endl;
         std::cerr << "Arguments:" << std::endl;
-        std::cerr << "  <input_csv>     Input CSV file to process" << std::endl;
-        std::cerr << "  <valid_output>  Output CSV file for valid records" << std::endl;
+        std::cerr << "  <input_csv>     Input CSV or .xlsx file to process" << std::endl;
+        std::cerr << "  <valid_output>  Output file for valid records (.xlsx writes a workbook, anything else CSV)" << std::endl;
         std::cerr << "  <process_log>   Log file for processing details" << std::endl;
+        std::cerr << std::endl;
+        std::cerr << "Options:" << std::endl;
+        std::cerr << "  --stream            Validate and write in fixed-size row blocks (bounded memory)" << std::endl;
+        std::cerr << "  --block-size <n>    Rows per block in --stream mode (default 65536)" << std::endl;
+        std::cerr << "  --threads <n>       Validation worker threads (default: all cores)" << std::endl;
+        std::cerr << "  --schema <file>     INI schema binding column codes to validators (default: built-in ITE schema)" << std::endl;
+        std::cerr << "  --problematic-output <csv>  Also write rows rejected as problematic, with headers" << std::endl;
+        std::cerr << "  --annotated-output <csv>    Also write every row with errors plus an errors column" << std::endl;
+        std::cerr << "  --highlight-errors  Fill the cells with validation errors in .xlsx outputs" << std::endl;
+        std::cerr << "  --output-format <f> csv (default) or arrow: write outputs not ending in .xlsx as Arrow IPC files" << std::endl;
+        std::cerr << "  --errors-output <file>      Also write one record per validation error (JSON Lines, or Arrow)" << std::endl;
+        std::cerr << "  --cache <file>      Reuse validation results of rows unchanged since the last run with this cache" << std::endl;
+        std::cerr << "  --history <index>   Check CURPs and control numbers against earlier runs and add the accepted ones" << std::endl;
+        std::cerr << "  --log-level <level> summary, warn, info or debug (default info; debug adds per-row write tracing)" << std::endl;
+        std::cerr << "  --stats <file>      Write per-phase timings, throughput, allocations, peak RSS and hash-set load as JSON" << std::endl;
+        std::cerr << "  --trace <file>      Write a Chrome trace (chrome://tracing, Perfetto) of every stage and row block" << std::endl;
+        std::cerr << std::endl;
+        std::cerr << "Batch mode: " << argv[0] << " --batch <input_dir|manifest> <output_dir> [--workers <n>] [--shared-dedup]" << std::endl;
+        std::cerr << "  Validates every .csv/.xlsx of a directory, or every path listed in a manifest, on one" << std::endl;
+        std::cerr << "  work-stealing pool; writes <stem>_valid, <stem>_problematic and <stem>.log per input" << std::endl;
+        std::cerr << "  and batch.log and batch_summary.csv. --shared-dedup checks duplicates across all inputs" << std::endl;
+        std::cerr << "  (also takes --schema, --log-level, --find/--replace, --case, --output-format, --trace)" << std::endl;
+        std::cerr << std::endl;
+        std::cerr << "Server mode: " << argv[0] << " --serve <socket> [--workers <n>]" << std::endl;
+        std::cerr << "  Runs validation jobs sent over a Unix domain socket on n warm workers (default: all cores)" << std::endl;
+        return 1;
+    }
+
+    std::map<std::string, std::string> options = parseArguments(argc, argv);
+
+    // Started first so the totals cover the whole run
+    std::unique_ptr<RunStats> stats;
+    if (options.count("stats")) {
+        stats = std::make_unique<RunStats>();
+        stats->streamed = options.count("stream") > 0;
+    }
+    std::unique_ptr<Tracer> tracer;
+    if (options.count("trace")) {
+        if (!Tracer::kEnabled) {
+            std::cerr << "ERROR: --trace is not available in a build with DATALOOM_NO_TRACE" << std::endl;
+            return 1;
+        }
+        tracer = std::make_unique<Tracer>();
+        tracer->start();
+    }
+
+    size_t block_size = 65536;
+    if (options.count("block-size")) {
+        try {
+            block_size = std::stoul(options["block-size"]);
+        } catch (...) {
+            block_size = 0;
+        }
+        if (block_size == 0) {
+            std::cerr << "ERROR: --block-size must be a positive integer" << std::endl;
+            return 1;
+        }
+    }
+
+    std::string problematic_output = options.count("problematic-output") ? options["problematic-output"] : "";
+    std::string annotated_output = options.count("annotated-output") ? options["annotated-output"] : "";
+
+    LogLevel log_level = LogLevel::Info;
+    if (options.count("log-level") && !LogManager::parseLevel(options["log-level"], log_level)) {
+        std::cerr << "ERROR: --log-level must be one of summary, warn, info, debug" << std::endl;
+        return 1;
+    }
+    if (options.count("output-format") && options["output-format"] != "csv" && options["output-format"] != "arrow") {
+        std::cerr << "ERROR: --output-format must be csv or arrow" << std::endl;
         return 1;
     }
 
     // Initialize log manager
     auto logger = std::make_shared<LogManager>();
+    logger->setLevel(log_level);
     if (!logger->initialize(argv[3])) {
         std::cerr << "ERROR: Failed to initialize log file" << std::endl;
         return 1;
@@ -1462,28 +8699,96 @@ int main(int argc, char* argv[]) {
     logger->log_info("Valid output: " + std::string(argv[2]));
     logger->log_info("Process log: " + std::string(argv[3]));
 
-    // No options - create empty options map
-    std::map<std::string, std::string> options;
-
     DataProcessor processor(options, logger);
+    processor.setStats(stats.get());
+
+    if (options.count("schema")) {
+        RunStats::Scope scope(stats.get(), "loadSchema");
+        DATALOOM_TRACE_SCOPE("load", "load schema");
+        auto schema = std::make_shared<ValidationSchema>();
+        std::string error;
+        if (!schema->loadFile(options["schema"], error)) {
+            logger->log_error(error);
+            return 1;
+        }
+        logger->log_info("Validation schema: " + schema->name() + " (" + std::to_string(schema->size()) + " columns)");
+        processor.setSchema(schema);
+    }
+
+    std::shared_ptr<RowCache> row_cache;
+    if (options.count("cache")) {
+        row_cache = std::make_shared<RowCache>();
+        std::string error;
+        if (!row_cache->open(options["cache"], error)) {
+            logger->log_warning(error);
+        }
+        processor.setRowCache(row_cache);
+    }
+
+    std::shared_ptr<HistoryIndex> history;
+    if (options.count("history")) {
+        history = std::make_shared<HistoryIndex>();
+        std::string error;
+        if (!history->open(options["history"], error)) {
+            logger->log_error(error);
+            return 1;
+        }
+        logger->log_info("Duplicate history: " + std::to_string(history->size()) + " keys in " + options["history"]);
+        processor.setHistory(history);
+    }
     
-    if (!processor.loadData(argv[1])) {
-        logger->log_error("Failed to load data from " + std::string(argv[1]));
-        return 1;
+    if (options.count("stream")) {
+        logger->log_info("Processing data in streaming mode...");
+        if (!processor.processStream(argv[1], argv[2], block_size, problematic_output, annotated_output)) {
+            logger->log_error("Failed to stream " + std::string(argv[1]) + " to " + std::string(argv[2]));
+            return 1;
+        }
+    } else {
+        if (!processor.loadData(argv[1])) {
+            logger->log_error("Failed to load data from " + std::string(argv[1]));
+            return 1;
+        }
+
+        logger->log_info("Processing data with comprehensive validation...");
+        processor.processData();
+
+        // Save only valid records
+        if (!processor.saveData(argv[2], problematic_output, annotated_output)) {
+            logger->log_error("Failed to save valid records to " + std::string(argv[2]));
+            return 1;
+        }
     }
 
-    logger->log_info("Processing data with comprehensive validation...");
-    processor.processData();
+    if (row_cache) {
+        RunStats::Scope scope(stats.get(), "commitCache");
+        DATALOOM_TRACE_SCOPE("write", "commit cache");
+        std::string error;
+        if (!row_cache->commit(error)) {
+            logger->log_error(error);
+            return 1;
+        }
+        logger->log_info("Revalidation cache: reused " + std::to_string(processor.getCacheHits()) + " of " + 
+                         std::to_string(processor.getProcessedCount()) + " rows, saved " + 
+                         std::to_string(row_cache->recordsWritten()) + " to " + options["cache"]);
+    }
 
-    // Save only valid records
-    if (!processor.saveData(argv[2])) {
-        logger->log_error("Failed to save valid records to " + std::string(argv[2]));
-        return 1;
+    // Only a run that wrote its outputs adds to the history
+    if (history) {
+        RunStats::Scope scope(stats.get(), "commitHistory");
+        DATALOOM_TRACE_SCOPE("write", "commit history");
+        std::string error;
+        long long added = history->commit(error);
+        if (added < 0) {
+            logger->log_error(error);
+            return 1;
+        }
+        logger->log_info("Added " + std::to_string(added) + " keys to duplicate history " + options["history"] + 
+                         " (" + std::to_string(history->size()) + " total)");
     }
 
     // Print final summary
-    auto problematic_count = processor.getProblematicRows().size();
-    auto total_records = processor.getValidationErrors().size();
+    auto problematic_count = processor.getProblematicCount();
+    auto total_records = processor.getProcessedCount();
     auto valid_count = total_records - problematic_count;
     
     logger->log_summary("=== PROCESSING SUMMARY ===");
@@ -1492,9 +8797,35 @@ int main(int argc, char* argv[]) {
     logger->log_summary("Problematic records filtered: " + std::to_string(problematic_count));
     logger->log_summary("Output file: " + std::string(argv[2]));
     logger->log_summary("==========================");
+
+    if (stats) {
+        processor.collectStats(argv[1]);
+        std::string error;
+        if (!stats->write(options["stats"], error)) {
+            logger->log_error(error);
+            return 1;
+        }
+        logger->log_info("Performance stats written to " + options["stats"]);
+    }
+
+    if (tracer) {
+        {
+            DATALOOM_TRACE_SCOPE("log", "flush log");
+            logger->flush();
+        }
+        tracer->stop();
+        std::string error;
+        if (!tracer->write(options["trace"], error)) {
+            logger->log_error(error);
+            return 1;
+        }
+        logger->log_info("Trace written to " + options["trace"]);
+    }
     
     logger->log_info("=== DATA PROCESSOR FINISHED ===");
     logger->close();
 
     return 0;
-}
\ No newline at end of file
+}
+
+#endif  // DATALOOM_LIBRARY
\ No newline at end of file
@@ -0,0 +1,88 @@
+/* dataloom.h
+ *
+ * C interface of libdataloom.so (built with `make lib`): the validator of
+ * data_processor run inside the calling process. Each dl_processor owns its
+ * own dataset, duplicate sets and log, so separate processors may be used
+ * from separate threads at the same time; a single processor must not be
+ * used from two threads at once.
+ *
+ * Functions returning int return 1 on success and 0 on failure; the reason
+ * is reported as an "ERROR: " line through the log callback.
+ */
+#ifndef DATALOOM_H
+#define DATALOOM_H
+
+#include <stddef.h>
+
+#if defined(_WIN32)
+#define DATALOOM_API __declspec(dllexport)
+#else
+#define DATALOOM_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct dl_processor dl_processor;
+
+/* Bytes that are not NUL-terminated */
+typedef struct {
+    const char* data;
+    size_t size;
+} dl_view;
+
+enum {
+    DL_ROW_VALID = 0,
+    DL_ROW_PROBLEMATIC = 1
+};
+
+typedef struct {
+    size_t row;       /* Data row, as passed to dl_cell */
+    size_t column;
+    const char* code; /* Stable id such as "curp_duplicate" */
+    dl_view message;  /* Valid until the next dl_error call on the processor */
+} dl_error_info;
+
+/* Receives each log line, without its newline, on the processor's log thread.
+ * Every line logged by a call has been delivered when the call returns. */
+typedef void (*dl_log_callback)(const char* line, size_t length, void* user);
+
+/* Options are command-line style arguments, e.g. {"--threads", "4",
+ * "--log-level", "warn", "--schema", "campus.ini"}. Returns NULL if the
+ * schema cannot be loaded. log may be NULL to discard the log. */
+DATALOOM_API dl_processor* dl_create(int argc, const char* const* argv, dl_log_callback log, void* user);
+DATALOOM_API void dl_destroy(dl_processor* processor);
+
+/* Loads CSV or XLSX bytes without copying them. The bytes belong to the
+ * caller and must stay unchanged until dl_destroy. name is used in messages.
+ * A processor loads one dataset. */
+DATALOOM_API int dl_load(dl_processor* processor, const char* data, size_t size, const char* name);
+DATALOOM_API int dl_load_file(dl_processor* processor, const char* path);
+
+/* Validates, auto-corrects and applies the text options of the loaded rows */
+DATALOOM_API int dl_process(dl_processor* processor);
+
+/* Writes the outputs like data_processor; problematic and annotated may be
+ * NULL. Paths ending in .xlsx are written as workbooks. */
+DATALOOM_API int dl_save(dl_processor* processor, const char* valid, const char* problematic, const char* annotated);
+
+DATALOOM_API size_t dl_row_count(const dl_processor* processor);
+DATALOOM_API size_t dl_column_count(const dl_processor* processor);
+DATALOOM_API size_t dl_problematic_count(const dl_processor* processor);
+
+/* Views stay valid until dl_destroy; cells reflect auto-corrections once
+ * dl_process has run. Out-of-range positions give an empty view. */
+DATALOOM_API dl_view dl_header(const dl_processor* processor, size_t column);
+DATALOOM_API dl_view dl_cell(const dl_processor* processor, size_t row, size_t column);
+DATALOOM_API int dl_row_status(const dl_processor* processor, size_t row);
+
+/* Validation errors in row order */
+DATALOOM_API size_t dl_error_count(const dl_processor* processor);
+DATALOOM_API int dl_error(dl_processor* processor, size_t index, dl_error_info* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DATALOOM_H */
@@ -0,0 +1,166 @@
+# dataloom.py
+"""ctypes binding for libdataloom.so (build it with `make lib`).
+
+Runs the C++ validator inside the Python process: data is handed over as
+bytes and read back through views, with no subprocess or temporary files.
+"""
+import ctypes
+import os
+
+
+class _View(ctypes.Structure):
+    _fields_ = [("data", ctypes.POINTER(ctypes.c_char)), ("size", ctypes.c_size_t)]
+
+    def text(self):
+        if not self.size:
+            return ""
+        return ctypes.string_at(self.data, self.size).decode("utf-8", errors="replace")
+
+
+class _ErrorInfo(ctypes.Structure):
+    _fields_ = [
+        ("row", ctypes.c_size_t),
+        ("column", ctypes.c_size_t),
+        ("code", ctypes.c_char_p),
+        ("message", _View),
+    ]
+
+
+_LogCallback = ctypes.CFUNCTYPE(None, ctypes.POINTER(ctypes.c_char), ctypes.c_size_t, ctypes.c_void_p)
+
+_library = None
+
+
+def library_path():
+    return os.path.join(os.path.dirname(os.path.abspath(__file__)), "libdataloom.so")
+
+
+def available():
+    return os.path.exists(library_path())
+
+
+def _load():
+    global _library
+    if _library is not None:
+        return _library
+    lib = ctypes.CDLL(library_path())
+    handle = ctypes.c_void_p
+    lib.dl_create.restype = handle
+    lib.dl_create.argtypes = [ctypes.c_int, ctypes.POINTER(ctypes.c_char_p), _LogCallback, ctypes.c_void_p]
+    lib.dl_destroy.argtypes = [handle]
+    lib.dl_load.argtypes = [handle, ctypes.c_char_p, ctypes.c_size_t, ctypes.c_char_p]
+    lib.dl_load_file.argtypes = [handle, ctypes.c_char_p]
+    lib.dl_process.argtypes = [handle]
+    lib.dl_save.argtypes = [handle, ctypes.c_char_p, ctypes.c_char_p, ctypes.c_char_p]
+    for name in ("dl_row_count", "dl_column_count", "dl_problematic_count", "dl_error_count"):
+        getattr(lib, name).restype = ctypes.c_size_t
+        getattr(lib, name).argtypes = [handle]
+    lib.dl_header.restype = _View
+    lib.dl_header.argtypes = [handle, ctypes.c_size_t]
+    lib.dl_cell.restype = _View
+    lib.dl_cell.argtypes = [handle, ctypes.c_size_t, ctypes.c_size_t]
+    lib.dl_row_status.argtypes = [handle, ctypes.c_size_t]
+    lib.dl_error.argtypes = [handle, ctypes.c_size_t, ctypes.POINTER(_ErrorInfo)]
+    _library = lib
+    return lib
+
+
+class DataLoomError(Exception):
+    pass
+
+
+class Processor:
+    """One dataset: load, process, then read rows and errors or save outputs.
+
+    options are data_processor command-line options, e.g. ["--threads", "4"].
+    on_log(line) is called from the library's log thread for every log line.
+    With keep_log=False and no on_log the log is discarded inside the library,
+    so no Python code runs per line (errors then carry no reason).
+    """
+
+    def __init__(self, options=(), on_log=None, keep_log=True):
+        self._lib = _load()
+        self._data = None
+        self._log_lines = []
+        self._on_log = on_log
+        self._keep_log = keep_log
+
+        def deliver(line, length, _user):
+            text = ctypes.string_at(line, length).decode("utf-8", errors="replace")
+            if self._keep_log:
+                self._log_lines.append(text)
+            if self._on_log:
+                self._on_log(text)
+
+        # Kept on the instance so the callback outlives every call
+        self._callback = _LogCallback(deliver) if keep_log or on_log else _LogCallback()
+        argv = (ctypes.c_char_p * max(1, len(options)))(*[str(o).encode() for o in options])
+        self._handle = self._lib.dl_create(len(options), argv, self._callback, None)
+        if not self._handle:
+            raise DataLoomError(self._last_error("Could not create processor"))
+
+    def _last_error(self, fallback):
+        for line in reversed(self._log_lines):
+            if line.startswith("ERROR: "):
+                return line[len("ERROR: "):]
+        return fallback
+
+    def _check(self, result, what):
+        if not result:
+            raise DataLoomError(self._last_error(what + " failed"))
+
+    def load(self, data, name="buffer"):
+        """Load CSV or XLSX bytes; they are not copied and stay referenced here"""
+        self._data = bytes(data)
+        self._check(self._lib.dl_load(self._handle, self._data, len(self._data), name.encode()), "Load")
+
+    def load_file(self, path):
+        self._check(self._lib.dl_load_file(self._handle, os.fsencode(path)), "Load")
+
+    def process(self):
+        self._check(self._lib.dl_process(self._handle), "Processing")
+
+    def save(self, valid, problematic=None, annotated=None):
+        encode = lambda path: os.fsencode(path) if path else None
+        self._check(self._lib.dl_save(self._handle, encode(valid), encode(problematic), encode(annotated)), "Save")
+
+    @property
+    def log_lines(self):
+        return list(self._log_lines)
+
+    def headers(self):
+        return [self._lib.dl_header(self._handle, j).text() for j in range(self._lib.dl_column_count(self._handle))]
+
+    def row_count(self):
+        return self._lib.dl_row_count(self._handle)
+
+    def problematic_count(self):
+        return self._lib.dl_problematic_count(self._handle)
+
+    def row(self, index):
+        columns = self._lib.dl_column_count(self._handle)
+        return [self._lib.dl_cell(self._handle, index, j).text() for j in range(columns)]
+
+    def is_problematic(self, index):
+        return self._lib.dl_row_status(self._handle, index) == 1
+
+    def errors(self):
+        """(row, column, code, message) for every validation error, in row order"""
+        info = _ErrorInfo()
+        for index in range(self._lib.dl_error_count(self._handle)):
+            if self._lib.dl_error(self._handle, index, ctypes.byref(info)):
+                yield info.row, info.column, info.code.decode(), info.message.text()
+
+    def close(self):
+        if self._handle:
+            self._lib.dl_destroy(self._handle)
+            self._handle = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def __del__(self):
+        self.close()
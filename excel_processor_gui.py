@@ -1,10 +1,12 @@
 # excel_processor_gui.py
 import os
+import re
 import pandas as pd
 import tempfile
 import subprocess
 import flet as ft
 import threading
+import dataloom
 
 class ExcelProcessorFlet:
     def __init__(self):
@@ -135,7 +137,7 @@ class ExcelProcessorFlet:
         )
     
     def process_file(self, e):
-        if not os.path.exists(self.cpp_executable):
+        if not dataloom.available() and not os.path.exists(self.cpp_executable):
             self.show_snackbar("Error: C++ processor executable not found!")
             return
         
@@ -146,33 +148,38 @@ class ExcelProcessorFlet:
         self.process_log.controls.clear()
         self.add_log_message("Starting validation process...", ft.Colors.BLUE)
         
-        # Run processing
-        thread = threading.Thread(target=self.run_processing)
+        # Run processing, in-process when libdataloom.so has been built
+        target = self.run_in_process if dataloom.available() else self.run_processing
+        thread = threading.Thread(target=target)
         thread.daemon = True
         thread.start()
     
     def run_processing(self):
         try:
             self.add_log_message(f"Processing file: {os.path.basename(self.input_file)}", ft.Colors.BLUE)
-            self.update_progress(10, "Converting Excel to CSV...")
-            self.add_log_message("Converting Excel to CSV format...")
-            
-            # Convert Excel to CSV
-            csv_data = self.excel_to_csv(self.input_file)
-            
-            # Save to temporary CSV file
-            self.update_progress(30, "Preparing data for C++...")
-            self.add_log_message("Preparing data for validation...")
-            with tempfile.NamedTemporaryFile(mode='w', suffix='.csv', delete=False) as f:
-                input_csv_path = f.name
-                f.write(csv_data)
+            if self.input_file.lower().endswith('.xlsx'):
+                # The C++ processor reads .xlsx workbooks natively
+                input_csv_path = self.input_file
+            else:
+                self.update_progress(10, "Converting Excel to CSV...")
+                self.add_log_message("Converting Excel to CSV format...")
+                
+                # Convert Excel to CSV
+                csv_data = self.excel_to_csv(self.input_file)
+                
+                # Save to temporary CSV file
+                self.update_progress(30, "Preparing data for C++...")
+                self.add_log_message("Preparing data for validation...")
+                with tempfile.NamedTemporaryFile(mode='w', suffix='.csv', delete=False) as f:
+                    input_csv_path = f.name
+                    f.write(csv_data)
             
             # Generate output file names - ONLY ONE OUTPUT FILE
             input_dir = os.path.dirname(self.input_file)
             input_name = os.path.splitext(os.path.basename(self.input_file))[0]
             
-            # Only valid output file and log file
-            valid_output_path = os.path.join(input_dir, f"output.csv")
+            # Only valid output file and log file; the C++ processor writes the workbook itself
+            valid_output_path = os.path.join(input_dir, f"output.xlsx")
             process_log_path = os.path.join(input_dir, f"process_log_{input_name}.txt")
             
             try:
@@ -180,16 +187,14 @@ class ExcelProcessorFlet:
                 self.update_progress(50, "Processing with C++...")
                 self.add_log_message("Running validation and auto-corrections...", ft.Colors.BLUE)
                 
-                # Pass only 3 arguments to C++ processor
+                # Pass only 3 arguments to C++ processor, plus cell highlighting for the workbook
                 cmd = [
                     self.cpp_executable, 
-                    input_csv_path,        # Input CSV
-                    valid_output_path,     # Valid output CSV
-                    process_log_path       # Log file
+                    input_csv_path,        # Input CSV or XLSX
+                    valid_output_path,     # Valid output XLSX
+                    process_log_path,      # Log file
+                    "--highlight-errors"
                 ]
-                # REMOVED: problematic_output_path from the arguments
-                
-                # REMOVED: No more processing options to pass
                 
                 self.add_log_message(f"Executing: {' '.join(cmd)}")
                 result = subprocess.run(cmd, capture_output=True, text=True, timeout=120)
@@ -202,22 +207,16 @@ class ExcelProcessorFlet:
                 # Load process log
                 self.load_process_log(process_log_path)
                 
-                self.update_progress(70, "Converting outputs to Excel...")
-                self.add_log_message("Converting results to Excel format...")
+                self.update_progress(70, "Checking Excel output...")
                 
-                # Convert valid records to Excel
                 if os.path.exists(valid_output_path):
-                    with open(valid_output_path, 'r') as f:
-                        valid_csv = f.read()
-                    valid_excel_path = os.path.join(input_dir, f"output.xlsx")
-                    self.csv_to_excel(valid_csv, valid_excel_path)
-                    self.valid_output_file = valid_excel_path
-                    self.add_log_message(f"Valid records saved: {os.path.basename(valid_excel_path)}", ft.Colors.GREEN)
+                    self.valid_output_file = valid_output_path
+                    self.add_log_message(f"Valid records saved: {os.path.basename(valid_output_path)}", ft.Colors.GREEN)
                     
-                    # Show record count
-                    df = pd.read_excel(valid_excel_path)
-                    total_records = len(df)
-                    self.add_log_message(f"Total valid records: {total_records}", ft.Colors.GREEN)
+                    # Show record count, as reported by the processor
+                    total_records = self.saved_record_count(process_log_path)
+                    if total_records is not None:
+                        self.add_log_message(f"Total valid records: {total_records}", ft.Colors.GREEN)
                 
                 self.update_progress(100, "Processing completed!")
                 self.add_log_message("Processing completed successfully!", ft.Colors.GREEN)
@@ -226,16 +225,48 @@ class ExcelProcessorFlet:
             finally:
                 # Clean up temporary files
                 for temp_file in [input_csv_path, process_log_path]:
-                    if os.path.exists(temp_file):
+                    if temp_file != self.input_file and os.path.exists(temp_file):
                         os.unlink(temp_file)
-                # Clean up temporary CSV files
-                if os.path.exists(valid_output_path):
-                    os.unlink(valid_output_path)
                         
         except Exception as e:
             self.add_log_message(f"Processing failed: {str(e)}", ft.Colors.RED)
             self.processing_finished(False, f"Processing failed: {str(e)}")
 
+    def run_in_process(self):
+        """Validate through libdataloom.so: no subprocess, temporary CSV or log file"""
+        try:
+            self.add_log_message(f"Processing file: {os.path.basename(self.input_file)}", ft.Colors.BLUE)
+            if self.input_file.lower().endswith(('.xlsx', '.csv')):
+                with open(self.input_file, 'rb') as f:
+                    input_data = f.read()
+            else:
+                self.update_progress(10, "Converting Excel to CSV...")
+                self.add_log_message("Converting Excel to CSV format...")
+                input_data = self.excel_to_csv(self.input_file).encode('utf-8')
+            
+            input_dir = os.path.dirname(self.input_file)
+            valid_output_path = os.path.join(input_dir, f"output.xlsx")
+            
+            self.update_progress(50, "Processing with C++...")
+            self.add_log_message("Running validation and auto-corrections...", ft.Colors.BLUE)
+            self.add_log_message("Process Log:", ft.Colors.BLUE)
+            with dataloom.Processor(["--highlight-errors"], on_log=self.add_process_log_line) as processor:
+                processor.load(input_data, os.path.basename(self.input_file))
+                processor.process()
+                processor.save(valid_output_path)
+                total_records = processor.row_count() - processor.problematic_count()
+            
+            self.valid_output_file = valid_output_path
+            self.add_log_message(f"Valid records saved: {os.path.basename(valid_output_path)}", ft.Colors.GREEN)
+            self.add_log_message(f"Total valid records: {total_records}", ft.Colors.GREEN)
+            self.update_progress(100, "Processing completed!")
+            self.add_log_message("Processing completed successfully!", ft.Colors.GREEN)
+            self.processing_finished(True, f"Successfully processed {os.path.basename(self.input_file)}")
+        
+        except Exception as e:
+            self.add_log_message(f"Processing failed: {str(e)}", ft.Colors.RED)
+            self.processing_finished(False, f"Processing failed: {str(e)}")
+
     def processing_finished(self, success, message):
         self.process_btn.disabled = False
         self.is_processing = False
@@ -275,25 +306,41 @@ class ExcelProcessorFlet:
                 
                 self.add_log_message("Process Log:", ft.Colors.BLUE)
                 for line in log_lines:
-                    line = line.strip()
-                    if line:
-                        # Color code based on content
-                        if "ERROR" in line or "Error" in line:
-                            self.add_log_message(line, ft.Colors.RED)
-                        elif "Auto-filled" in line or "Auto-corrected" in line or "Fixed" in line or "Cleaned" in line:
-                            self.add_log_message(line, ft.Colors.PURPLE)
-                        elif "Warning" in line:
-                            self.add_log_message(line, ft.Colors.ORANGE)
-                        elif "Success" in line or "Saved" in line:
-                            self.add_log_message(line, ft.Colors.GREEN)
-                        else:
-                            self.add_log_message(line)
+                    self.add_process_log_line(line)
             else:
                 self.add_log_message("No detailed process log available", ft.Colors.GREY_600)
                 
         except Exception as e:
             self.add_log_message(f"Could not load process log: {e}", ft.Colors.RED)
 
+    def add_process_log_line(self, line):
+        """Show one line of the C++ process log, colored by its content"""
+        line = line.strip()
+        if not line:
+            return
+        if "ERROR" in line or "Error" in line:
+            self.add_log_message(line, ft.Colors.RED)
+        elif "Auto-filled" in line or "Auto-corrected" in line or "Fixed" in line or "Cleaned" in line:
+            self.add_log_message(line, ft.Colors.PURPLE)
+        elif "Warning" in line:
+            self.add_log_message(line, ft.Colors.ORANGE)
+        elif "Success" in line or "Saved" in line:
+            self.add_log_message(line, ft.Colors.GREEN)
+        else:
+            self.add_log_message(line)
+
+    def saved_record_count(self, log_path):
+        """Number of valid records the processor reports saving, or None"""
+        try:
+            with open(log_path, 'r', encoding='utf-8') as f:
+                for line in f:
+                    match = re.search(r"Saved (\d+) valid records", line)
+                    if match:
+                        return int(match.group(1))
+        except OSError:
+            pass
+        return None
+
     def add_log_message(self, message, color=None):
         """Add a message to the process log with optional color"""
         if color is None:
@@ -325,24 +372,6 @@ class ExcelProcessorFlet:
         except Exception as e:
             raise Exception(f"Error reading Excel file: {str(e)}")
     
-    def csv_to_excel(self, csv_data, output_path):
-        """Convert CSV data back to Excel file"""
-        try:
-            # Read CSV data
-            from io import StringIO
-            df = pd.read_csv(StringIO(csv_data))
-            
-            # Save as Excel
-            if output_path.endswith('.xlsx'):
-                df.to_excel(output_path, index=False, engine='openpyxl')
-            else:
-                df.to_excel(output_path, index=False, engine='xlwt')
-            
-            return True
-            
-        except Exception as e:
-            raise Exception(f"Error writing Excel file: {str(e)}")
-    
     def update_progress(self, value, message):
         """Update progress from background thread"""
         self.progress_bar.value = value / 100
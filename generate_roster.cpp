@@ -0,0 +1,418 @@
+// generate_roster.cpp
+//
+// Synthetic ITE student rosters for benchmarking data_processor without real
+// student data. Rows use the built-in column codes and are consistent the way
+// the validator checks them: the CURP is built from the names, birth date,
+// gender and state (with its real check digit), the RFC from the CURP, the
+// email from the control number, and new students have no credits or
+// averages. A tunable share of rows gets one injected error, and another
+// share repeats the CURP or control number of a recent row. Output is
+// deterministic for a given seed and scales to hundreds of millions of rows
+// in constant memory.
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <map>
+#include <iostream>
+#include <algorithm>
+#include <cctype>
+
+namespace {
+
+// splitmix64: fast, and the same sequence on every platform
+class Random {
+public:
+    explicit Random(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [0, n)
+    uint64_t below(uint64_t n) {
+        return static_cast<uint64_t>((static_cast<unsigned __int128>(next()) * n) >> 64);
+    }
+
+    bool chance(double p) {
+        return static_cast<double>(next() >> 11) * 0x1.0p-53 < p;
+    }
+
+    template <typename T, size_t N>
+    const T& pick(const std::array<T, N>& items) {
+        return items[below(N)];
+    }
+
+private:
+    uint64_t state;
+};
+
+const std::array<const char*, 32> kMaleNames = {
+    "JUAN", "JOSE", "LUIS", "CARLOS", "JORGE", "MIGUEL", "DAVID", "DANIEL", "ALEJANDRO", "FERNANDO",
+    "RICARDO", "EDUARDO", "FRANCISCO", "JAVIER", "ROBERTO", "SERGIO", "ANDRES", "RAUL", "PABLO", "HECTOR",
+    "MANUEL", "OSCAR", "ARTURO", "EMILIANO", "SANTIAGO", "MATEO", "DIEGO", "IVAN", "RAFAEL", "ADRIAN",
+    "GERARDO", "ENRIQUE"};
+
+const std::array<const char*, 32> kFemaleNames = {
+    "MARIA", "GUADALUPE", "ANA", "SOFIA", "FERNANDA", "VALERIA", "DANIELA", "ALEJANDRA", "GABRIELA", "PAOLA",
+    "ANDREA", "MARIANA", "XIMENA", "REGINA", "CAMILA", "LUCIA", "ISABEL", "VERONICA", "LETICIA", "PATRICIA",
+    "ADRIANA", "CLAUDIA", "KARLA", "DIANA", "ELENA", "MONICA", "ROSA", "LAURA", "NATALIA", "JIMENA",
+    "RENATA", "ESTEFANIA"};
+
+const std::array<const char*, 48> kLastNames = {
+    "HERNANDEZ", "GARCIA", "MARTINEZ", "LOPEZ", "GONZALEZ", "PEREZ", "RODRIGUEZ", "SANCHEZ", "RAMIREZ",
+    "CRUZ", "FLORES", "GOMEZ", "MORALES", "VAZQUEZ", "REYES", "JIMENEZ", "TORRES", "DIAZ", "GUTIERREZ",
+    "RUIZ", "MENDOZA", "AGUILAR", "ORTIZ", "MORENO", "CASTILLO", "ROMERO", "ALVAREZ", "MENDEZ", "CHAVEZ",
+    "RIVERA", "JUAREZ", "RAMOS", "DOMINGUEZ", "HERRERA", "MEDINA", "CASTRO", "VARGAS", "GUZMAN",
+    "VELAZQUEZ", "MU\xC3\x91OZ", "ROJAS", "CONTRERAS", "SALAZAR", "LUNA", "ORTEGA", "NU\xC3\x91" "EZ",
+    "DE LA CRUZ", "ESPINOZA"};
+
+const std::array<const char*, 32> kStates = {
+    "AS", "BC", "BS", "CC", "CL", "CM", "CS", "CH", "DF", "DG", "GT", "GR", "HG", "JC", "MC", "MN",
+    "MS", "NT", "NL", "OC", "PL", "QT", "QR", "SP", "SL", "SR", "TC", "TS", "TL", "VZ", "YN", "ZS"};
+
+const std::array<const char*, 10> kCareers = {
+    "ISC", "IIN", "IEM", "IGE", "IEL", "IME", "ARQ", "LAD", "ICI", "IBQ"};
+
+const std::array<const char*, 5> kDisabilities = {
+    "Visual", "Auditiva", "Motriz", "Intelectual", "Psicosocial"};
+
+const std::array<const char*, 6> kAreaCodes = {"646", "664", "686", "665", "612", "656"};
+
+const char* const kHeader =
+    "ctr,cur,nom,app,apm,sem,sex,psa1,pge,cac,res,ema,rfc,cel,dis,tipo_discapacidad,"
+    "lengua_indigena,reingreso,movilidad,car";
+
+constexpr size_t kColumns = 20;
+enum Column { Ctr, Cur, Nom, App, Apm, Sem, Sex, Psa1, Pge, Cac, Res, Ema, Rfc, Cel, Dis, Tipo, Lengua, Reingreso,
+              Movilidad, Car };
+
+bool isVowel(char c) {
+    return c == 'A' || c == 'E' || c == 'I' || c == 'O' || c == 'U';
+}
+
+bool isAsciiUpper(char c) {
+    return c >= 'A' && c <= 'Z';
+}
+
+// Letters of a name as the validator reads them: ASCII letters only
+char initial(std::string_view name) {
+    for (char c : name) {
+        if (isAsciiUpper(c)) return c;
+    }
+    return 'X';
+}
+
+char firstInnerVowel(std::string_view name) {
+    bool first = true;
+    for (char c : name) {
+        if (!isAsciiUpper(c)) continue;
+        if (first) {
+            first = false;
+            continue;
+        }
+        if (isVowel(c)) return c;
+    }
+    return 'X';
+}
+
+char firstInnerConsonant(std::string_view name) {
+    bool first = true;
+    for (char c : name) {
+        if (!isAsciiUpper(c)) continue;
+        if (first) {
+            first = false;
+            continue;
+        }
+        if (!isVowel(c)) return c;
+    }
+    return 'X';
+}
+
+// CURP check digit over the first 17 characters
+char curpCheckDigit(const char* curp) {
+    static const char kAlphabet[] = "0123456789ABCDEFGHIJKLMN&OPQRSTUVWXYZ";
+    int sum = 0;
+    for (int i = 0; i < 17; ++i) {
+        const char* position = std::strchr(kAlphabet, curp[i]);
+        int value = position ? static_cast<int>(position - kAlphabet) : 0;
+        sum += value * (18 - i);
+    }
+    return static_cast<char>('0' + (10 - sum % 10) % 10);
+}
+
+// One student's identity; duplicates of a CURP repeat all of it
+struct Identity {
+    std::string name;
+    std::string paternal;
+    std::string maternal;
+    std::string curp;
+    std::string rfc;
+    char sex;
+};
+
+Identity makeIdentity(Random& random) {
+    Identity person;
+    person.sex = random.chance(0.5) ? 'H' : 'M';
+    const auto& names = person.sex == 'H' ? kMaleNames : kFemaleNames;
+    person.name = random.pick(names);
+    if (random.chance(0.3)) {
+        person.name += ' ';
+        person.name += random.pick(names);
+    }
+    person.paternal = random.pick(kLastNames);
+    if (!random.chance(0.02)) person.maternal = random.pick(kLastNames);
+
+    int year = 1995 + static_cast<int>(random.below(12));
+    int month = 1 + static_cast<int>(random.below(12));
+    int day = 1 + static_cast<int>(random.below(28));
+    char curp[19];
+    curp[0] = initial(person.paternal);
+    curp[1] = firstInnerVowel(person.paternal);
+    curp[2] = person.maternal.empty() ? 'X' : initial(person.maternal);
+    curp[3] = initial(person.name);
+    std::snprintf(curp + 4, 7, "%02d%02d%02d", year % 100, month, day);
+    curp[10] = person.sex;
+    const char* state = random.pick(kStates);
+    curp[11] = state[0];
+    curp[12] = state[1];
+    curp[13] = firstInnerConsonant(person.paternal);
+    curp[14] = person.maternal.empty() ? 'X' : firstInnerConsonant(person.maternal);
+    curp[15] = firstInnerConsonant(person.name);
+    curp[16] = year < 2000 ? static_cast<char>('0' + random.below(10)) : static_cast<char>('A' + random.below(26));
+    curp[17] = curpCheckDigit(curp);
+    curp[18] = '\0';
+    person.curp = curp;
+
+    static const char kAlnum[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    person.rfc = person.curp.substr(0, 10);
+    for (int i = 0; i < 3; ++i) person.rfc += kAlnum[random.below(36)];
+    return person;
+}
+
+std::string digits(Random& random, size_t count) {
+    std::string out;
+    for (size_t i = 0; i < count; ++i) out += static_cast<char>('0' + random.below(10));
+    return out;
+}
+
+std::string decimal(Random& random, int low, int high) {
+    char text[16];
+    int hundredths = low * 100 + static_cast<int>(random.below(static_cast<uint64_t>((high - low) * 100 + 1)));
+    std::snprintf(text, sizeof(text), "%d.%02d", hundredths / 100, hundredths % 100);
+    return text;
+}
+
+// Replaces one cell with a value the validator reports or corrects
+void injectError(Random& random, std::array<std::string, kColumns>& row) {
+    switch (random.below(16)) {
+        case 0: row[Cur].clear(); break;
+        case 1: row[Cur].resize(16); break;
+        case 2: row[Cur][5] = '*'; break;
+        case 3: row[Nom] += " 2"; break;
+        case 4: row[App] = "GARRRIDO"; break;
+        case 5: row[Sex] = random.chance(0.5) ? "Q" : ""; break;
+        case 6: row[Sem] = random.chance(0.5) ? "0" : "x"; break;
+        case 7: row[Psa1] = random.chance(0.5) ? "101.5" : "abc"; break;
+        case 8: row[Cel] = random.chance(0.5) ? "646-13x-0058" : "12345"; break;
+        case 9: for (char& c : row[Rfc]) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c))); break;
+        case 10: row[Dis] = "S"; row[Tipo].clear(); break;
+        case 11: row[Res] = "maybe"; break;
+        case 12: row[Ctr] = random.chance(0.5) ? "" : "1234"; break;
+        case 13: row[Ema] = "student@gmail.com"; break;
+        case 14: row[Cur][3] = row[Cur][3] == 'Q' ? 'W' : 'Q'; break;
+        default: row[Cac] = "-5"; break;
+    }
+}
+
+class CsvOutput {
+public:
+    explicit CsvOutput(FILE* file) : file(file) {
+        buffer.reserve(kFlushBytes + 4096);
+    }
+
+    ~CsvOutput() {
+        flush();
+    }
+
+    void row(const std::array<std::string, kColumns>& cells) {
+        for (size_t j = 0; j < kColumns; ++j) {
+            if (j > 0) buffer += ',';
+            const std::string& cell = cells[j];
+            if (cell.find_first_of(",\"\n") == std::string::npos) {
+                buffer += cell;
+                continue;
+            }
+            buffer += '"';
+            for (char c : cell) {
+                if (c == '"') buffer += '"';
+                buffer += c;
+            }
+            buffer += '"';
+        }
+        buffer += '\n';
+        if (buffer.size() >= kFlushBytes) flush();
+    }
+
+    void line(std::string_view text) {
+        buffer.append(text);
+        buffer += '\n';
+    }
+
+    void flush() {
+        std::fwrite(buffer.data(), 1, buffer.size(), file);
+        buffer.clear();
+    }
+
+private:
+    static constexpr size_t kFlushBytes = 1 << 20;
+    FILE* file;
+    std::string buffer;
+};
+
+std::map<std::string, std::string> parseArguments(int argc, char* argv[], int first) {
+    std::map<std::string, std::string> options;
+    for (int i = first; i < argc; ++i) {
+        if (argv[i][0] == '-' && argv[i][1] == '-') {
+            std::string key = argv[i] + 2;
+            size_t eq = key.find('=');
+            if (eq != std::string::npos) {
+                options[key.substr(0, eq)] = key.substr(eq + 1);
+            } else if (i + 1 < argc) {
+                options[key] = argv[++i];
+            }
+        }
+    }
+    return options;
+}
+
+bool parseRate(const std::map<std::string, std::string>& options, const char* key, double& rate) {
+    auto it = options.find(key);
+    if (it == options.end()) return true;
+    char* end = nullptr;
+    rate = std::strtod(it->second.c_str(), &end);
+    if (end == it->second.c_str() || *end != '\0' || rate < 0 || rate > 1) {
+        std::cerr << "ERROR: --" << key << " must be between 0 and 1" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <rows> <output_csv> [options]" << std::endl;
+        std::cerr << std::endl;
+        std::cerr << "  <output_csv> may be - for standard output" << std::endl;
+        std::cerr << std::endl;
+        std::cerr << "Options:" << std::endl;
+        std::cerr << "  --seed <n>             Random seed (default 1); the same seed gives the same file" << std::endl;
+        std::cerr << "  --error-rate <p>       Share of rows with one injected validation error (default 0.05)" << std::endl;
+        std::cerr << "  --duplicate-rate <p>   Share of rows repeating a recent CURP or control number (default 0.01)" << std::endl;
+        return 1;
+    }
+
+    char* end = nullptr;
+    unsigned long long rows = std::strtoull(argv[1], &end, 10);
+    if (end == argv[1] || *end != '\0') {
+        std::cerr << "ERROR: <rows> must be a non-negative integer" << std::endl;
+        return 1;
+    }
+    std::map<std::string, std::string> options = parseArguments(argc, argv, 3);
+    double error_rate = 0.05;
+    double duplicate_rate = 0.01;
+    if (!parseRate(options, "error-rate", error_rate) || !parseRate(options, "duplicate-rate", duplicate_rate)) {
+        return 1;
+    }
+    uint64_t seed = options.count("seed") ? std::strtoull(options["seed"].c_str(), nullptr, 10) : 1;
+
+    FILE* file = std::string(argv[2]) == "-" ? stdout : std::fopen(argv[2], "wb");
+    if (!file) {
+        std::cerr << "ERROR: Cannot create file " << argv[2] << std::endl;
+        return 1;
+    }
+
+    Random random(seed);
+    // Control numbers are an affine permutation of the row index, so they are
+    // unique without remembering them: 8 digits up to 10M rows, then 10
+    const uint64_t id_space = rows <= 10000000ULL ? 10000000ULL : 1000000000ULL;
+    if (rows > id_space) {
+        std::cerr << "ERROR: at most " << id_space << " rows" << std::endl;
+        return 1;
+    }
+    const uint64_t id_offset = random.below(id_space);
+
+    // Recent rows that duplicates are drawn from
+    constexpr size_t kRecent = 4096;
+    std::vector<Identity> recent_people(kRecent);
+    std::vector<std::string> recent_ids(kRecent);
+
+    CsvOutput out(file);
+    out.line(kHeader);
+    std::array<std::string, kColumns> row;
+    for (uint64_t i = 0; i < rows; ++i) {
+        Identity person;
+        bool duplicate = i > 0 && random.chance(duplicate_rate);
+        bool same_student = duplicate && random.chance(0.5);
+        if (same_student) {
+            person = recent_people[random.below(std::min<uint64_t>(i, kRecent))];
+        } else {
+            person = makeIdentity(random);
+        }
+
+        uint64_t id = (i * 2654435761ULL + id_offset) % id_space;
+        std::string ctr = (id_space == 10000000ULL ? "2" : "20");
+        std::string number = std::to_string(id);
+        ctr += std::string((id_space == 10000000ULL ? 7 : 9) - number.size(), '0') + number;
+        if (duplicate && !same_student) ctr = recent_ids[random.below(std::min<uint64_t>(i, kRecent))];
+
+        int semester = 1 + static_cast<int>(random.below(12));
+        bool new_student = semester == 1;
+        bool disability = random.chance(0.04);
+
+        row[Ctr] = ctr;
+        row[Cur] = person.curp;
+        row[Nom] = person.name;
+        row[App] = person.paternal;
+        row[Apm] = person.maternal;
+        row[Sem] = std::to_string(semester);
+        row[Sex] = std::string(1, person.sex);
+        row[Psa1] = new_student ? "0.00" : decimal(random, 70, 100);
+        row[Pge] = new_student ? "0.00" : decimal(random, 70, 100);
+        row[Cac] = new_student ? "0" : std::to_string((semester - 1) * 24 + static_cast<int>(random.below(12)));
+        row[Res] = semester >= 8 && random.chance(0.6) ? "S" : "N";
+        row[Ema] = "al" + ctr + "@ite.edu.mx";
+        row[Rfc] = person.rfc;
+        row[Cel] = std::string(random.pick(kAreaCodes)) + digits(random, 7);
+        row[Dis] = disability ? "S" : "N";
+        row[Tipo] = disability ? random.pick(kDisabilities) : "";
+        row[Lengua] = random.chance(0.06) ? "S" : "N";
+        row[Reingreso] = new_student ? "N" : "S";
+        row[Movilidad] = random.chance(0.02) ? "Intercambio, UABC" : "";
+        row[Car] = random.pick(kCareers);
+
+        if (random.chance(error_rate)) injectError(random, row);
+        out.row(row);
+
+        recent_people[i % kRecent] = std::move(person);
+        recent_ids[i % kRecent] = ctr;
+    }
+    out.flush();
+
+    bool written = std::ferror(file) == 0;
+    if (file != stdout) written = std::fclose(file) == 0 && written;
+    if (!written) {
+        std::cerr << "ERROR: Cannot write " << argv[2] << std::endl;
+        return 1;
+    }
+    return 0;
+}